@@ -0,0 +1,85 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file addrmap.h
+ *
+ * Hash table mapping target addresses to pointers.
+ *
+ * Used for the breakpoint table, which is searched on every breakpoint
+ * and singlestep event. Open addressing with linear probing keeps the
+ * keys and values in one array, and the table grows with the number of
+ * entries instead of using a fixed number of buckets.
+ */
+#ifndef FTK_ADDRMAP_H
+#define FTK_ADDRMAP_H
+
+#include <stddef.h>
+
+#include "target_mem.h"
+
+struct addrmap;
+
+/**
+ * Creates an empty table.
+ */
+extern struct addrmap *addrmap_init(void);
+
+/**
+ * Frees the table. The values are not freed.
+ */
+extern void addrmap_clear(struct addrmap *m);
+
+/**
+ * Maps the address to the value, which must not be NULL.
+ *
+ * @return   the value previously mapped to the address, or NULL.
+ */
+extern void *addrmap_enter(struct addrmap *m, addr_t key, void *value);
+
+/**
+ * Removes the address from the table.
+ *
+ * @return   the value mapped to the address, or NULL.
+ */
+extern void *addrmap_remove(struct addrmap *m, addr_t key);
+
+/**
+ * Returns the value mapped to the address, or NULL.
+ */
+extern void *addrmap_find(struct addrmap *m, addr_t key);
+
+/**
+ * Returns the number of addresses in the table.
+ */
+extern size_t addrmap_size(struct addrmap *m);
+
+/**
+ * Calls the function for every address in the table. The table must not
+ * be modified by the function.
+ */
+extern void addrmap_apply_to_all(struct addrmap *m,
+		void (*func)(addr_t key, void *value, void *data), void *data);
+
+#endif /* !FTK_ADDRMAP_H */
@@ -0,0 +1,178 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file agent.h
+ *
+ * In-process recording agent.
+ *
+ * With --agent option the started program is run with the agent library
+ * preloaded. The agent interposes the memory allocation functions and
+ * writes a fixed size record of every call, including the arguments, the
+ * return value and the raw return addresses of the caller stack, into a
+ * ring buffer shared with functracer. The functions handled by the agent
+ * don't get breakpoints, so the traced process is not stopped on them.
+ *
+ * The attached processes get the agent loaded by calling dlopen() in them
+ * through the SSOL area (see ssol_call()). The loaded agent can't
+ * interpose the functions, so it points their GOT entries in the loaded
+ * objects to its hooks instead, also in the objects loaded later. The
+ * functions are traced with breakpoints in the processes the agent can't
+ * be loaded into, like the attached processes executing a new program.
+ *
+ * This header is shared by functracer and the agent library, so it must
+ * not depend on the rest of functracer.
+ */
+#ifndef FTK_AGENT_H
+#define FTK_AGENT_H
+
+#include <time.h>
+
+/* environment variable passing the ring buffer path to the agent */
+#define AGENT_RING_ENV		"FUNCTRACER_AGENT_RING"
+
+#define AGENT_MAGIC		0x46544147	/* "FTAG" */
+#define AGENT_VERSION		3
+
+/* number of records in the ring buffer */
+#define AGENT_RING_SIZE		16384
+#define AGENT_MAX_ARGS		3
+#define AGENT_MAX_FRAMES	32
+
+/* functions hooked by the agent */
+enum {
+	AGENT_MALLOC,
+	AGENT_FREE,
+	AGENT_CALLOC,
+	AGENT_REALLOC,
+	AGENT_POSIX_MEMALIGN,
+	AGENT_MEMALIGN,
+	AGENT_VALLOC,
+	AGENT_NFUNCTIONS
+};
+
+/* flags of the record seq while the writer fills the record and after the
+ * reader has given up waiting for it */
+#define AGENT_SEQ_BUSY		(~0UL ^ (~0UL >> 1))
+#define AGENT_SEQ_SKIPPED	(AGENT_SEQ_BUSY >> 1)
+
+struct agent_record {
+	/* index of the record + 1, with AGENT_SEQ_BUSY flag while the record
+	 * is written and without flags when it is complete */
+	volatile unsigned long seq;
+	unsigned long function;
+	unsigned long tid;
+	/* CLOCK_MONOTONIC time of the call */
+	struct timespec time;
+	unsigned long args[AGENT_MAX_ARGS];
+	unsigned long retval;
+	/* value stored through the first argument (posix_memalign()) */
+	unsigned long result;
+	unsigned long nframes;
+	unsigned long frames[AGENT_MAX_FRAMES];
+};
+
+/*
+ * The ring is written by all the threads and processes running the agent
+ * and read by functracer. A writer reserves a record by advancing head
+ * unless the ring is full, claims the slot by setting its seq from the
+ * value left by the previous use of the slot, and completes the record by
+ * clearing the busy flag. The reader advances tail after processing the
+ * record. A record not completed in time (its writer was killed) is given
+ * up by the reader setting the skipped flag instead, so that the slot can
+ * be reused: the writer can't claim or complete a given up record. The
+ * counters are never wrapped to the ring size.
+ */
+struct agent_ring {
+	unsigned long magic;
+	unsigned long version;
+	unsigned long size;
+	/* backtrace depth */
+	unsigned long depth;
+	/* mask of the functions to be recorded, set by functracer */
+	volatile unsigned long functions;
+	volatile unsigned long head;
+	volatile unsigned long tail;
+	/* records dropped because the ring was full */
+	volatile unsigned long lost;
+	struct agent_record records[];
+};
+
+#define AGENT_RING_LENGTH(size) \
+	(sizeof(struct agent_ring) + (size) * sizeof(struct agent_record))
+
+/* function setting up the agent loaded into an attached process, called
+ * with the ring buffer path */
+#define AGENT_ATTACH_FUNCTION	"ftagent_attach"
+
+#ifdef AGENT_LIBRARY
+extern int ftagent_attach(const char *path);
+#endif
+
+#ifndef AGENT_LIBRARY
+
+struct process;
+
+/**
+ * Creates the ring buffer if the agent is enabled.
+ */
+extern void agent_init(void);
+
+/**
+ * Removes the ring buffer.
+ */
+extern void agent_finish(void);
+
+extern int agent_enabled(void);
+
+/**
+ * Sets up the environment of the started program for loading the agent.
+ *
+ * Called in the child process before exec.
+ */
+extern int agent_setup_child(void);
+
+/**
+ * Sets up the agent in a new address space: the started programs have it
+ * preloaded, and it's loaded into the attached processes. Must be called
+ * before inserting the breakpoints.
+ */
+extern void agent_attach(struct process *proc);
+
+/**
+ * Enables recording of the function by the agent.
+ *
+ * @return   0 if the function is recorded by the agent, -1 if it must be
+ *           traced with breakpoints.
+ */
+extern int agent_register(struct process *proc, const char *symname);
+
+/**
+ * Reports the function calls recorded by the agent.
+ */
+extern void agent_read_records(void);
+
+#endif /* !AGENT_LIBRARY */
+
+#endif /* !FTK_AGENT_H */
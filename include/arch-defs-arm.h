@@ -29,5 +29,6 @@
 #define DECR_PC_AFTER_BREAK	0	/* decrement after breakpoint */
 #define MAX_INSN_SIZE		16	/* maximum instruction size */
 #define FT_PTRACE_SINGLESTEP	PTRACE_CONT
+#define FT_AUDIT_ARCH		AUDIT_ARCH_ARM	/* seccomp filter architecture */
 
 #endif /* !FT_ARCH_DEFS_ARM_H */
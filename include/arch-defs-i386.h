@@ -29,5 +29,6 @@
 #define DECR_PC_AFTER_BREAK	1	/* decrement after breakpoint */
 #define MAX_INSN_SIZE		32	/* maximum instruction size */
 #define FT_PTRACE_SINGLESTEP	PTRACE_SINGLESTEP
+#define FT_AUDIT_ARCH		AUDIT_ARCH_I386	/* seccomp filter architecture */
 
 #endif /* !FT_ARCH_DEFS_I386_H */
@@ -28,8 +28,9 @@
 #include <sys/types.h>
 
 struct bt_data;
+struct process;
 
-extern struct bt_data *bt_init(pid_t pid);
+extern struct bt_data *bt_init(struct process *proc);
 extern int bt_backtrace(struct bt_data *btd, void** frames, char **buffer, int size);
 extern void bt_finish(struct bt_data *btd);
 
@@ -55,18 +55,30 @@ struct breakpoint {
 	void (*ssol_pre_handler)(struct process *proc, struct breakpoint *bkpt);
 	void (*ssol_post_handler)(struct process *proc, struct breakpoint *bkpt);
 	void *ssol_data;
+	/* size of the displaced instruction if its SSOL copy jumps back to
+	 * the original code by itself (no singlestep needed), otherwise 0 */
+	int ssol_boost;
 };
 
 extern void set_instruction_pointer(struct process *proc, addr_t addr);
+extern addr_t get_instruction_pointer(struct process *proc);
 extern addr_t bkpt_get_address(struct process *proc);
 extern struct bkpt_insn *breakpoint_instruction(addr_t addr);
 extern addr_t fixup_address(addr_t addr);
 extern void bkpt_handle(struct process *proc, addr_t addr);
 extern void singlestep_handle(struct process *proc, addr_t addr);
 extern void singlestep_after_signal(struct process *proc);
+extern void bkpt_leave_ssol(struct process *proc);
 extern void bkpt_init(struct process *proc);
+/**
+ * Sets up the breakpoints of a forked child as a copy of the parent's
+ * ones. The child's address space is a copy of the parent's, so the
+ * breakpoints and the SSOL area are already in place there.
+ */
+extern void bkpt_fork(struct process *child, struct process *parent);
 extern void bkpt_finish(struct process *proc);
 extern void disable_all_breakpoints(struct process *proc);
 extern int ssol_prepare_bkpt(struct breakpoint *bkpt, void *safe_insn);
+extern int ssol_boost_bkpt(struct breakpoint *bkpt, void *safe_insn);
 
 #endif /* !FTK_BREAKPOINT_H */
@@ -0,0 +1,81 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file collector.h
+ *
+ * Protocol of the trace stream sent to a collector.
+ *
+ * With --collector option the trace records of all traced processes are
+ * sent to a local collector daemon over a UNIX domain stream socket or a
+ * named pipe, instead of being written to files. The stream starts with
+ * a stream header:
+ *
+ *   char[4] COLLECTOR_MAGIC
+ *   u16     COLLECTOR_VERSION
+ *   u16     reserved
+ *
+ * followed by frames of a 16 byte frame header and the frame payload:
+ *
+ *   u32 payload length
+ *   u32 sequence number
+ *   u32 trace identifier (PID of the traced process)
+ *   u8  frame type (COLLECTOR_EVENT, COLLECTOR_BACKTRACE)
+ *   u8  payload format (COLLECTOR_TEXT, COLLECTOR_BINARY)
+ *   u16 reserved
+ *
+ * Integers are little-endian. The payload is a part of the trace of the
+ * given process, in rtrace text or in the binary trace format, whose
+ * file header is sent in the first frame of the trace. A frame holds
+ * whole records: a function call with its arguments, its backtrace, or
+ * a declaration or comment.
+ *
+ * The sequence number is increased for every frame, also for the frames
+ * dropped when the collector doesn't keep up, so that the collector can
+ * detect the gaps. Backtraces are dropped first, when the output buffer
+ * is half full. Other frames are dropped only when it is full, and only
+ * with drop output policy. The strings of a binary trace defined in
+ * a dropped frame are defined again in the frame using them next.
+ */
+#ifndef FTK_COLLECTOR_H
+#define FTK_COLLECTOR_H
+
+#define COLLECTOR_MAGIC		"FTRC"
+#define COLLECTOR_VERSION	1
+#define COLLECTOR_HEADER_SIZE	8
+#define COLLECTOR_FRAME_SIZE	16
+
+/* frame types */
+enum {
+	COLLECTOR_EVENT,
+	COLLECTOR_BACKTRACE,
+};
+
+/* payload formats */
+enum {
+	COLLECTOR_TEXT,
+	COLLECTOR_BINARY,
+};
+
+#endif /* !FTK_COLLECTOR_H */
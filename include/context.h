@@ -41,6 +41,9 @@ struct process;
 /* the call context value */
 extern int context_mask;
 
+/* NULL terminated list of the context handling function names */
+extern const char *context_symbols[];
+
 /**
  * Checks if the symbol name matches context handling function names.
  */
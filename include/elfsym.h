@@ -0,0 +1,152 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file elfsym.h
+ *
+ * Minimal ELF file reader for the symbol lookups done on startup.
+ *
+ * The file is mapped to memory and its symbol and string tables are used
+ * in place, without copying them or allocating memory per symbol like
+ * libbfd does. Only files of the native class and byte order are
+ * handled, elf_open() fails for other files, which are then read with
+ * libbfd.
+ */
+#ifndef FTK_ELFSYM_H
+#define FTK_ELFSYM_H
+
+#include "target_mem.h"
+
+struct elf_file;
+
+/* symbol tables */
+enum elf_symtab {
+	ELF_DYNSYM,	/* dynamic symbol table */
+	ELF_SYMTAB,	/* full symbol table */
+};
+
+/**
+ * Maps the ELF file to memory.
+ *
+ * @return   the opened file, or NULL if it can't be read.
+ */
+extern struct elf_file *elf_open(const char *filename);
+
+/**
+ * Opens the separate debug symbol file of the ELF file, located with its
+ * .gnu_debuglink section like gdb does.
+ *
+ * @param[in] filename   the path of the ELF file.
+ * @return               the opened debug file, or NULL if not found.
+ */
+extern struct elf_file *elf_open_debug(struct elf_file *ef,
+				       const char *filename);
+
+/**
+ * Finds the separate debug symbol file like elf_open_debug(), without
+ * reading it to check its CRC.
+ *
+ * @param[out] path   the path of the first debug file found.
+ * @return            0 if found, -1 otherwise.
+ */
+extern int elf_find_debug(struct elf_file *ef, const char *filename,
+			  char *path, size_t size);
+
+extern void elf_close(struct elf_file *ef);
+
+/**
+ * Checks if the file contains the named section.
+ */
+extern int elf_has_section(struct elf_file *ef, const char *name);
+
+/**
+ * Checks if the file is prelinked.
+ */
+extern int elf_is_prelinked(struct elf_file *ef);
+
+/**
+ * Calls the function for every defined function symbol in the symbol
+ * table. The symbol value has the lowest bit set for Thumb functions.
+ *
+ * @return   the number of symbols in the table, -1 if there is no table.
+ */
+extern long elf_for_each_function(struct elf_file *ef, enum elf_symtab table,
+		void (*func)(const char *name, addr_t value, void *data),
+		void *data);
+
+/**
+ * Checks if the file has a dynamic symbol hash table.
+ */
+extern int elf_has_dynamic_hash(struct elf_file *ef);
+
+/**
+ * Looks up function symbols of the given name from the dynamic symbol
+ * table using its .gnu.hash or .hash section, and calls the function for
+ * each of them (there may be several versions of the symbol).
+ *
+ * @return   the number of symbols found, -1 if the file has no dynamic
+ *           symbol hash table.
+ */
+extern int elf_lookup_dynamic(struct elf_file *ef, const char *name,
+		void (*func)(const char *name, addr_t value, void *data),
+		void *data);
+
+/**
+ * Looks up a function symbol in code section, first from the full and
+ * then from the dynamic symbol table.
+ *
+ * @return   the symbol value, or 0 if not found.
+ */
+extern addr_t elf_lookup_function(struct elf_file *ef, const char *name);
+
+/**
+ * Returns the program entry point address.
+ */
+extern addr_t elf_entry(struct elf_file *ef);
+
+/**
+ * Checks if the first loadable segment is linked at address 0, i.e. the
+ * file is position independent.
+ */
+extern int elf_is_pic(struct elf_file *ef);
+
+/**
+ * Returns the link time address of the dynamic section, or 0.
+ */
+extern addr_t elf_dynamic(struct elf_file *ef);
+
+/**
+ * Retrieves the page aligned link time address range of the loadable
+ * segments.
+ *
+ * @return   0 on success, -1 if there are no loadable segments.
+ */
+extern int elf_load_range(struct elf_file *ef, addr_t *lo, addr_t *hi);
+
+/**
+ * Returns the program interpreter path, or NULL.
+ */
+extern const char *elf_interp(struct elf_file *ef);
+
+#endif /* !FTK_ELFSYM_H */
@@ -37,6 +37,33 @@ extern void fn_do_return(struct process *proc);
 extern int fn_callstack_push(struct process *proc, char *fn_name);
 extern void fn_callstack_pop(struct process *proc);
 extern void fn_callstack_restore(struct process *proc, int original);
+/**
+ * Copies the call stack of a process to its forked child.
+ *
+ * @param[in] map_name   returns the function name to be used by the
+ *                       child for the name used by the parent.
+ */
+extern void fn_callstack_clone(struct process *dst, struct process *src,
+			char *(*map_name)(char *name, void *data), void *data);
+struct callstack;
+/**
+ * Returns the stack address where the return address of the traced call
+ * is expected to be saved (holding the SSOL return address).
+ */
+extern addr_t fn_return_address_slot(struct callstack *cs);
 extern char *fn_name(struct process *proc);
+/**
+ * Sets up the registers and the stack for calling a function, like the
+ * caller would do.
+ *
+ * @param[in,out] regs    the registers of the process, modified for the
+ *                        call.
+ * @param[in] fn          the function address.
+ * @param[in] argnum      the number of the arguments (up to four).
+ * @param[in] args        the arguments.
+ * @param[in] ret_addr    the return address of the call.
+ */
+extern void fn_setup_call(struct process *proc, void *regs, addr_t fn,
+			  unsigned int argnum, long *args, addr_t ret_addr);
 
 #endif /* !FTK_FUNCTION_H */
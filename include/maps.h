@@ -22,16 +22,29 @@
  *
  */
 
+/**
+ * @file maps.h
+ *
+ * Memory mappings of the traced processes, read from /proc/PID/maps.
+ *
+ * The mappings of a traced address space are kept in an index that is
+ * read on the first lookup after a library load or unload event, or an
+ * exec, instead of parsing the maps file for every lookup.
+ */
 #ifndef FTK_MAPS_H
 #define FTK_MAPS_H
 
-#include <stdio.h>
 #include <sys/types.h>
 
+#include "target_mem.h"
+
+struct process;
+
 struct maps_data {
-	FILE *fp;
+	/* next line in the procfs buffer of the calling thread */
+	char *pos;
 	unsigned long lo, hi, off;
-	char perm[4];
+	char perm[5];
 	unsigned int maj, min;
 	int inum;
 	char *path;
@@ -39,8 +52,40 @@ struct maps_data {
 
 #define MAP_EXEC(md)	((md)->perm[2] == 'x')
 
+/**
+ * Reads the mappings of the process. The mappings are returned one by one
+ * by maps_next(), which returns 0 after the last one.
+ *
+ * The path is valid until the next maps_init() of the calling thread.
+ */
 extern int maps_init(struct maps_data *md, pid_t pid);
 extern int maps_next(struct maps_data *md);
 extern int maps_finish(struct maps_data *md);
 
+/* mappings in address order */
+struct maps_index {
+	struct maps_data *maps;
+	int nmaps;
+};
+
+/**
+ * Returns the mappings of the traced address space, reading them if they
+ * have changed since the previous call.
+ *
+ * @return   the mappings, or NULL if they can't be read.
+ */
+extern struct maps_index *maps_get(struct process *proc);
+
+/**
+ * Drops the mappings of the address space after they have changed.
+ */
+extern void maps_invalidate(struct process *proc);
+
+/**
+ * Finds the mapping containing the address with a binary search.
+ *
+ * @return   the mapping, or NULL if the address is not mapped.
+ */
+extern struct maps_data *maps_lookup(struct maps_index *index, addr_t addr);
+
 #endif /* !FTK_MAPS_H */
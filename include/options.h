@@ -30,7 +30,12 @@
 #include <sp_rtrace_filter.h>
 
 #define MAX_NPIDS 20
+#define MAX_JOBS 64
 #define OPT_USAGE -3
+#define OPT_ROTATE_SIZE 0x100
+#define OPT_ROTATE_TIME 0x101
+#define OPT_COLLECTOR 0x102
+#define OPT_UPROBES_SYSTEM_WIDE 0x103
 
 struct arguments {
 	char **remaining_args;
@@ -56,6 +61,30 @@ struct arguments {
 	bool skip_symbol_check;
 	/* set to true when functracer is stopping */
 	bool stopping;
+	/* number of tracer threads */
+	int jobs;
+	/* trace plugin resources at system call level */
+	bool syscalls;
+	/* trace functions with kernel uprobes */
+	bool uprobes;
+	/* open the uprobes for all the processes instead of the traced ones */
+	bool uprobes_system_wide;
+	/* agent library recording function calls in the traced program */
+	const char *agent;
+	/* directory of the library symbol index */
+	const char *symbol_cache;
+	/* write binary traces instead of rtrace text */
+	bool binary;
+	/* what to do when the output ring buffer is full (enum output_policy) */
+	int output_policy;
+	/* gzip compression level of the output, 0 if not compressed */
+	int compress;
+	/* size in bytes and age in seconds of the trace chunks, 0 if the
+	 * trace is not rotated */
+	unsigned long long rotate_size;
+	int rotate_time;
+	/* socket or named pipe of the collector the trace is sent to */
+	const char *collector;
 };
 
 extern struct arguments arguments;
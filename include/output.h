@@ -0,0 +1,129 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file output.h
+ *
+ * Trace output writer.
+ *
+ * The report output of a trace is handed from the tracer thread to a
+ * writer thread through a single-producer/single-consumer ring buffer,
+ * so that traced threads are not kept stopped while the output is
+ * written to a file or a pipe. The writes are handed over in complete
+ * records: whole text lines or whole binary trace buffers.
+ *
+ * When the ring is full, the tracer thread either waits for the writer
+ * thread (OUTPUT_BLOCK), drops the record and counts it (OUTPUT_DROP) or
+ * queues it in memory until the writer thread catches up (OUTPUT_SPILL).
+ * With OUTPUT_SYNC the output is written directly by the tracer thread.
+ *
+ * With -Z option the writer thread compresses the output in blocks of
+ * 1 MiB, each written as a separate gzip member. A block is also written
+ * out when there has been no output for a second.
+ *
+ * With --collector option the output of all traces is sent to the
+ * collector over a single non-blocking connection, in the frames
+ * described in collector.h. The writer thread writes all the frames
+ * queued in the ring with one write.
+ */
+#ifndef FTK_OUTPUT_H
+#define FTK_OUTPUT_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+enum output_policy {
+	OUTPUT_BLOCK,
+	OUTPUT_DROP,
+	OUTPUT_SPILL,
+	OUTPUT_SYNC,
+};
+
+/* size of the ring buffer between the tracer and writer threads */
+#define OUTPUT_RING_SIZE	(8 * 1024 * 1024)
+
+struct output;
+
+/**
+ * Starts writing the output to the file descriptor, with the policy
+ * selected on the command line.
+ *
+ * @param fd        the output file
+ * @param close_fd  if the file is closed by output_close()
+ */
+extern struct output *output_open(int fd, int close_fd);
+
+/**
+ * Connects to the collector and starts sending the output to it in
+ * frames.
+ *
+ * @param path    the collector socket or named pipe
+ * @param format  COLLECTOR_TEXT or COLLECTOR_BINARY
+ * @return        the output, or NULL if the collector can't be reached.
+ */
+extern struct output *output_connect(const char *path, int format);
+
+/**
+ * Sets the trace and the type of the frame the following records are
+ * sent in to the collector.
+ *
+ * @param trace  PID identifying the trace
+ * @param type   COLLECTOR_EVENT or COLLECTOR_BACKTRACE
+ */
+extern void output_set_frame(struct output *out, pid_t trace, int type);
+
+/**
+ * Waits until the output is written, stops the writer thread and frees
+ * the output.
+ */
+extern void output_close(struct output *out);
+
+/**
+ * Queues a record to be written. The records sent to the collector are
+ * framed one frame per call.
+ *
+ * @return   0 on success, -1 if the record was dropped or can't be
+ *           written.
+ */
+extern int output_write(struct output *out, const void *data, size_t len);
+
+/**
+ * Returns the number of bytes queued to the output, before compression.
+ */
+extern unsigned long long output_size(struct output *out);
+
+/**
+ * Returns a stdio stream writing to the output. The stream hands the
+ * text over in whole lines.
+ */
+extern FILE *output_fopen(struct output *out);
+
+/**
+ * Parses an output policy name.
+ *
+ * @return   the policy, or -1 if the name is unknown.
+ */
+extern int output_policy(const char *name);
+
+#endif /* !FTK_OUTPUT_H */
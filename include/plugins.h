@@ -37,6 +37,19 @@ struct plg_symbol {
 	int hit;
 };
 
+/**
+ * Structure defining system calls monitored by a plugin.
+ *
+ * When system calls are traced (--syscalls option), the system call is
+ * reported to the plugin function_exit() callback with the name of the
+ * plugin symbol handling it, and the breakpoint is not set for that
+ * symbol.
+ */
+struct plg_syscall {
+	int sysno;
+	char *name;
+};
+
 struct plg_api {
 	char *api_version;
 	void (*function_entry)(struct process *proc, const char *name);
@@ -51,6 +64,8 @@ struct plg_api {
 	void (*syscall_exit)(struct process *proc, int sysno);
 	int (*get_symbols)(struct plg_symbol **symbols);
 	void (*report_init)(struct process *proc);
+	/* API version 2.1 */
+	int (*get_syscalls)(struct plg_syscall **syscalls);
 };
 
 
@@ -59,6 +74,48 @@ void plg_finish(void);
 void plg_function_exit(struct process *proc, const char *name);
 int plg_match(const char *symname);
 
+/**
+ * Checks if the symbol matches a plugin symbol. Unlike plg_match(), the
+ * plugin symbol is not marked as found.
+ *
+ * @param[in] symname   the library symbol name.
+ * @return              1 if the symbol matches, 0 otherwise.
+ */
+int plg_lookup(const char *symname);
+
+/**
+ * Retrieves the plugin symbol names if all of them are matched only by
+ * library symbols of the same name, so that they can be looked up from
+ * the library symbol hash tables.
+ *
+ * @param[out] names   the plugin symbol names.
+ * @return             the number of names, -1 if a symbol name is a
+ *                     pattern or may match a demangled C++ name.
+ */
+int plg_exact_symbols(const char ***names);
+
+/**
+ * Returns a hash of the plugin symbol names, identifying the set of
+ * library symbols matched by the plugin.
+ */
+unsigned int plg_symbols_hash(void);
+
+/**
+ * Retrieves the system calls monitored by the plugin.
+ *
+ * @param[out] syscalls   the plugin system call table.
+ * @return                the number of system calls.
+ */
+int plg_get_syscalls(struct plg_syscall **syscalls);
+
+/**
+ * Reports the system call exit to the plugin.
+ *
+ * @param proc
+ * @param sysno   the system call number.
+ */
+void plg_syscall_exit(struct process *proc, int sysno);
+
 /**
  * Checks if all of the plugin symbols have been found in the
  * loaded libraries.
@@ -25,15 +25,21 @@
 #ifndef TT_PROCESS_H
 #define TT_PROCESS_H
 
+#include <pthread.h>
+#include <sys/procfs.h>
 #include <sys/types.h>
 
 #include "target_mem.h"
 
-struct dict;
+struct addrmap;
 struct bt_data;
+struct dict;
+struct maps_index;
 struct rp_data;
 struct solib_list;
 struct solib_data;
+struct sample;
+struct page_cache;
 
 struct callstack {
 	void *data[3];
@@ -49,11 +55,31 @@ struct process;
  * freed when no more processes refers to it.
  */
 struct process_shared {
-	struct dict *breakpoints;
+	struct addrmap *breakpoints;
 	struct solib_list *solib_list;
+	/* solib_list entries by path */
+	struct dict *solib_index;
+	unsigned int solib_generation;
+	/* run-time address of the program dynamic section */
+	addr_t dynamic_addr;
+	/* dynamic linker r_debug structure and the last link_map entry
+	 * seen in its library list */
+	addr_t r_debug;
+	addr_t r_map_tail;
+	/* library list change announced by the dynamic linker */
+	int r_state;
+	/* memory mappings, read on demand */
+	struct maps_index *maps;
 	struct ssol *ssol;
+	/* the functions hooked by the agent are recorded by it */
+	int agent;
+	/* writes to the memory, invalidating the pages cached by the
+	 * threads, see page_cache_get() */
+	unsigned int mem_writes;
 	int ref_count;
 	struct process* main;
+	/* protects the data above from threads traced by other workers */
+	pthread_mutex_t lock;
 };
 
 struct process {
@@ -73,7 +99,23 @@ struct process {
 	int singlestep;
 	int exiting;
 	int in_syscall;
+	/* system call stopped by the seccomp filter and its arguments */
+	int in_seccomp;
+	long syscall_args[6];
+	int initialized;
 	addr_t start_address;
+	/* sampled state, if the process is accessed through a sample */
+	struct sample *sample;
+	/* functions entered, as reported by uprobes */
+	struct callstack *uprobe_stack;
+	/* registers read at the current stop, see trace_regs_flush() */
+	elf_gregset_t regs;
+	int regs_cached;
+	int regs_dirty;
+	/* /proc/PID/mem descriptor, -1 if not opened yet */
+	int mem_fd;
+	/* memory read at the current stop, see trace_flush() */
+	struct page_cache *page_cache;
 
 	struct process *parent;
 	struct process *next;
@@ -82,7 +124,10 @@ struct process {
 typedef void (*for_each_process_t)(struct process *, int value);
 
 extern void for_each_process(for_each_process_t callback, int value);
+/* same for the processes traced by the calling worker */
+extern void for_each_own_process(for_each_process_t callback, int value);
 extern struct process *process_from_pid(pid_t pid);
+extern struct process *process_lookup(pid_t pid);
 extern char *name_from_pid(pid_t pid);
 extern char *cmd_from_pid(pid_t pid, int nargs);
 extern struct process *add_process(pid_t pid);
@@ -0,0 +1,71 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file procfs.h
+ *
+ * Access to the /proc files of the traced processes.
+ *
+ * The files are kept open per thread of functracer and read with
+ * pread() into buffers reused between the reads, so that looking up the
+ * status or the memory mappings of a process doesn't open, allocate and
+ * parse with stdio every time. A descriptor left open for a process that
+ * has exited or executed a new program returns no data, and is reopened.
+ */
+#ifndef FTK_PROCFS_H
+#define FTK_PROCFS_H
+
+#include <sys/types.h>
+
+enum procfs_file {
+	PROCFS_STATUS,
+	PROCFS_CMDLINE,
+	PROCFS_MAPS,
+	PROCFS_NFILES
+};
+
+/**
+ * Reads the whole file.
+ *
+ * @param[in] pid    the process (or thread) identifier.
+ * @param[out] len   the length of the data, may be NULL.
+ * @return           the NUL terminated contents, or NULL if the file
+ *                   can't be read. The buffer is owned by the calling
+ *                   thread and valid until the next read of the same
+ *                   file type by it.
+ */
+extern char *procfs_read(pid_t pid, enum procfs_file file, size_t *len);
+
+/**
+ * Returns the value of a numeric field of /proc/PID/status, like
+ * "Tgid:", or -1 if it is not found.
+ */
+extern long procfs_status(pid_t pid, const char *field);
+
+/**
+ * Closes the descriptors of the process opened by the calling thread.
+ */
+extern void procfs_close(pid_t pid);
+
+#endif /* !FTK_PROCFS_H */
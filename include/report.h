@@ -23,19 +23,45 @@
 
 #include <stdio.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include <sp_rtrace_defs.h>
 
 #include "process.h"
 #include "target_mem.h"
 
-#define RP_TIMESTAMP (arguments.time)
+#define RP_TIMESTAMP (rp_timestamp())
+
+struct output;
+struct rtbin_writer;
 
 struct rp_data {
 	pid_t pid;
 	int rp_number;
 	int step;
 	FILE *fp;
+	/* binary trace writer, used instead of fp with -B option */
+	struct rtbin_writer *bw;
+	/* output written by the writer thread */
+	struct output *out;
+	/* process name and PID written to the trace header */
+	char *process;
+	pid_t process_pid;
+	/* index and current chunk of a rotated trace */
+	FILE *index;
+	int chunk;
+	time_t chunk_time;
+	/* declarations repeated at the start of every chunk */
+	sp_rtrace_resource_t *resources;
+	int nresources;
+	sp_rtrace_context_t *contexts;
+	int ncontexts;
+	sp_rtrace_mmap_t *mmaps;
+	int nmmaps;
+	/* order of the records collected by the tracer workers, see
+	 * rp_stage_end() */
+	unsigned int stage_tickets;
+	unsigned int commit_tickets;
         int refcnt;
 };
 
@@ -48,4 +74,69 @@ extern int rp_init(struct process *proc);
 extern void rp_write_backtraces(struct process *proc, sp_rtrace_fcall_t *fcall);
 extern void rp_finish(struct process *proc);
 
+/**
+ * Sets the time of the events reported by the calling thread, for the
+ * events recorded earlier than they are reported (e.g. uprobe samples).
+ *
+ * @param ts   CLOCK_MONOTONIC time of the event, or NULL to stamp the
+ *             events when they are reported.
+ */
+extern void rp_set_event_time(const struct timespec *ts);
+
+/**
+ * Returns the timestamp of the reported call, 0 if timestamps are
+ * disabled.
+ */
+extern int rp_timestamp(void);
+
+/**
+ * Report output functions matching sp_rtrace_print_*(). The records are
+ * written as rtrace text, or as binary trace records with -B option.
+ */
+extern void rp_print_call(struct rp_data *rd, const sp_rtrace_fcall_t *call);
+extern void rp_print_args(struct rp_data *rd, const sp_rtrace_farg_t *args);
+extern void rp_print_trace(struct rp_data *rd, const sp_rtrace_ftrace_t *trace);
+extern void rp_print_resource(struct rp_data *rd, const sp_rtrace_resource_t *res);
+extern void rp_print_context(struct rp_data *rd, const sp_rtrace_context_t *context);
+extern void rp_print_mmap(struct rp_data *rd, const sp_rtrace_mmap_t *mmap);
+extern void rp_print_comment(struct rp_data *rd, const char *fmt, ...)
+	__attribute__ ((format(printf, 2, 3)));
+
+/**
+ * Hands the buffered report output over to the writer thread.
+ *
+ * Called on the process life cycle events, so that the report up to
+ * them is written out without waiting for the buffers to fill.
+ */
+extern void rp_flush(struct rp_data *rd);
+
+/**
+ * Starts collecting the records reported for the process in a buffer of
+ * the calling worker, instead of writing them to the trace. The records
+ * are collected only with several tracer workers.
+ *
+ * Called with the callback lock held.
+ */
+extern void rp_stage_begin(struct process *proc);
+
+/**
+ * Stops collecting the records.
+ *
+ * Called with the callback lock held.
+ *
+ * @return   non-zero if records were collected and must be written with
+ *           rp_stage_commit().
+ */
+extern int rp_stage_end(void);
+
+/**
+ * Unwinds the backtraces of the collected records, then writes them to
+ * the trace, after the records collected earlier by other workers for the
+ * same trace. The traces are written under a lock of their own, so the
+ * other workers can run their callbacks meanwhile.
+ *
+ * Called without the callback lock.
+ */
+extern void rp_stage_commit(void);
+
 #endif /* !FTK_REPORT_H */
@@ -0,0 +1,131 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file rtbin.h
+ *
+ * Binary trace format.
+ *
+ * The binary trace carries the same records as the rtrace text format,
+ * but without formatting them on the tracer thread. A trace starts with
+ * a file header, followed by records of a fixed 4 byte record header
+ * and the record payload:
+ *
+ *   u8  record type (RTBIN_*)
+ *   u8  record flags (the function type of RTBIN_CALL records)
+ *   u16 payload length
+ *
+ * Integers are little-endian, addresses and sizes are LEB128 varints.
+ * Function, module, resource and argument names are interned: the first
+ * use of a string is preceded by a RTBIN_STRING record assigning it an
+ * identifier, and later records refer to the identifier only. String
+ * identifier 0 is the NULL string.
+ *
+ * The records are written through a large buffer which is flushed when
+ * full and on the explicit flush points of the report, so a trace cut
+ * short ends on a complete record. If the output drops a buffer, the
+ * strings defined in it are interned again with the same identifiers,
+ * and the strings of the earlier buffers stay defined. functracer-bin2txt
+ * converts binary traces back to rtrace text.
+ */
+#ifndef FTK_RTBIN_H
+#define FTK_RTBIN_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <sp_rtrace_defs.h>
+
+#define RTBIN_MAGIC		"FTRB"
+#define RTBIN_VERSION		1
+#define RTBIN_FILE_HEADER_SIZE	8
+
+#define RTBIN_RECORD_HEADER_SIZE 4
+#define RTBIN_MAX_PAYLOAD	0xffff
+
+/* record types */
+enum {
+	RTBIN_STRING = 1,	/* u32 id, string bytes */
+	RTBIN_HEADER,		/* u32 string id for each header field */
+	RTBIN_CALL,		/* u32 index, context, timestamp, name, res_type,
+				 * varint res_size, res_id */
+	RTBIN_ARGS,		/* { u32 name, varint length, value bytes } */
+	RTBIN_TRACE,		/* { varint zigzag address delta [, u32 name] } */
+	RTBIN_RESOURCE,		/* u32 id, flags, type, desc */
+	RTBIN_CONTEXT,		/* u32 id, name */
+	RTBIN_MMAP,		/* u32 module, varint from, to */
+	RTBIN_COMMENT,		/* comment bytes */
+	RTBIN_RESET,		/* forget the strings, not written anymore */
+};
+
+/* RTBIN_TRACE flags */
+#define RTBIN_TRACE_RESOLVED	0x01
+
+/* size of the output buffer */
+#define RTBIN_BUFFER_SIZE	(1024 * 1024)
+
+struct output;
+struct rtbin_writer;
+
+/**
+ * Starts a binary trace written to the output.
+ *
+ * @return   the trace writer, or NULL if the file header can't be written.
+ */
+extern struct rtbin_writer *rtbin_open(struct output *out);
+
+/**
+ * Flushes the buffered records and frees the writer. The output is not
+ * closed.
+ *
+ * @return   0 on success, -1 if any of the writes failed.
+ */
+extern int rtbin_close(struct rtbin_writer *bw);
+
+/**
+ * Hands the buffered records over to the output.
+ *
+ * @return   0 on success, -1 if the records were dropped or can't be
+ *           written.
+ */
+extern int rtbin_flush(struct rtbin_writer *bw);
+
+/**
+ * Returns the number of bytes buffered by the writer.
+ */
+extern size_t rtbin_buffered(struct rtbin_writer *bw);
+
+/**
+ * Records matching the sp_rtrace_print_*() functions.
+ */
+extern void rtbin_write_header(struct rtbin_writer *bw, const sp_rtrace_header_t *header);
+extern void rtbin_write_call(struct rtbin_writer *bw, const sp_rtrace_fcall_t *call);
+extern void rtbin_write_args(struct rtbin_writer *bw, const sp_rtrace_farg_t *args);
+extern void rtbin_write_trace(struct rtbin_writer *bw, const sp_rtrace_ftrace_t *trace);
+extern void rtbin_write_resource(struct rtbin_writer *bw, const sp_rtrace_resource_t *res);
+extern void rtbin_write_context(struct rtbin_writer *bw, const sp_rtrace_context_t *context);
+extern void rtbin_write_mmap(struct rtbin_writer *bw, const sp_rtrace_mmap_t *mmap);
+extern void rtbin_write_comment(struct rtbin_writer *bw, const char *text, size_t len);
+
+#endif /* !FTK_RTBIN_H */
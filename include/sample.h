@@ -0,0 +1,97 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file sample.h
+ *
+ * Sampled process state.
+ *
+ * Function calls can be captured without stopping the process (e.g. with
+ * uprobes). In that case the registers and a copy of the user stack are
+ * recorded at the time of the call, and the process is accessed through
+ * the sample while reporting the call: trace_user_readw() and
+ * trace_mem_readw() return the sampled data, fn_argument() returns the
+ * arguments saved on the function entry and backtraces are unwound from
+ * the sampled stack. Memory outside the stack copy is read from the
+ * running process. If the sampled process recorded its own backtrace,
+ * the recorded return addresses are used instead of unwinding.
+ */
+#ifndef FTK_SAMPLE_H
+#define FTK_SAMPLE_H
+
+#include <sys/procfs.h>
+#include <sys/types.h>
+
+#include "target_mem.h"
+
+/* number of function arguments saved on the function entry */
+#define SAMPLE_NARGS	6
+
+struct sample {
+	pid_t pid;
+	/* user registers, in the same layout as PTRACE_GETREGS returns */
+	elf_gregset_t regs;
+	/* copy of the user stack starting from stack_addr */
+	addr_t stack_addr;
+	size_t stack_size;
+	const unsigned char *stack;
+	/* function arguments saved on the function entry */
+	long args[SAMPLE_NARGS];
+	/* backtrace recorded by the process, if any */
+	const unsigned long *frames;
+	int nframes;
+	/* /proc/PID/mem of the running process, opened on demand */
+	int mem_fd;
+};
+
+/**
+ * Initializes the sample.
+ *
+ * @param[in] sample       the sample to initialize.
+ * @param[in] pid          the sampled process/thread.
+ * @param[in] stack_addr   the address of the stack copy (stack pointer).
+ * @param[in] stack        the stack copy.
+ * @param[in] stack_size   the size of the stack copy.
+ */
+extern void sample_init(struct sample *sample, pid_t pid, addr_t stack_addr,
+			const unsigned char *stack, size_t stack_size);
+
+/**
+ * Releases the resources used for accessing the sampled process.
+ */
+extern void sample_finish(struct sample *sample);
+
+/**
+ * Reads the sampled memory.
+ *
+ * @return   0 on success, -1 if the memory could not be read.
+ */
+extern int sample_mem_read(struct sample *sample, addr_t addr, void *buf,
+			   size_t count);
+
+extern long sample_mem_readw(struct sample *sample, addr_t addr);
+extern long sample_user_readw(struct sample *sample, long offset);
+extern long sample_argument(struct sample *sample, int arg_num);
+
+#endif /* !FTK_SAMPLE_H */
@@ -0,0 +1,94 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file seccomp.h
+ *
+ * System call level tracing with seccomp filter.
+ *
+ * A seccomp filter is installed into the started program, so that it
+ * stops only on the system calls monitored by the plugin. Those system
+ * calls are reported to the plugin like calls of the plugin functions
+ * handling them, with fn_argument() and fn_return_value() returning the
+ * system call arguments and return value.
+ */
+#ifndef FTK_SECCOMP_H
+#define FTK_SECCOMP_H
+
+#include "process.h"
+
+#ifndef PTRACE_O_TRACESECCOMP
+#define PTRACE_O_TRACESECCOMP	0x00000080
+#endif
+#ifndef PTRACE_EVENT_SECCOMP
+#define PTRACE_EVENT_SECCOMP	7
+#endif
+
+/**
+ * Creates the seccomp filter for the system calls monitored by the
+ * plugin. System call tracing is disabled if the plugin or the kernel
+ * doesn't support it.
+ */
+extern void seccomp_init(void);
+
+/**
+ * Checks if the system calls are traced with seccomp filter.
+ */
+extern int seccomp_enabled(void);
+
+/**
+ * Installs the seccomp filter into the calling process.
+ *
+ * Called by the traced child before executing the program.
+ *
+ * @return   0 on success, -1 on failure.
+ */
+extern int seccomp_install(void);
+
+/**
+ * Saves the arguments of the system call stopped by the seccomp filter.
+ *
+ * The process must be continued with PTRACE_SYSCALL to catch the
+ * system call exit.
+ */
+extern void seccomp_syscall_enter(struct process *proc);
+
+/**
+ * Clears the system call data after the system call exit has been
+ * reported.
+ */
+extern void seccomp_syscall_exit(struct process *proc);
+
+/**
+ * Returns the argument of the traced system call.
+ */
+extern long seccomp_argument(struct process *proc, int arg_num);
+
+/**
+ * Returns the return value of the traced system call. Errors are
+ * returned as -1 like the C-library wrappers do.
+ */
+extern long seccomp_return_value(struct process *proc);
+
+#endif /* !FTK_SECCOMP_H */
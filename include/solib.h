@@ -83,13 +83,21 @@ struct solib_data {
 };
 
 
+struct solib_image;
+
 struct solib_list {
 	addr_t start_addr;
 	addr_t end_addr;
 	char *path;
+	/* update round when the library was last seen loaded */
+	unsigned int generation;
+	/* matching symbols, NULL if the library is not read */
+	struct solib_image *image;
 	struct solib_list *next;
 };
 
+/* Called for the library function symbols matching the plugin symbols or
+ * the context functions. */
 typedef void (*new_sym_t)(struct process *, const char *, const char *,
 			  addr_t);
 
@@ -97,6 +105,36 @@ extern void solib_update_list(struct process *proc, new_sym_t callback);
 extern addr_t solib_dl_debug_address(struct process *proc);
 extern void free_all_solibs(struct process *proc);
 
+/**
+ * Copies the library list of a process to its forked child.
+ */
+extern void solib_clone(struct process *child, struct process *parent);
+
+/**
+ * Finds a loaded library by its path.
+ *
+ * @return   the library, or NULL if not loaded.
+ */
+extern struct solib_list *solib_find(struct process *proc, const char *path);
+
+/**
+ * Reads the symbols of the libraries mapped by a running process before
+ * attaching to it, so that the process is stopped only for inserting the
+ * breakpoints. The symbols are used by the first solib_update_list() call
+ * for the process, for the libraries still mapped at the same address.
+ *
+ * @param[in] pid   the process identifier.
+ */
+extern void solib_prepare(pid_t pid);
+
+/**
+ * Drops the symbols read by solib_prepare() when they are not used, like
+ * when attaching to the process fails.
+ *
+ * @param[in] pid   the process identifier.
+ */
+extern void solib_prepare_cancel(pid_t pid);
+
 /**
  * Initializes solib symbol access handler.
  *
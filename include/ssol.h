@@ -30,10 +30,35 @@
 
 struct ssol {
 	addr_t first, last;
+	/* return breakpoint of ssol_call(), 0 if not set */
+	addr_t call_ret;
 };
 
 extern addr_t ssol_new_slot(struct process *proc);
 extern void ssol_init(struct process *proc);
+extern void ssol_clone(struct process *child, struct process *parent);
 extern void ssol_finish(struct process *proc);
 
+/**
+ * Calls a function in the stopped process. The function returns to a
+ * breakpoint in the SSOL area, and the registers are restored after the
+ * call.
+ *
+ * @param[in] fn       the function address.
+ * @param[in] argnum   the number of the arguments (up to four).
+ * @param[in] args     the arguments.
+ * @return             the function return value, or -1 if the process
+ *                     stopped elsewhere.
+ */
+extern long ssol_call(struct process *proc, addr_t fn, unsigned int argnum,
+		      long *args);
+
+/**
+ * Maps anonymous read-write memory into the stopped process.
+ *
+ * @return   the address of the memory, or 0 if it can't be mapped.
+ */
+extern addr_t ssol_map(struct process *proc, size_t length);
+extern void ssol_unmap(struct process *proc, addr_t addr, size_t length);
+
 #endif /* !FT_SSOL_H */
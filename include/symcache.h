@@ -0,0 +1,112 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file symcache.h
+ *
+ * On-disk index of library function symbols.
+ *
+ * Reading the symbol table of a library with libbfd and matching every
+ * function symbol against the plugin symbols takes most of the startup
+ * time of big programs, while the traced process is stopped. The index
+ * stores the function symbols of a library and the symbols matched by
+ * the plugin, so that later runs only need to map the index file.
+ *
+ * The index files are named by the ELF build-id of the library, or by
+ * its device and inode if it has no build-id, and are validated against
+ * the library size and modification time. The index of the debug symbols
+ * (-a) is validated against the path, size and modification time of the
+ * separate debug file too. The plugin matches are
+ * recomputed from the indexed symbols when a different set of plugin
+ * symbols is used.
+ */
+#ifndef FTK_SYMCACHE_H
+#define FTK_SYMCACHE_H
+
+#include "target_mem.h"
+
+struct symcache;
+
+/**
+ * Locates or creates the index directory.
+ */
+extern void symcache_init(void);
+extern void symcache_finish(void);
+
+/**
+ * Opens the symbol index of a library.
+ *
+ * A handle is returned even if the index is disabled, so that it can be
+ * used to collect the symbols read from the library.
+ *
+ * @param[in] filename     the library file name.
+ * @param[in] debug        set if the debug symbol table is read (-a).
+ * @param[in] match_hash   identifies the set of symbols matched by match().
+ * @param[in] match        returns nonzero for the symbols to be reported.
+ * @return                 the index handle.
+ */
+extern struct symcache *symcache_open(const char *filename, int debug,
+				      unsigned int match_hash,
+				      int (*match)(const char *name));
+
+/**
+ * Loads the index file of the library.
+ *
+ * @return   0 on success, -1 if the library is not indexed yet.
+ */
+extern int symcache_load(struct symcache *sc);
+
+/**
+ * Adds a function symbol read from the library.
+ *
+ * @param[in] value   the symbol address before relocation.
+ */
+extern void symcache_add(struct symcache *sc, const char *name, addr_t value);
+
+/**
+ * Matches the added symbols and writes the index file.
+ *
+ * @param[in] prelinked   set if the symbol addresses need no relocation.
+ */
+extern void symcache_save(struct symcache *sc, int prelinked);
+
+/**
+ * Checks if the symbol addresses of the library need no relocation.
+ */
+extern int symcache_prelinked(struct symcache *sc);
+
+/**
+ * Calls the function for every symbol matched by the match() function
+ * given to symcache_open().
+ */
+extern void symcache_for_each_match(struct symcache *sc,
+		void (*func)(const char *name, addr_t value, void *data),
+		void *data);
+
+/**
+ * Frees the index handle.
+ */
+extern void symcache_close(struct symcache *sc);
+
+#endif /* !FTK_SYMCACHE_H */
@@ -33,6 +33,11 @@ typedef uintptr_t addr_t;
 struct process;
 
 extern long trace_mem_readw(struct process *proc, addr_t addr);
+/**
+ * Reads a word like trace_mem_readw(), but returns -1 instead of printing
+ * a warning if the memory can't be read.
+ */
+extern int trace_mem_peek(struct process *proc, addr_t addr, long *w);
 extern void trace_mem_writew(struct process *proc, addr_t addr, long w);
 extern long trace_user_readw(struct process *proc, long offset);
 extern void trace_user_writew(struct process *proc, long offset, long w);
@@ -40,6 +45,25 @@ extern void trace_mem_read(struct process *proc, addr_t addr, void *buf, size_t
 extern void trace_mem_write(struct process *proc, addr_t addr, const void *buf, size_t count);
 extern void trace_getregs(struct process *proc, void *regs);
 extern void trace_setregs(struct process *proc, void *regs);
+/**
+ * Writes back the modified registers and drops the register cache.
+ *
+ * The registers are read with one PTRACE_GETREGS on the first access after
+ * the process stops, and the register accesses are served from the cache
+ * until the process is resumed.
+ */
+extern void trace_regs_flush(struct process *proc);
+/**
+ * Flushes the registers and drops the memory pages cached at the current
+ * stop. Must be called before resuming the process.
+ */
+extern void trace_flush(struct process *proc);
+/**
+ * Releases the descriptor and the page cache used for memory access.
+ *
+ * Must be called when the process exits or executes a new program.
+ */
+extern void trace_mem_close(struct process *proc);
 extern size_t trace_mem_readstr(struct process* proc, addr_t addr, char* buffer, size_t size);
 #include <wchar.h>
 extern size_t trace_mem_readwstr(struct process* proc, addr_t addr, wchar_t* buffer, size_t size);
@@ -0,0 +1,108 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file uprobe.h
+ *
+ * Kernel uprobes backend.
+ *
+ * With -U option the traced functions are probed with uprobes created
+ * through perf_event_open() instead of the int3 breakpoints. The traced
+ * processes are not stopped on the function calls: the kernel records the
+ * registers and the top of the user stack on the function entry and return
+ * into per-CPU ring buffers, and the calls are reported from these samples
+ * (see sample.h) while the tracer waits for the ptrace events. The calls
+ * are stamped with the sample time.
+ *
+ * Each function is probed separately in each traced process, the events
+ * being inherited by its threads and children. With --uprobes-system-wide
+ * option, when permitted, each function is probed once on every CPU for all
+ * the processes instead, and the samples of the untraced processes are
+ * dropped.
+ *
+ * The breakpoints are still used for the functions uprobes can't handle
+ * (Thumb code on ARM), for the context handling functions and when the
+ * kernel doesn't support uprobes.
+ */
+#ifndef FTK_UPROBE_H
+#define FTK_UPROBE_H
+
+#include <sys/types.h>
+
+#include "target_mem.h"
+
+struct process;
+
+/**
+ * Checks the kernel support for uprobes if the backend is enabled.
+ *
+ * Falls back to the breakpoints if uprobes are not supported.
+ */
+extern void uprobe_init(void);
+
+/**
+ * Removes the probes and releases the ring buffers.
+ */
+extern void uprobe_finish(void);
+
+/**
+ * Checks if the uprobes backend is in use.
+ */
+extern int uprobe_enabled(void);
+
+/**
+ * Creates the entry and return probes of the function.
+ *
+ * @param[in] proc      the process loading the library.
+ * @param[in] libname   the library (or executable) containing the function.
+ * @param[in] symname   the function name.
+ * @param[in] symaddr   the function address in the process.
+ * @return              0 if the function is probed, -1 if it must be
+ *                      traced with breakpoints.
+ */
+extern int uprobe_register(struct process *proc, const char *libname,
+			   const char *symname, addr_t symaddr);
+
+/**
+ * Records that the child process inherited the probes of its parent.
+ */
+extern void uprobe_fork(struct process *parent, pid_t child_pid);
+
+/**
+ * Releases the function calls still pending for the process.
+ */
+extern void uprobe_release(struct process *proc);
+
+/**
+ * Reports the function calls sampled by the probes so far.
+ */
+extern void uprobe_read_samples(void);
+
+/**
+ * Waits until the probes have sampled more function calls or the timeout
+ * (in milliseconds) expires.
+ */
+extern void uprobe_poll(int timeout);
+
+#endif /* !FTK_UPROBE_H */
@@ -0,0 +1,115 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file worker.h
+ *
+ * Tracer worker threads.
+ *
+ * ptrace() requests must come from the thread that attached the tracee,
+ * so with -j option every traced thread is owned by exactly one worker
+ * thread. Each worker runs its own event loop on its own slice of the
+ * process registry. Threads and children created later by a tracee are
+ * automatically traced by the worker owning their creator.
+ */
+#ifndef FTK_WORKER_H
+#define FTK_WORKER_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+struct process;
+
+struct worker {
+	int id;
+	pthread_t thread;
+	/* registry slice: processes/threads traced by this worker */
+	struct process *processes;
+	/* threads to be attached by this worker on startup */
+	pid_t *tids;
+	int ntids;
+	int retval;
+	/* tracing toggle requests applied to the processes of the worker */
+	int toggles;
+};
+
+/**
+ * Returns the worker of the calling thread.
+ */
+extern struct worker *worker_self(void);
+
+/**
+ * Calls the callback for every worker.
+ */
+extern void worker_for_each(void (*callback)(struct worker *, void *), void *data);
+
+/**
+ * Checks if the thread is attached by the calling worker on startup.
+ */
+extern int worker_owns(pid_t tid);
+
+/**
+ * Locks/unlocks the process registry shared by all workers.
+ */
+extern void worker_registry_lock(void);
+extern void worker_registry_unlock(void);
+
+/**
+ * Waits until the registry is changed by other worker, or until the
+ * timeout has passed.
+ *
+ * Must be called with registry lock held.
+ *
+ * @param timeout  the timeout in seconds
+ * @return         0, or ETIMEDOUT if the timeout passed.
+ */
+extern int worker_registry_wait(int timeout);
+
+/**
+ * Records that the thread could not be attached, and wakes up the workers
+ * waiting for it.
+ */
+extern void worker_attach_failed(pid_t tid);
+
+/**
+ * Checks if attaching the thread has failed.
+ *
+ * Must be called with registry lock held.
+ */
+extern int worker_failed(pid_t tid);
+
+/**
+ * Wakes up workers waiting for registry changes.
+ */
+extern void worker_registry_notify(void);
+
+/**
+ * Starts the traced program or attaches to the traced processes and
+ * runs the tracer event loops until there are no more tracees.
+ *
+ * @return   0 on success, -1 if any of the event loops failed.
+ */
+extern int worker_run(void);
+
+#endif /* !FTK_WORKER_H */
@@ -36,6 +36,7 @@ rm -rf %{buildroot}
 %files
 %defattr(-,root,root,-)
 %{_bindir}/functracer
+%{_bindir}/functracer-bin2txt
 %{_libdir}/%{name}/
 %{_mandir}/man1/functracer.1.gz
 %doc README COPYING src/modules/TODO.plugins src/modules/README.plugins
@@ -0,0 +1,168 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <libiberty.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "addrmap.h"
+#include "debug.h"
+
+#define ADDRMAP_MIN_SIZE	64
+
+struct addrmap_entry {
+	addr_t key;
+	void *value;	/* NULL for free entries */
+};
+
+struct addrmap {
+	struct addrmap_entry *entries;
+	size_t mask;	/* number of entries - 1, a power of two - 1 */
+	size_t count;
+};
+
+/* Mixes all bits of the address, as breakpoint addresses share most of
+ * their high bits and are often aligned (murmur3 finalizer). */
+static inline size_t addr_hash(addr_t key)
+{
+	uint32_t h = (uint32_t)key ^ (uint32_t)((uint64_t)key >> 32);
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static struct addrmap_entry *addrmap_slot(struct addrmap *m, addr_t key)
+{
+	size_t i = addr_hash(key) & m->mask;
+
+	while (m->entries[i].value != NULL && m->entries[i].key != key)
+		i = (i + 1) & m->mask;
+
+	return &m->entries[i];
+}
+
+static void addrmap_resize(struct addrmap *m, size_t size)
+{
+	struct addrmap_entry *old = m->entries;
+	size_t i, old_size = m->mask + 1;
+
+	debug(3, "resizing address map %p to %zu entries", (void *)m, size);
+	m->entries = xcalloc(size, sizeof(struct addrmap_entry));
+	m->mask = size - 1;
+	for (i = 0; i < old_size; i++) {
+		if (old[i].value != NULL)
+			*addrmap_slot(m, old[i].key) = old[i];
+	}
+	free(old);
+}
+
+struct addrmap *addrmap_init(void)
+{
+	struct addrmap *m = xmalloc(sizeof(struct addrmap));
+
+	m->entries = xcalloc(ADDRMAP_MIN_SIZE, sizeof(struct addrmap_entry));
+	m->mask = ADDRMAP_MIN_SIZE - 1;
+	m->count = 0;
+
+	return m;
+}
+
+void addrmap_clear(struct addrmap *m)
+{
+	free(m->entries);
+	free(m);
+}
+
+void *addrmap_enter(struct addrmap *m, addr_t key, void *value)
+{
+	struct addrmap_entry *e;
+	void *old;
+
+	/* keep the load factor below 0.7 */
+	if ((m->count + 1) * 10 > (m->mask + 1) * 7)
+		addrmap_resize(m, (m->mask + 1) * 2);
+
+	e = addrmap_slot(m, key);
+	old = e->value;
+	if (old == NULL)
+		m->count++;
+	e->key = key;
+	e->value = value;
+
+	return old;
+}
+
+void *addrmap_remove(struct addrmap *m, addr_t key)
+{
+	struct addrmap_entry *e = addrmap_slot(m, key);
+	size_t i, j, k;
+	void *old = e->value;
+
+	if (old == NULL)
+		return NULL;
+	m->count--;
+
+	/* Move the following entries of the probe sequence back, so that
+	 * no free entry is left between an entry and its home position. */
+	i = e - m->entries;
+	for (j = (i + 1) & m->mask; m->entries[j].value != NULL;
+	     j = (j + 1) & m->mask) {
+		k = addr_hash(m->entries[j].key) & m->mask;
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		m->entries[i] = m->entries[j];
+		i = j;
+	}
+	m->entries[i].value = NULL;
+
+	return old;
+}
+
+void *addrmap_find(struct addrmap *m, addr_t key)
+{
+	return addrmap_slot(m, key)->value;
+}
+
+size_t addrmap_size(struct addrmap *m)
+{
+	return m->count;
+}
+
+void addrmap_apply_to_all(struct addrmap *m,
+		void (*func)(addr_t key, void *value, void *data), void *data)
+{
+	size_t i;
+
+	if (m == NULL)
+		return;
+	for (i = 0; i <= m->mask; i++) {
+		if (m->entries[i].value != NULL)
+			func(m->entries[i].key, m->entries[i].value, data);
+	}
+}
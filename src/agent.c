@@ -0,0 +1,396 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libiberty.h>
+#include <limits.h>
+#include <linux/ptrace.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/procfs.h>
+#include <unistd.h>
+
+#include "agent.h"
+#include "arch-defs.h"
+#include "callback.h"
+#include "debug.h"
+#include "elfsym.h"
+#include "maps.h"
+#include "options.h"
+#include "process.h"
+#include "report.h"
+#include "sample.h"
+#include "ssol.h"
+
+/* user area offset of the function return value */
+#if defined(ARCH_ARM)
+#define RETVAL_OFFSET	0
+#else
+#define RETVAL_OFFSET	EAX
+#endif
+
+/* number of polls an incomplete record is waited for before it's given
+ * up (the writer was killed in the middle of the record) */
+#define STALL_LIMIT	100
+
+/* traced symbols of the functions hooked by the agent, writable as they
+ * are passed in the callstack */
+static char agent_symbols[AGENT_NFUNCTIONS][24] = {
+	[AGENT_MALLOC]		= "__libc_malloc",
+	[AGENT_FREE]		= "__libc_free",
+	[AGENT_CALLOC]		= "__libc_calloc",
+	[AGENT_REALLOC]		= "__libc_realloc",
+	[AGENT_POSIX_MEMALIGN]	= "posix_memalign",
+	[AGENT_MEMALIGN]	= "__libc_memalign",
+	[AGENT_VALLOC]		= "valloc",
+};
+
+static struct agent_ring *ring;
+static char ring_path[PATH_MAX];
+static char library_path[PATH_MAX];
+static unsigned long lost_reported;
+static int stalled;
+/* incomplete records given up by the reader */
+static unsigned long skipped;
+
+void agent_init(void)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	if (arguments.agent == NULL)
+		return;
+	/* like the plugins, the agent is looked up from the plugin
+	 * directory unless a path is given */
+	if (strchr(arguments.agent, '/'))
+		snprintf(library_path, sizeof(library_path), "%s",
+			 arguments.agent);
+	else
+		snprintf(library_path, sizeof(library_path), "%s/%s.so",
+			 PLG_PATH, arguments.agent);
+	if (access(library_path, R_OK) < 0) {
+		msg_warn("could not find the agent library %s, using "
+			 "breakpoints instead", library_path);
+		return;
+	}
+	/* the loaded agent is looked up from the process mappings */
+	if (realpath(library_path, path) != NULL)
+		snprintf(library_path, sizeof(library_path), "%s", path);
+
+	snprintf(ring_path, sizeof(ring_path), "/dev/shm/functracer-agent.%d",
+		 getpid());
+	fd = open(ring_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		msg_warn("could not create %s: %s, using breakpoints instead",
+			 ring_path, strerror(errno));
+		return;
+	}
+	if (ftruncate(fd, AGENT_RING_LENGTH(AGENT_RING_SIZE)) < 0) {
+		msg_err("ftruncate");
+		goto err;
+	}
+	ring = mmap(NULL, AGENT_RING_LENGTH(AGENT_RING_SIZE),
+		    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ring == MAP_FAILED) {
+		ring = NULL;
+		msg_err("mmap");
+		goto err;
+	}
+	close(fd);
+
+	ring->version = AGENT_VERSION;
+	ring->size = AGENT_RING_SIZE;
+	ring->depth = arguments.depth < AGENT_MAX_FRAMES ?
+		arguments.depth : AGENT_MAX_FRAMES;
+	ring->magic = AGENT_MAGIC;
+	debug(1, "agent %s, ring buffer %s", library_path, ring_path);
+	return;
+
+err:
+	close(fd);
+	unlink(ring_path);
+}
+
+void agent_finish(void)
+{
+	if (ring == NULL)
+		return;
+	/* the agent stays in the processes detached from */
+	ring->functions = 0;
+	munmap(ring, AGENT_RING_LENGTH(AGENT_RING_SIZE));
+	unlink(ring_path);
+	ring = NULL;
+}
+
+int agent_enabled(void)
+{
+	return ring != NULL;
+}
+
+int agent_setup_child(void)
+{
+	const char *preload = getenv("LD_PRELOAD");
+	char *buf;
+	int ret;
+
+	if (setenv(AGENT_RING_ENV, ring_path, 1) < 0)
+		return -1;
+	if (preload == NULL || *preload == '\0')
+		return setenv("LD_PRELOAD", library_path, 1);
+	buf = xmalloc(strlen(library_path) + strlen(preload) + 2);
+	sprintf(buf, "%s:%s", library_path, preload);
+	ret = setenv("LD_PRELOAD", buf, 1);
+	free(buf);
+
+	return ret;
+}
+
+/* Returns the address of the function in the file mapped by the process,
+ * or 0 if not found. */
+static addr_t remote_function(struct process *proc, const char *path,
+			      const char *name)
+{
+	struct maps_index *index;
+	struct elf_file *ef;
+	addr_t addr = 0, lo, hi;
+	int i;
+
+	index = maps_get(proc);
+	if (index == NULL)
+		return 0;
+	for (i = 0; i < index->nmaps; i++) {
+		if (index->maps[i].off != 0 ||
+		    strcmp(index->maps[i].path, path) != 0)
+			continue;
+		ef = elf_open(path);
+		if (ef == NULL)
+			return 0;
+		addr = elf_lookup_function(ef, name);
+		if (addr && elf_is_pic(ef) && elf_load_range(ef, &lo, &hi) == 0)
+			addr += index->maps[i].lo - lo;
+		elf_close(ef);
+		break;
+	}
+	return addr;
+}
+
+/* Returns the path of the C library mapped by the process, or NULL. */
+static char *libc_path(struct process *proc)
+{
+	struct maps_index *index;
+	const char *name;
+	int i;
+
+	index = maps_get(proc);
+	if (index == NULL)
+		return NULL;
+	for (i = 0; i < index->nmaps; i++) {
+		name = strrchr(index->maps[i].path, '/');
+		if (name && (strncmp(name, "/libc.so", 8) == 0 ||
+			     strncmp(name, "/libc-", 6) == 0))
+			return xstrdup(index->maps[i].path);
+	}
+	return NULL;
+}
+
+/* Loads the agent into the stopped process with dlopen() called in it,
+ * and hands the ring buffer to it. */
+static int agent_inject(struct process *proc)
+{
+	addr_t dlopen_addr, attach_addr, buf;
+	long args[2], handle, ret = -1;
+	char *libc;
+
+	/* not yet mapped after exec */
+	libc = libc_path(proc);
+	if (libc == NULL) {
+		debug(1, "pid=%d: no C library to load the agent with",
+		      proc->pid);
+		return -1;
+	}
+	/* dlopen() is in the C library since glibc 2.34 */
+	dlopen_addr = remote_function(proc, libc, "dlopen");
+	if (dlopen_addr == 0)
+		dlopen_addr = remote_function(proc, libc, "__libc_dlopen_mode");
+	free(libc);
+	if (dlopen_addr == 0) {
+		msg_warn("could not find dlopen() in PID %d to load the agent",
+			 proc->pid);
+		return -1;
+	}
+
+	buf = ssol_map(proc, 2 * PATH_MAX);
+	if (buf == 0)
+		return -1;
+	trace_mem_write(proc, buf, library_path, strlen(library_path) + 1);
+	trace_mem_write(proc, buf + PATH_MAX, ring_path, strlen(ring_path) + 1);
+	args[0] = buf;
+	args[1] = RTLD_NOW;
+	handle = ssol_call(proc, dlopen_addr, 2, args);
+	if (handle != 0 && handle != -1) {
+		maps_invalidate(proc);
+		attach_addr = remote_function(proc, library_path,
+					      AGENT_ATTACH_FUNCTION);
+		args[0] = buf + PATH_MAX;
+		if (attach_addr)
+			ret = ssol_call(proc, attach_addr, 1, args);
+	}
+	ssol_unmap(proc, buf, 2 * PATH_MAX);
+	if (ret != 0) {
+		msg_warn("could not load the agent into PID %d", proc->pid);
+		return -1;
+	}
+	debug(1, "pid=%d: agent %s loaded", proc->pid, library_path);
+
+	return 0;
+}
+
+void agent_attach(struct process *proc)
+{
+	if (!agent_enabled())
+		proc->shared->agent = 0;
+	/* the started programs preload the agent */
+	else if (arguments.npids == 0)
+		proc->shared->agent = 1;
+	else
+		proc->shared->agent = agent_inject(proc) == 0;
+}
+
+int agent_register(struct process *proc, const char *symname)
+{
+	int i;
+
+	if (!agent_enabled() || !proc->shared->agent)
+		return -1;
+	for (i = 0; i < AGENT_NFUNCTIONS; i++) {
+		if (strcmp(agent_symbols[i], symname) == 0) {
+			__sync_fetch_and_or(&ring->functions, 1UL << i);
+			debug(2, "function \"%s\" recorded by the agent",
+			      symname);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void report_record(struct agent_record *rec)
+{
+	struct callback *cb = cb_get();
+	struct process *proc;
+	struct callstack cs, *saved;
+	struct sample sample;
+	elf_greg_t *regs;
+	char *name;
+	int i;
+
+	if (rec->function >= AGENT_NFUNCTIONS)
+		return;
+	name = agent_symbols[rec->function];
+	proc = process_from_pid(rec->tid);
+	if (proc == NULL) {
+		debug(2, "record from unknown thread %lu", rec->tid);
+		return;
+	}
+
+	/* The value stored through the pointer argument is served from the
+	 * record, as the memory may have been changed since. */
+	if (rec->function == AGENT_POSIX_MEMALIGN)
+		sample_init(&sample, rec->tid, rec->args[0],
+			    (const unsigned char *)&rec->result,
+			    sizeof(rec->result));
+	else
+		sample_init(&sample, rec->tid, 0, NULL, 0);
+	for (i = 0; i < AGENT_MAX_ARGS; i++)
+		sample.args[i] = rec->args[i];
+	regs = (elf_greg_t *)&sample.regs;
+	regs[RETVAL_OFFSET] = rec->retval;
+	sample.frames = rec->frames;
+	sample.nframes = rec->nframes < AGENT_MAX_FRAMES ?
+		rec->nframes : AGENT_MAX_FRAMES;
+
+	/* The agent records only the outermost calls, so the call is
+	 * reported like the only one in the callstack. */
+	memset(&cs, 0, sizeof(cs));
+	cs.data[2] = name;
+	saved = proc->callstack;
+	proc->callstack = &cs;
+	proc->sample = &sample;
+	/* the call is stamped with the time the agent recorded it */
+	rp_set_event_time(&rec->time);
+	if (cb && cb->function.exit)
+		cb->function.exit(proc, name);
+	rp_set_event_time(NULL);
+	proc->sample = NULL;
+	proc->callstack = saved;
+	sample_finish(&sample);
+}
+
+void agent_read_records(void)
+{
+	struct agent_record *rec;
+	unsigned long tail, seq, lost;
+
+	if (ring == NULL)
+		return;
+	tail = ring->tail;
+	while (tail != ring->head) {
+		rec = &ring->records[tail % ring->size];
+		seq = rec->seq;
+		if (seq != tail + 1) {
+			if (++stalled < STALL_LIMIT)
+				break;
+			/* The writer can't complete the record once the
+			 * skipped flag is set, so the slot can be reused. */
+			do {
+				seq = rec->seq;
+				if (seq == tail + 1)
+					break;
+			} while (!__sync_bool_compare_and_swap(&rec->seq, seq,
+					(tail + 1) | AGENT_SEQ_SKIPPED));
+		}
+		if (seq == tail + 1) {
+			__sync_synchronize();
+			report_record(rec);
+		} else {
+			debug(1, "skipping incomplete agent record %lu", tail);
+			skipped++;
+		}
+		stalled = 0;
+		tail++;
+		__sync_synchronize();
+		ring->tail = tail;
+	}
+
+	lost = ring->lost + skipped;
+	if (lost != lost_reported) {
+		msg_warn("%lu function calls were lost, the agent ring buffer "
+			 "is full or the records were not completed",
+			 lost - lost_reported);
+		lost_reported = lost;
+	}
+}
@@ -27,34 +27,235 @@
 #include <string.h> /* XXX DEBUG */
 #include <sys/types.h>
 #include <libunwind-ptrace.h>
+#include <linux/ptrace.h>
 #include <limits.h>
 
+#include "arch-defs.h"
 #include "backtrace.h"
 #include "debug.h"
+#include "function.h"
 #include "options.h"
+#include "process.h"
+#include "sample.h"
+#include "ssol.h"
+#include "target_mem.h"
 
 struct bt_data {
 	unw_addr_space_t as;
 	struct UPT_info *ui;
+	struct process *proc;
+	/* SSOL return address replacement state of the current backtrace */
+	struct callstack *next_call;
+	addr_t last_slot;
+	unw_word_t last_addr;
 };
 
-struct bt_data *bt_init(pid_t pid)
+/* backtrace being unwound by the calling thread */
+static __thread struct bt_data *current_btd;
+
+/* user area offsets of the libunwind registers */
+#if defined(ARCH_ARM)
+static const int unw_reg_offset[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+#else
+static const int unw_reg_offset[] = {
+	EAX, EDX, ECX, EBX, ESI, EDI, EBP, UESP, EIP, EFL,
+};
+#endif
+
+/*
+ * Accessors used for unwinding the stack. Normally the stopped process
+ * is accessed with the libunwind ptrace accessors, but the registers and
+ * stack of a sampled process are read from the sample.
+ */
+static int bt_find_proc_info(unw_addr_space_t as, unw_word_t ip,
+			     unw_proc_info_t *pi, int need_unwind_info,
+			     void *arg __unused)
+{
+	return _UPT_find_proc_info(as, ip, pi, need_unwind_info, current_btd->ui);
+}
+
+static void bt_put_unwind_info(unw_addr_space_t as, unw_proc_info_t *pi,
+			       void *arg __unused)
+{
+	_UPT_put_unwind_info(as, pi, current_btd->ui);
+}
+
+static int bt_get_dyn_info_list_addr(unw_addr_space_t as, unw_word_t *dilap,
+				     void *arg __unused)
+{
+	return _UPT_get_dyn_info_list_addr(as, dilap, current_btd->ui);
+}
+
+/*
+ * The return addresses of the traced calls are replaced with the SSOL
+ * return breakpoint address in the tracee stack. Instead of restoring the
+ * original addresses in the tracee memory for unwinding, the unwinder gets
+ * them from the callstack: from the call whose return address slot was
+ * read, or if the slot is not known (e.g. on ARM the lr register may be
+ * saved anywhere in the frame), from the next outer call in order.
+ */
+static unw_word_t bt_return_address(struct bt_data *btd, addr_t slot,
+				    unw_word_t val)
+{
+	struct process *proc = btd->proc;
+	struct callstack *cs;
+
+	if (proc->shared == NULL || proc->shared->ssol == NULL ||
+	    val != proc->shared->ssol->first)
+		return val;
+	if (slot == btd->last_slot)
+		return btd->last_addr;
+	for (cs = proc->callstack; cs; cs = cs->next) {
+		if (fn_return_address_slot(cs) == slot)
+			break;
+	}
+	if (cs == NULL) {
+		cs = btd->next_call;
+		if (cs == NULL) {
+			debug(1, "no call found for the SSOL return address at %#x",
+			      slot);
+			return val;
+		}
+	}
+	btd->next_call = cs->next;
+	btd->last_slot = slot;
+	btd->last_addr = (unw_word_t)cs->data[1];
+
+	return btd->last_addr;
+}
+
+static int bt_access_mem(unw_addr_space_t as __unused, unw_word_t addr, unw_word_t *val,
+			 int write, void *arg __unused)
+{
+	struct process *proc = current_btd->proc;
+	long w;
+
+	if (write) {
+		if (proc->sample)
+			return -UNW_EREADONLYREG;
+		trace_mem_writew(proc, addr, *val);
+		return 0;
+	}
+	/* read through the page cache, or from the sample */
+	if (trace_mem_peek(proc, addr, &w) < 0)
+		return -UNW_EINVAL;
+	*val = proc->sample ? (unw_word_t)w :
+		bt_return_address(current_btd, addr, w);
+	return 0;
+}
+
+static int bt_access_reg(unw_addr_space_t as, unw_regnum_t reg, unw_word_t *val,
+			 int write, void *arg __unused)
+{
+	struct process *proc = current_btd->proc;
+
+	/* The registers are read through the register cache, or from the
+	 * sample. Other registers and writes go directly to the process. */
+	if (write || reg < 0 ||
+	    reg >= (int)(sizeof(unw_reg_offset) / sizeof(unw_reg_offset[0]))) {
+		if (proc->sample)
+			return write ? -UNW_EREADONLYREG : -UNW_EBADREG;
+		trace_regs_flush(proc);
+		return _UPT_access_reg(as, reg, val, write, current_btd->ui);
+	}
+	*val = trace_user_readw(proc, unw_reg_offset[reg] * sizeof(long));
+	/* the SSOL return address in lr belongs to the innermost call */
+	if (!proc->sample && proc->callstack && proc->shared &&
+	    proc->shared->ssol && *val == proc->shared->ssol->first)
+		*val = (unw_word_t)proc->callstack->data[1];
+	return 0;
+}
+
+static int bt_access_fpreg(unw_addr_space_t as, unw_regnum_t reg,
+			   unw_fpreg_t *val, int write, void *arg __unused)
+{
+	if (current_btd->proc->sample)
+		return -UNW_EBADREG;
+	return _UPT_access_fpreg(as, reg, val, write, current_btd->ui);
+}
+
+static int bt_resume(unw_addr_space_t as, unw_cursor_t *c, void *arg __unused)
+{
+	return _UPT_resume(as, c, current_btd->ui);
+}
+
+static int bt_get_proc_name(unw_addr_space_t as, unw_word_t addr, char *buf,
+			    size_t buf_len, unw_word_t *offp, void *arg __unused)
+{
+	return _UPT_get_proc_name(as, addr, buf, buf_len, offp, current_btd->ui);
+}
+
+static unw_accessors_t bt_accessors = {
+	.find_proc_info = bt_find_proc_info,
+	.put_unwind_info = bt_put_unwind_info,
+	.get_dyn_info_list_addr = bt_get_dyn_info_list_addr,
+	.access_mem = bt_access_mem,
+	.access_reg = bt_access_reg,
+	.access_fpreg = bt_access_fpreg,
+	.resume = bt_resume,
+	.get_proc_name = bt_get_proc_name,
+};
+
+struct bt_data *bt_init(struct process *proc)
 {
 	struct bt_data *btd;
 
-	debug(3, "bt_init(pid=%d)", pid);
+	debug(3, "bt_init(pid=%d)", proc->pid);
 	btd = malloc(sizeof(struct bt_data));
 	if (!btd)
 		error_exit("bt_init(): malloc");
-	btd->as = unw_create_addr_space(&_UPT_accessors, 0);
+	btd->proc = proc;
+	btd->as = unw_create_addr_space(&bt_accessors, 0);
 	unw_set_caching_policy (btd->as, UNW_CACHE_GLOBAL);
 	if (!btd->as)
 		error_exit("bt_init(): unw_create_addr_space() failed");
-	btd->ui = _UPT_create(pid);
+	btd->ui = _UPT_create(proc->pid);
 
 	return btd;
 }
 
+/* Formats the frame name returned by unw_get_proc_name(). The buffer
+ * starts with "in " prefix followed by the function name. */
+static char *bt_frame_name(char *buf, size_t size, int ret, unw_word_t off)
+{
+	char* ptr = buf;
+
+	if (ret < 0) {
+		ptr = buf + 3;
+		strcpy(ptr, "<undefined>");
+	}
+	else if (off) {
+		size_t len = strlen(buf);
+		/* Reserve the last 64 bytes for the offset */
+		if (len >= size - 64)
+			len = size - 64;
+		sprintf(buf + len, "+0x%lx", (unsigned long)off);
+	}
+	return strdup(ptr);
+}
+
+/* Returns the backtrace recorded by the sampled process itself. */
+static int bt_recorded_backtrace(struct bt_data *btd, struct sample *sample,
+				 void **frames, char **buffer, int size)
+{
+	unw_word_t off;
+	int n, ret;
+	char buf[512] = "in ";
+
+	for (n = 0; n < sample->nframes && n < size; n++) {
+		frames[n] = (void *)sample->frames[n];
+		if (arguments.resolve_name) {
+			ret = bt_get_proc_name(btd->as, sample->frames[n],
+					       buf + 3, sizeof(buf) - 3, &off,
+					       NULL);
+			buffer[n] = bt_frame_name(buf, sizeof(buf), ret, off);
+		}
+	}
+	return n;
+}
+
 int bt_backtrace(struct bt_data *btd, void** frames, char **buffer, int size)
 {
 	unw_cursor_t c;
@@ -65,6 +266,13 @@ int bt_backtrace(struct bt_data *btd, void** frames, char **buffer, int size)
 	if (size == 0)
 		return 0;
 
+	current_btd = btd;
+	/* the innermost call has returned, its slot is not in the stack */
+	btd->next_call = btd->proc->callstack ? btd->proc->callstack->next : NULL;
+	btd->last_slot = 0;
+	if (btd->proc->sample && btd->proc->sample->frames)
+		return bt_recorded_backtrace(btd, btd->proc->sample, frames,
+					     buffer, size);
 	if ((ret = unw_init_remote(&c, btd->as, btd->ui)) < 0) {
 		debug(1, "bt_backtrace(): unw_init_remote() failed, ret=%d", ret);
 		return -1;
@@ -82,20 +290,8 @@ int bt_backtrace(struct bt_data *btd, void** frames, char **buffer, int size)
 //		sprintf(buf,  "0x%08x", (uintptr_t)(ip - 1));
 
 		if (arguments.resolve_name) {
-			char* ptr = buf;
 			ret = unw_get_proc_name(&c, buf + 3, sizeof(buf) - 3, &off);
-			if (ret < 0) {
-				ptr = buf + 3;
-				strcpy(ptr, "<undefined>");
-			}
-			else if (off) {
-				size_t len = strlen(buf);
-				/* Reserve the last 64 bytes for the offset */
-				if (len >= sizeof(buf) - 64)
-					len = sizeof(buf) - 64;
-				sprintf(buf + len, "+0x%lx", (unsigned long)off);
-			}
-			buffer[n] = strdup(ptr);
+			buffer[n] = bt_frame_name(buf, sizeof(buf), ret, off);
 		}
 		n++;
 		if ((ret = unw_step(&c)) < 0) {
@@ -0,0 +1,382 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Converts binary traces written with functracer -B option to rtrace
+ * text, so that they can be processed with the sp-rtrace tools:
+ *
+ *	$ functracer-bin2txt 1234-0.rtrace.bin > 1234-0.rtrace.txt
+ *
+ * Traces compressed with -Z option are decompressed. A trace cut short
+ * is converted up to its last complete record.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libiberty.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sp_rtrace_formatter.h>
+
+#include "rtbin.h"
+
+struct input {
+	gzFile gz;
+	unsigned char *buf;
+	size_t len;
+	size_t pos;
+	int eof;
+};
+
+/* interned strings, indexed by the string identifier - 1 */
+static char **strings;
+static uint32_t nstrings;
+
+/* decoded backtrace */
+static pointer_t *frames;
+static char **names;
+static size_t maxframes;
+
+static const char *input_name = "standard input";
+
+static void fail(const char *msg)
+{
+	fprintf(stderr, "functracer-bin2txt: %s: %s\n", input_name, msg);
+	exit(EXIT_FAILURE);
+}
+
+/* Makes at least len bytes available from the current position.
+ *
+ * @return   0 on success, -1 at the end of the input.
+ */
+static int fill(struct input *in, size_t len)
+{
+	int ret, err;
+
+	if (in->pos + len <= in->len)
+		return 0;
+	memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+	in->len -= in->pos;
+	in->pos = 0;
+	while (in->len < len && !in->eof) {
+		ret = gzread(in->gz, in->buf + in->len, RTBIN_BUFFER_SIZE - in->len);
+		if (ret <= 0) {
+			/* a compressed trace cut short ends with an
+			 * incomplete gzip member */
+			if (ret < 0)
+				fprintf(stderr, "functracer-bin2txt: %s: %s\n",
+					input_name, gzerror(in->gz, &err));
+			in->eof = 1;
+			break;
+		}
+		in->len += ret;
+	}
+	return in->len < len ? -1 : 0;
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_varint(const unsigned char **p, const unsigned char *end)
+{
+	unsigned int shift = 0;
+	uint64_t value = 0;
+
+	while (*p < end && shift < 64) {
+		value |= (uint64_t)(**p & 0x7f) << shift;
+		if (!(*(*p)++ & 0x80))
+			return value;
+		shift += 7;
+	}
+	fail("corrupted varint");
+	return 0;
+}
+
+static char *get_string(const unsigned char **p, const unsigned char *end)
+{
+	uint32_t id;
+
+	if (*p + 4 > end)
+		fail("truncated record");
+	id = get_u32(*p);
+	*p += 4;
+	if (id == 0)
+		return NULL;
+	if (id > nstrings)
+		fail("undefined string");
+	return strings[id - 1];
+}
+
+static void add_string(const unsigned char *p, const unsigned char *end)
+{
+	if (p + 4 > end || get_u32(p) != nstrings + 1)
+		fail("unexpected string identifier");
+	strings = xrealloc(strings, (nstrings + 1) * sizeof(char *));
+	strings[nstrings++] = xstrndup((const char *)p + 4, end - p - 4);
+}
+
+static void clear_strings(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < nstrings; i++)
+		free(strings[i]);
+	nstrings = 0;
+}
+
+static void print_header(FILE *fp, const unsigned char *p, const unsigned char *end)
+{
+	sp_rtrace_header_t header;
+	unsigned int i;
+
+	memset(&header, 0, sizeof(header));
+	for (i = 0; i < sizeof(header.fields) / sizeof(header.fields[0]) && p < end; i++)
+		header.fields[i] = get_string(&p, end);
+	sp_rtrace_print_header(fp, &header);
+}
+
+static void print_call(FILE *fp, int type, const unsigned char *p, const unsigned char *end)
+{
+	sp_rtrace_fcall_t call;
+
+	if (p + 12 > end)
+		fail("truncated record");
+	memset(&call, 0, sizeof(call));
+	call.type = type;
+	call.index = get_u32(p);
+	call.context = get_u32(p + 4);
+	call.timestamp = get_u32(p + 8);
+	p += 12;
+	call.name = get_string(&p, end);
+	call.res_type = get_string(&p, end);
+	call.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME;
+	call.res_size = get_varint(&p, end);
+	call.res_id = get_varint(&p, end);
+	sp_rtrace_print_call(fp, &call);
+}
+
+static void print_args(FILE *fp, const unsigned char *p, const unsigned char *end)
+{
+	sp_rtrace_farg_t *args = NULL;
+	/* the argument values copied from the record */
+	char **values = NULL;
+	size_t nargs = 0, i;
+	uint64_t len;
+
+	while (p < end) {
+		args = xrealloc(args, (nargs + 2) * sizeof(sp_rtrace_farg_t));
+		values = xrealloc(values, (nargs + 1) * sizeof(char *));
+		args[nargs].name = get_string(&p, end);
+		len = get_varint(&p, end);
+		if (len > (size_t)(end - p))
+			fail("truncated record");
+		values[nargs] = xstrndup((const char *)p, len);
+		args[nargs].value = values[nargs];
+		nargs++;
+		p += len;
+	}
+	if (args == NULL)
+		return;
+	args[nargs].name = NULL;
+	args[nargs].value = NULL;
+	sp_rtrace_print_args(fp, args);
+	for (i = 0; i < nargs; i++)
+		free(values[i]);
+	free(values);
+	free(args);
+}
+
+static void print_trace(FILE *fp, int flags, const unsigned char *p, const unsigned char *end)
+{
+	sp_rtrace_ftrace_t trace;
+	uint64_t addr = 0, delta;
+	size_t n = 0;
+
+	while (p < end) {
+		if (n == maxframes) {
+			maxframes = maxframes ? maxframes * 2 : 64;
+			frames = xrealloc(frames, maxframes * sizeof(pointer_t));
+			names = xrealloc(names, maxframes * sizeof(char *));
+		}
+		delta = get_varint(&p, end);
+		addr += (delta >> 1) ^ -(delta & 1);
+		frames[n] = addr;
+		names[n] = (flags & RTBIN_TRACE_RESOLVED) ? get_string(&p, end) : NULL;
+		n++;
+	}
+	trace.nframes = n;
+	trace.frames = frames;
+	trace.resolved_names = (flags & RTBIN_TRACE_RESOLVED) ? names : NULL;
+	sp_rtrace_print_trace(fp, &trace);
+}
+
+static void print_resource(FILE *fp, const unsigned char *p, const unsigned char *end)
+{
+	sp_rtrace_resource_t res;
+
+	if (p + 8 > end)
+		fail("truncated record");
+	memset(&res, 0, sizeof(res));
+	res.id = get_u32(p);
+	res.flags = get_u32(p + 4);
+	p += 8;
+	res.type = get_string(&p, end);
+	res.desc = get_string(&p, end);
+	sp_rtrace_print_resource(fp, &res);
+}
+
+static void print_context(FILE *fp, const unsigned char *p, const unsigned char *end)
+{
+	sp_rtrace_context_t context;
+
+	if (p + 4 > end)
+		fail("truncated record");
+	memset(&context, 0, sizeof(context));
+	context.id = get_u32(p);
+	p += 4;
+	context.name = get_string(&p, end);
+	sp_rtrace_print_context(fp, &context);
+}
+
+static void print_mmap(FILE *fp, const unsigned char *p, const unsigned char *end)
+{
+	sp_rtrace_mmap_t mmap;
+
+	memset(&mmap, 0, sizeof(mmap));
+	mmap.module = get_string(&p, end);
+	mmap.from = get_varint(&p, end);
+	mmap.to = get_varint(&p, end);
+	sp_rtrace_print_mmap(fp, &mmap);
+}
+
+static void convert(struct input *in, FILE *fp)
+{
+	const unsigned char *p, *end;
+	size_t size;
+	int type, flags;
+
+	if (fill(in, RTBIN_FILE_HEADER_SIZE) < 0 ||
+	    memcmp(in->buf, RTBIN_MAGIC, 4) != 0)
+		fail("not a functracer binary trace");
+	if ((in->buf[4] | (in->buf[5] << 8)) != RTBIN_VERSION)
+		fail("unsupported binary trace version");
+	in->pos = RTBIN_FILE_HEADER_SIZE;
+
+	while (fill(in, RTBIN_RECORD_HEADER_SIZE) == 0) {
+		p = in->buf + in->pos;
+		type = p[0];
+		flags = p[1];
+		size = p[2] | (p[3] << 8);
+		if (fill(in, RTBIN_RECORD_HEADER_SIZE + size) < 0)
+			break;
+		p = in->buf + in->pos + RTBIN_RECORD_HEADER_SIZE;
+		end = p + size;
+		in->pos += RTBIN_RECORD_HEADER_SIZE + size;
+
+		switch (type) {
+		case RTBIN_STRING:
+			add_string(p, end);
+			break;
+		case RTBIN_HEADER:
+			print_header(fp, p, end);
+			break;
+		case RTBIN_CALL:
+			print_call(fp, flags, p, end);
+			break;
+		case RTBIN_ARGS:
+			print_args(fp, p, end);
+			break;
+		case RTBIN_TRACE:
+			print_trace(fp, flags, p, end);
+			break;
+		case RTBIN_RESOURCE:
+			print_resource(fp, p, end);
+			break;
+		case RTBIN_CONTEXT:
+			print_context(fp, p, end);
+			break;
+		case RTBIN_MMAP:
+			print_mmap(fp, p, end);
+			break;
+		case RTBIN_COMMENT:
+			sp_rtrace_print_comment(fp, "%.*s", (int)size, (const char *)p);
+			break;
+		case RTBIN_RESET:
+			clear_strings();
+			break;
+		default:
+			fail("unknown record type");
+		}
+	}
+	if (in->pos < in->len)
+		fprintf(stderr, "functracer-bin2txt: %s: trace ends with an incomplete record\n",
+			input_name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct input in;
+	FILE *fp = stdout;
+	int fd = STDIN_FILENO;
+
+	if (argc > 3 || (argc > 1 && argv[1][0] == '-' && argv[1][1])) {
+		fprintf(stderr, "Usage: functracer-bin2txt [INPUT [OUTPUT]]\n");
+		return EXIT_FAILURE;
+	}
+
+	memset(&in, 0, sizeof(in));
+	if (argc > 1 && strcmp(argv[1], "-")) {
+		input_name = argv[1];
+		fd = open(input_name, O_RDONLY);
+		if (fd < 0)
+			fail(strerror(errno));
+	}
+	/* reads uncompressed input as is */
+	in.gz = gzdopen(fd, "rb");
+	if (in.gz == NULL)
+		fail("out of memory");
+	if (argc > 2) {
+		fp = fopen(argv[2], "w");
+		if (fp == NULL) {
+			perror(argv[2]);
+			return EXIT_FAILURE;
+		}
+	}
+	in.buf = xmalloc(RTBIN_BUFFER_SIZE);
+
+	convert(&in, fp);
+	gzclose(in.gz);
+
+	if (fclose(fp) != 0) {
+		perror("functracer-bin2txt");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
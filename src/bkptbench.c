@@ -0,0 +1,121 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Breakpoint table microbenchmark.
+ *
+ * Compares the lookup cost of the old chained dictionary and the address
+ * map used for the breakpoint table. It is not built by default:
+ *
+ *	$ make -C src bkptbench && src/bkptbench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "addrmap.h"
+#include "dict.h"
+#include "options.h"
+
+/* debug_() checks the debug level */
+struct arguments arguments;
+
+#define LOOKUPS		2000000
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Function entries scattered over the text segments of some libraries,
+ * mixed with consecutive SSOL slots like in the real breakpoint table. */
+static void make_addresses(addr_t *addr, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (i % 2)
+			addr[i] = 0x40000000 + (i / 2) * 16;
+		else
+			addr[i] = 0x41000000 + (i / 64) * 0x100000 +
+				(random() % 0x40000) * 4;
+	}
+}
+
+static void bench(int n)
+{
+	addr_t *addr = malloc(n * sizeof(addr_t));
+	int *order = malloc(LOOKUPS * sizeof(int));
+	struct dict *d = dict_init(dict_key2hash_int, dict_key_cmp_int);
+	struct addrmap *m = addrmap_init();
+	double t, t_dict, t_map;
+	unsigned long found = 0;
+	int i;
+
+	if (addr == NULL || order == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	make_addresses(addr, n);
+	for (i = 0; i < n; i++) {
+		if (addrmap_enter(m, addr[i], &addr[i]) == NULL)
+			dict_enter(d, (void *)addr[i], &addr[i]);
+	}
+	for (i = 0; i < LOOKUPS; i++)
+		order[i] = random() % n;
+
+	t = now();
+	for (i = 0; i < LOOKUPS; i++)
+		found += dict_find_entry(d, (void *)addr[order[i]]) != NULL;
+	t_dict = now() - t;
+
+	t = now();
+	for (i = 0; i < LOOKUPS; i++)
+		found += addrmap_find(m, addr[order[i]]) != NULL;
+	t_map = now() - t;
+
+	if (found != 2 * LOOKUPS)
+		fprintf(stderr, "lookup failed\n");
+	printf("%7d breakpoints: dict %6.1f ns, addrmap %6.1f ns per lookup\n",
+	       n, t_dict * 1e9 / LOOKUPS, t_map * 1e9 / LOOKUPS);
+
+	dict_clear(d);
+	addrmap_clear(m);
+	free(order);
+	free(addr);
+}
+
+int main(void)
+{
+	srandom(1);
+	bench(100);
+	bench(10000);
+	bench(100000);
+
+	return 0;
+}
@@ -50,6 +50,9 @@
 /*#define MOV_reg(insn)		((insn & 0x0fe00ff0) == 0x01a00000)*/
 #define ARM_NOP			0xe1a00000	/* nop (mov r0,r0) */
 #define THUMB_NOP16		0x46c0		/* nop (mov r8,r8) */
+#define ARM_LDR_PC		0xe51ff004	/* ldr pc, [pc, #-4] */
+#define THUMB_LDR_PC_0		0xf8df		/* ldr.w pc, [pc, #0] */
+#define THUMB_LDR_PC_1		0xf000
 
 #define BRANCH(insn)		((insn & 0xff000000) == 0xea000000)
 #define sign_extend(x, signbit) ((x) | (0 - ((x) & (1 << (signbit)))))
@@ -83,6 +86,11 @@ void set_instruction_pointer(struct process *proc, addr_t addr)
 	trace_user_writew(proc, off_pc, (long)addr);
 }
 
+addr_t get_instruction_pointer(struct process *proc)
+{
+	return trace_user_readw(proc, off_pc);
+}
+
 struct bkpt_insn *breakpoint_instruction(addr_t addr)
 {
 	/* ARM mode breakpoint */
@@ -382,3 +390,35 @@ int ssol_prepare_bkpt(struct breakpoint *bkpt, void *safe_insn)
 	}
 	return -1;
 }
+
+/* The branch back to the original code loads the PC from a literal, as the
+ * SSOL area may be out of the range of the B instruction. The literal is
+ * word aligned at offset 8 of the (16 byte aligned) SSOL slot. */
+int ssol_boost_bkpt(struct breakpoint *bkpt, void *safe_insn)
+{
+	unsigned short *insn_s = (unsigned short *)safe_insn;
+	long *insn = (long *)safe_insn;
+	int bits_15_11, size;
+
+	if (bkpt->insn->size == 2) { /* thumb */
+		bits_15_11 = (insn_s[0] >> 11) & ((1 << 5) - 1);
+		if (bits_15_11 >= 0x1D && bits_15_11 <= 0x1F) {
+			size = 4;
+		} else {
+			/* pad to keep the literal aligned */
+			size = 2;
+			insn_s[1] = THUMB_NOP16;
+		}
+		insn_s[2] = THUMB_LDR_PC_0;
+		insn_s[3] = THUMB_LDR_PC_1;
+		/* stay in Thumb mode */
+		insn[2] = (bkpt->addr + size) | 1;
+	} else {
+		size = 4;
+		insn[1] = ARM_LDR_PC;
+		insn[2] = bkpt->addr + size;
+	}
+	bkpt->ssol_boost = size;
+
+	return 0;
+}
@@ -49,6 +49,11 @@ void set_instruction_pointer(struct process *proc, addr_t addr)
 	trace_user_writew(proc, 4 * EIP, (long)addr);
 }
 
+addr_t get_instruction_pointer(struct process *proc)
+{
+	return trace_user_readw(proc, 4 * EIP);
+}
+
 struct bkpt_insn *breakpoint_instruction(addr_t addr __unused)
 {
 	static struct bkpt_insn insn = {
@@ -70,3 +75,103 @@ int ssol_prepare_bkpt(struct breakpoint *bkpt, void *safe_insn)
 	memcpy(safe_insn, bkpt->orig_insn.data, MAX_INSN_SIZE);
 	return 0;
 }
+
+/* Returns the length of the ModR/M byte and the following SIB byte and
+ * displacement. */
+static int modrm_length(const unsigned char *modrm)
+{
+	int mod = *modrm >> 6, rm = *modrm & 7;
+	int len = 1;
+
+	if (mod == 3)
+		return len;
+	if (rm == 4) {
+		/* SIB byte, base register 5 means disp32 without base */
+		len++;
+		if (mod == 0 && (modrm[1] & 7) == 5)
+			len += 4;
+	} else if (mod == 0 && rm == 5) {
+		/* absolute disp32 */
+		len += 4;
+	}
+	if (mod == 1)
+		len += 1;
+	else if (mod == 2)
+		len += 4;
+
+	return len;
+}
+
+/* Returns the length of an instruction which does not depend on its
+ * address, or -1 if the instruction is unknown or uses EIP. Only the
+ * instructions commonly found at function entry are recognized. */
+static int insn_length(const unsigned char *insn)
+{
+	unsigned char op = insn[0];
+	int len;
+
+	if (op >= 0x50 && op <= 0x5f)	/* push/pop r32 */
+		return 1;
+	if (op >= 0xb8 && op <= 0xbf)	/* mov imm32, r32 */
+		return 5;
+
+	switch (op) {
+	case 0x90:		/* nop */
+		return 1;
+	case 0x6a:		/* push imm8 */
+		return 2;
+	case 0x68:		/* push imm32 */
+	case 0xa1:		/* mov moffs32, %eax */
+	case 0xa3:		/* mov %eax, moffs32 */
+		return 5;
+	case 0x01: case 0x03:	/* add */
+	case 0x09: case 0x0b:	/* or */
+	case 0x21: case 0x23:	/* and */
+	case 0x29: case 0x2b:	/* sub */
+	case 0x31: case 0x33:	/* xor */
+	case 0x39: case 0x3b:	/* cmp */
+	case 0x85:		/* test */
+	case 0x89: case 0x8b:	/* mov */
+		return 1 + modrm_length(insn + 1);
+	case 0x8d:		/* lea */
+		if ((insn[1] >> 6) == 3)
+			return -1;
+		return 1 + modrm_length(insn + 1);
+	case 0x83:		/* group 1, imm8 */
+		return 1 + modrm_length(insn + 1) + 1;
+	case 0x81:		/* group 1, imm32 */
+		return 1 + modrm_length(insn + 1) + 4;
+	case 0xc7:		/* mov imm32, r/m32 */
+		if ((insn[1] >> 3 & 7) != 0)
+			return -1;
+		return 1 + modrm_length(insn + 1) + 4;
+	case 0x65:		/* %gs segment prefix (stack protector) */
+		if (insn[1] == 0x65)
+			return -1;
+		len = insn_length(insn + 1);
+		return len < 0 ? -1 : len + 1;
+	case 0xf3:		/* endbr32 */
+		if (insn[1] == 0x0f && insn[2] == 0x1e && insn[3] == 0xfb)
+			return 4;
+		return -1;
+	default:
+		return -1;
+	}
+}
+
+int ssol_boost_bkpt(struct breakpoint *bkpt, void *safe_insn)
+{
+	unsigned char *insn = safe_insn;
+	int len = insn_length(bkpt->orig_insn.data);
+	long disp;
+
+	if (len < 0)
+		return -1;
+	/* jmp rel32 back to the instruction following the original one */
+	disp = (long)(bkpt->addr + len) - (long)(bkpt->ssol_addr + len + 5);
+	insn[len] = 0xe9;
+	memcpy(&insn[len + 1], &disp, 4);
+	bkpt->ssol_boost = len;
+
+	return 0;
+}
@@ -23,22 +23,26 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <libiberty.h>
 
+#include "addrmap.h"
+#include "agent.h"
 #include "breakpoint.h"
 #include "callback.h"
 #include "debug.h"
-#include "dict.h"
 #include "function.h"
+#include "maps.h"
 #include "options.h"
 #include "plugins.h"
 #include "process.h"
 #include "solib.h"
 #include "ssol.h"
 #include "target_mem.h"
+#include "uprobe.h"
 #include "context.h"
 
 static void enable_breakpoint(struct process *proc, struct breakpoint *bkpt)
@@ -54,6 +58,12 @@ static void enable_breakpoint(struct process *proc, struct breakpoint *bkpt)
 		bkpt->enabled = 0;
 		return;
 	}
+	/* Instructions which need no fixups after execution get a jump back
+	 * to the original code, so that they run without a singlestep. */
+	bkpt->ssol_boost = 0;
+	if (bkpt->type == BKPT_ENTRY && bkpt->ssol_pre_handler == NULL &&
+	    bkpt->ssol_post_handler == NULL)
+		ssol_boost_bkpt(bkpt, &safe_insn);
 	trace_mem_write(proc, bkpt->ssol_addr, safe_insn, MAX_INSN_SIZE);
 	trace_mem_write(proc, bkpt->addr, bkpt->insn->value, bkpt->insn->size);
 	bkpt->enabled = 1;
@@ -68,18 +78,11 @@ static void disable_breakpoint(struct process *proc, struct breakpoint *bkpt)
 
 static struct breakpoint *breakpoint_from_address(struct process *proc, addr_t addr)
 {
-	struct breakpoint *bkpt = dict_find_entry(proc->shared->breakpoints,
-		(void *)fixup_address(addr));
+	struct breakpoint *bkpt = addrmap_find(proc->shared->breakpoints,
+		fixup_address(addr));
 	return bkpt != NULL && !bkpt->enabled ? NULL : bkpt;
 }
 
-static void register_breakpoint_(struct process *proc, addr_t addr,
-				 struct breakpoint *bkpt)
-{
-	dict_enter(proc->shared->breakpoints, (void *)addr, bkpt);
-	bkpt->refcnt++;
-}
-
 static void breakpoint_put(struct breakpoint *bkpt)
 {
 	if (--bkpt->refcnt == 0) {
@@ -88,6 +91,43 @@ static void breakpoint_put(struct breakpoint *bkpt)
 	}
 }
 
+/* Same as breakpoint_from_address(), but safe to be used while threads
+ * traced by other workers update the breakpoint table. The breakpoint is
+ * referenced until release_breakpoint(), so that it is not freed when
+ * replaced in the table in the meantime. */
+static struct breakpoint *lookup_breakpoint(struct process *proc, addr_t addr)
+{
+	struct breakpoint *bkpt;
+
+	pthread_mutex_lock(&proc->shared->lock);
+	bkpt = breakpoint_from_address(proc, addr);
+	if (bkpt)
+		bkpt->refcnt++;
+	pthread_mutex_unlock(&proc->shared->lock);
+	return bkpt;
+}
+
+static void release_breakpoint(struct process *proc, struct breakpoint *bkpt)
+{
+	if (bkpt == NULL)
+		return;
+	pthread_mutex_lock(&proc->shared->lock);
+	breakpoint_put(bkpt);
+	pthread_mutex_unlock(&proc->shared->lock);
+}
+
+static void register_breakpoint_(struct process *proc, addr_t addr,
+				 struct breakpoint *bkpt)
+{
+	struct breakpoint *old;
+
+	/* a disabled breakpoint at the same address is replaced */
+	old = addrmap_enter(proc->shared->breakpoints, addr, bkpt);
+	bkpt->refcnt++;
+	if (old)
+		breakpoint_put(old);
+}
+
 static struct breakpoint *register_breakpoint(struct process *proc, addr_t addr,
 					      int type, const char* symname)
 {
@@ -140,19 +180,26 @@ static void register_entry_breakpoint(struct process *proc, const char *libname,
 				      const char *symname, addr_t symaddr)
 {
 	struct breakpoint *bkpt, *bkpt2;
+	int context = context_match(symname);
 
-	if (context_match(symname) || plg_match(symname)) {
-		bkpt = register_breakpoint(proc, symaddr, BKPT_ENTRY, symname);
-		bkpt2 = register_breakpoint(proc, ssol_new_slot(proc), BKPT_SENTINEL, NULL);
-		if (arguments.verbose)
-			fprintf(stderr, "Registered breakpoint for function "
-				"\"%s\" (%#x) from %s (PID %d)\n",
-				bkpt->symbol, bkpt->addr, libname, proc->pid);
-		debug(2, "entry breakpoint registered for \"%s\" at %#x, "
-		      "SSOL %#x, sentinel %#x, PID %d", bkpt->symbol,
-		      bkpt->addr, bkpt->ssol_addr, bkpt2->addr, proc->pid);
-	}
+	if (!context && !plg_match(symname))
+		return;
+	/* Context functions must stop the process, as the context of the
+	 * following calls depends on them. */
+	if (!context && agent_register(proc, symname) == 0)
+		return;
+	if (!context && uprobe_register(proc, libname, symname, symaddr) == 0)
+		return;
 
+	bkpt = register_breakpoint(proc, symaddr, BKPT_ENTRY, symname);
+	bkpt2 = register_breakpoint(proc, ssol_new_slot(proc), BKPT_SENTINEL, NULL);
+	if (arguments.verbose)
+		fprintf(stderr, "Registered breakpoint for function "
+			"\"%s\" (%#x) from %s (PID %d)\n",
+			bkpt->symbol, bkpt->addr, libname, proc->pid);
+	debug(2, "entry breakpoint registered for \"%s\" at %#x, "
+	      "SSOL %#x, sentinel %#x, PID %d", bkpt->symbol,
+	      bkpt->addr, bkpt->ssol_addr, bkpt2->addr, proc->pid);
 }
 
 static void register_dl_debug_breakpoint(struct process *proc)
@@ -192,18 +239,19 @@ void singlestep_handle(struct process *proc, addr_t addr)
 
 	debug(1, "pid=%d, addr=0x%x", proc->pid, addr);
 	assert(size > 0 && size <= MAX_INSN_SIZE);
-	bkpt = breakpoint_from_address(proc, addr - size);
+	bkpt = lookup_breakpoint(proc, addr - size);
 	assert(bkpt != NULL);
 	set_instruction_pointer(proc, bkpt->addr + size);
 	/* Call SSOL post handler (if any). */
 	if (bkpt->ssol_post_handler)
 		bkpt->ssol_post_handler(proc, bkpt);
+	release_breakpoint(proc, bkpt);
 }
 
 void singlestep_after_signal(struct process *proc)
 {
 	addr_t addr = bkpt_get_address(proc);
-	struct breakpoint *bkpt = breakpoint_from_address(proc, addr);
+	struct breakpoint *bkpt = lookup_breakpoint(proc, addr);
 
 	debug(2, "signal received while singlestepping (pid=%d, ssol=%#x)",
 	      proc->pid, addr);
@@ -220,11 +268,39 @@ void singlestep_after_signal(struct process *proc)
 	}
 	set_instruction_pointer(proc, addr);
 	proc->singlestep = 0;
+	release_breakpoint(proc, bkpt);
+}
+
+/* Moves a thread stopped inside a boosted SSOL slot back to the
+ * original code, as the SSOL area is unmapped on detach. */
+void bkpt_leave_ssol(struct process *proc)
+{
+	struct ssol *ssol;
+	struct breakpoint *bkpt;
+	addr_t addr, slot;
+
+	if (proc->shared == NULL || proc->shared->ssol == NULL ||
+	    proc->singlestep)
+		return;
+	ssol = proc->shared->ssol;
+	addr = get_instruction_pointer(proc);
+	if (addr <= ssol->first || addr > ssol->last + MAX_INSN_SIZE)
+		return;
+	slot = (addr / MAX_INSN_SIZE) * MAX_INSN_SIZE;
+	bkpt = lookup_breakpoint(proc, slot);
+	if (bkpt != NULL && bkpt->ssol_boost && bkpt->ssol_addr == slot) {
+		debug(2, "leaving SSOL slot (pid=%d, ssol=%#x)", proc->pid, addr);
+		if (addr == slot)
+			set_instruction_pointer(proc, bkpt->addr);
+		else
+			set_instruction_pointer(proc, bkpt->addr + bkpt->ssol_boost);
+	}
+	release_breakpoint(proc, bkpt);
 }
 
 void bkpt_handle(struct process *proc, addr_t addr)
 {
-	struct breakpoint *bkpt = breakpoint_from_address(proc, addr);
+	struct breakpoint *bkpt = lookup_breakpoint(proc, addr);
 	struct callback *cb = cb_get();
 	char *symbol_name;
 
@@ -251,25 +327,29 @@ void bkpt_handle(struct process *proc, addr_t addr)
 		/* Call SSOL pre handler (if any). */
 		if (bkpt->ssol_pre_handler)
 			bkpt->ssol_pre_handler(proc, bkpt);
-		proc->singlestep = 1;
+		if (!bkpt->ssol_boost)
+			proc->singlestep = 1;
 		break;
 	case BKPT_RETURN:
 		symbol_name = fn_name(proc);
 		debug(2, "return breakpoint for %s() (exiting=%d)", symbol_name, proc->exiting);
 		/* Fixup return address before calling function.exit()
 		 * callback so that backtraces do not contain the SSOL
-		 * address. */
+		 * address. The SSOL return addresses of the outer calls
+		 * are replaced by the unwinder (see backtrace.c). */
 		fn_get_return_address(proc, &addr);
 		set_instruction_pointer(proc, addr);
-		fn_callstack_restore(proc, 1);
 		if (cb && cb->function.exit)
 			cb->function.exit(proc, symbol_name);
-		fn_callstack_restore(proc, 0);
 		fn_callstack_pop(proc);
 		break;
 	case BKPT_SOLIB:
 		debug(1, "solib breakpoint");
+		pthread_mutex_lock(&proc->shared->lock);
+		/* the mappings change on every library load and unload */
+		maps_invalidate(proc);
 		solib_update_list(proc, register_entry_breakpoint);
+		pthread_mutex_unlock(&proc->shared->lock);
 		fn_do_return(proc);
 		break;
 	case BKPT_SENTINEL:
@@ -283,23 +363,27 @@ void bkpt_handle(struct process *proc, addr_t addr)
 	case BKPT_START:
 		/* program entry point reached, check loaded symbols */
 		plg_check_symbols(false);
-		disable_breakpoint((struct process *)proc, breakpoint_from_address(proc, proc->start_address));
+		disable_breakpoint(proc, bkpt);
 		set_instruction_pointer(proc, bkpt->addr);
 		break;
 
 	default:
 		error_exit("unknown breakpoint type");
 	}
+	release_breakpoint(proc, bkpt);
 }
 
 void bkpt_init(struct process *proc)
 {
 	if (proc->parent == NULL) {
 		proc->shared = xcalloc(1, sizeof(struct process_shared));
+		pthread_mutex_init(&proc->shared->lock, NULL);
 		proc->shared->ref_count++;
-		proc->shared->breakpoints = dict_init(dict_key2hash_int, dict_key_cmp_int);
+		proc->shared->breakpoints = addrmap_init();
 		proc->shared->main = proc;
 		ssol_init(proc);
+		/* before the breakpoints, which the loading would hit */
+		agent_attach(proc);
 		register_ssol_return_breakpoint(proc);
 		register_dl_debug_breakpoint(proc);
 		if (proc->start_address) {
@@ -311,11 +395,80 @@ void bkpt_init(struct process *proc)
 
 	} else {
 		proc->shared = proc->parent->shared;
+		pthread_mutex_lock(&proc->shared->lock);
 		proc->shared->ref_count++;
+		pthread_mutex_unlock(&proc->shared->lock);
 	}
 }
 
-static void disable_bkpt_cb(void *addr __unused, void *bkpt, void *proc)
+struct clone_data {
+	struct process *child;
+	/* parent's breakpoints and symbol names -> child's copies */
+	struct addrmap *clones;
+	struct addrmap *names;
+};
+
+static void clone_bkpt_cb(addr_t addr, void *data, void *cd_)
+{
+	struct breakpoint *bkpt = data, *copy;
+	struct clone_data *cd = cd_;
+
+	/* the breakpoints are in the table at both the original and the
+	 * SSOL addresses */
+	copy = addrmap_find(cd->clones, (addr_t)bkpt);
+	if (copy == NULL) {
+		copy = xmalloc(sizeof(struct breakpoint));
+		*copy = *bkpt;
+		copy->refcnt = 0;
+		if (bkpt->symbol) {
+			copy->symbol = xstrdup(bkpt->symbol);
+			addrmap_enter(cd->names, (addr_t)bkpt->symbol,
+				      copy->symbol);
+		}
+		addrmap_enter(cd->clones, (addr_t)bkpt, copy);
+	}
+	register_breakpoint_(cd->child, addr, copy);
+}
+
+static char *clone_name(char *name, void *cd_)
+{
+	struct clone_data *cd = cd_;
+	char *copy = addrmap_find(cd->names, (addr_t)name);
+
+	return copy ? copy : name;
+}
+
+void bkpt_fork(struct process *child, struct process *parent)
+{
+	struct process_shared *from = parent->shared;
+	struct clone_data cd;
+
+	child->shared = xcalloc(1, sizeof(struct process_shared));
+	pthread_mutex_init(&child->shared->lock, NULL);
+	child->shared->ref_count++;
+	child->shared->breakpoints = addrmap_init();
+	child->shared->main = child;
+	/* the agent is in the copy of the address space */
+	child->shared->agent = from->agent;
+	child->start_address = parent->start_address;
+
+	cd.child = child;
+	cd.clones = addrmap_init();
+	cd.names = addrmap_init();
+	pthread_mutex_lock(&from->lock);
+	addrmap_apply_to_all(from->breakpoints, clone_bkpt_cb, &cd);
+	ssol_clone(child, parent);
+	solib_clone(child, parent);
+	pthread_mutex_unlock(&from->lock);
+	/* the child returns from the functions the parent was in */
+	fn_callstack_clone(child, parent, clone_name, &cd);
+	addrmap_clear(cd.clones);
+	addrmap_clear(cd.names);
+	debug(1, "pid=%d: %d breakpoints copied from pid=%d", child->pid,
+	      (int)addrmap_size(child->shared->breakpoints), parent->pid);
+}
+
+static void disable_bkpt_cb(addr_t addr __unused, void *bkpt, void *proc)
 {
 	disable_breakpoint((struct process *)proc, bkpt);
 }
@@ -325,10 +478,10 @@ void disable_all_breakpoints(struct process *proc)
 	if (proc->shared->breakpoints == NULL)
 		return;
 	debug(1, "Disabling breakpoints for pid %d...", proc->pid);
-	dict_apply_to_all(proc->shared->breakpoints, disable_bkpt_cb, proc);
+	addrmap_apply_to_all(proc->shared->breakpoints, disable_bkpt_cb, proc);
 }
 
-static void free_bkpt_cb(void *addr __unused, void *bkpt, void *proc __unused)
+static void free_bkpt_cb(addr_t addr __unused, void *bkpt, void *proc __unused)
 {
 	breakpoint_put((struct breakpoint *)bkpt);
 }
@@ -338,20 +491,27 @@ static void free_all_breakpoints(struct process *proc)
 	if (proc->shared->breakpoints == NULL)
 		return;
 	debug(1, "Freeing breakpoints for pid %d...", proc->pid);
-	dict_apply_to_all(proc->shared->breakpoints, free_bkpt_cb, proc);
-	dict_clear(proc->shared->breakpoints);
+	addrmap_apply_to_all(proc->shared->breakpoints, free_bkpt_cb, proc);
+	addrmap_clear(proc->shared->breakpoints);
 	proc->shared->breakpoints = NULL;
 }
 
 void bkpt_finish(struct process *proc)
 {
-	if (--proc->shared->ref_count > 0)
+	int ref_count;
+
+	pthread_mutex_lock(&proc->shared->lock);
+	ref_count = --proc->shared->ref_count;
+	pthread_mutex_unlock(&proc->shared->lock);
+	if (ref_count > 0)
 		return;
-	assert(proc->shared->ref_count == 0);
+	assert(ref_count == 0);
 
 	free_all_solibs(proc->shared->main);
+	maps_invalidate(proc->shared->main);
 	ssol_finish(proc->shared->main);
 	free_all_breakpoints(proc->shared->main);
+	pthread_mutex_destroy(&proc->shared->lock);
 	free(proc->shared);
 	proc->shared = NULL;
 }
@@ -23,6 +23,7 @@
  */
 
 #include <libiberty.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,118 +38,206 @@
 #include "process.h"
 #include "report.h"
 #include "target_mem.h"
+#include "worker.h"
 
 static struct callback *current_cb = NULL;
 
+/* Plugins and report data are not thread safe, so the callbacks are
+ * serialized between tracer workers. The records reported by them are
+ * collected by the worker and written in order after the lock is released,
+ * so that the backtraces of the reported calls are unwound without the
+ * lock, see function_exit(). */
+static pthread_mutex_t cb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Number of tracing toggle requests (SIGUSR1) received. The processes
+ * are used by the workers tracing them without locking, so each worker
+ * toggles the tracing of its own processes, on its next callback. */
+static int toggle_requests;
+
 static int trace_enabled(struct process *proc)
 {
 	return (proc->trace_control != 0);
 }
 
+static void toggle_tracing(struct process *proc, int dummy __unused)
+{
+	if (trace_enabled(proc)) {
+		rp_finish(proc);
+		proc->trace_control = 0;
+	} else {
+		proc->trace_control = rp_init(proc) < 0 ? 0 : 1;
+	}
+}
+
+static void callback_lock(void)
+{
+	struct worker *w = worker_self();
+
+	pthread_mutex_lock(&cb_lock);
+	for (; w->toggles != toggle_requests; w->toggles++)
+		for_each_own_process(toggle_tracing, 0);
+}
+
+/* Releases the callback lock, and writes the records reported under it
+ * after the records collected before them by the other workers. */
+static void callback_unlock(int staged)
+{
+	pthread_mutex_unlock(&cb_lock);
+	if (staged)
+		rp_stage_commit();
+}
+
 static void process_create(struct process *proc)
 {
+	int staged = 0;
 	char *buf;
 
 	debug(3, "new process/thread (pid=%d)", proc->pid);
 
+	callback_lock();
 	if (trace_enabled(proc)) {
 		if (rp_init(proc) < 0) {
 			proc->trace_control = 0;
 		} else {
 			buf = cmd_from_pid(proc->pid, 1);
-			sp_rtrace_print_comment(proc->rp_data->fp, "Process/Thread %d (%s) was created\n",
+			rp_stage_begin(proc);
+			rp_print_comment(proc->rp_data, "Process/Thread %d (%s) was created\n",
 				 proc->pid, buf);
+			staged = rp_stage_end();
 			free(buf);
 		}
 	}
+	callback_unlock(staged);
 }
 
 static void process_exec(struct process *proc)
 {
+	int staged = 0;
 	char *buf;
 
 	debug(3, "process/thread has executed (pid=%d, filename=%s)",
 	      proc->pid, proc->filename);
 
+	callback_lock();
 	if (trace_enabled(proc)) {
 		buf = cmd_from_pid(proc->pid, 0);
-		sp_rtrace_print_comment(proc->rp_data->fp, "Process/Thread %d has executed: %s\n",
+		rp_stage_begin(proc);
+		rp_print_comment(proc->rp_data, "Process/Thread %d has executed: %s\n",
 			 proc->pid, buf);
+		staged = rp_stage_end();
 		free(buf);
 
 	}
+	callback_unlock(staged);
 }
 
 static void process_exit(struct process *proc, int exit_code)
 {
+	int staged = 0;
+
 	debug(3, "process/thread exited (pid=%d, exit_code=%d)", proc->pid,
 	      exit_code);
 
+	callback_lock();
 	if (trace_enabled(proc)) {
-		sp_rtrace_print_comment(proc->rp_data->fp, "Process/Thread %d has exited with code %d\n",
+		rp_stage_begin(proc);
+		rp_print_comment(proc->rp_data, "Process/Thread %d has exited with code %d\n",
 			 proc->pid, exit_code);
+		staged = rp_stage_end();
+	}
+	callback_unlock(staged);
+
+	/* the trace is closed after the comment is written */
+	callback_lock();
+	if (trace_enabled(proc)) {
+		rp_flush(proc->rp_data);
 		rp_finish(proc);
 	}
+	pthread_mutex_unlock(&cb_lock);
 }
 
 static void process_fork(struct process *proc, pid_t child_pid)
 {
+	int staged = 0;
 	char *buf;
 
 	debug(3, "process/thread has forked (pid=%d, filename=%s,"
 	      "child_pid=%d)", proc->pid, proc->filename, child_pid);
 
+	callback_lock();
 	if (trace_enabled(proc)) {
 		buf = cmd_from_pid(proc->pid, 0);
-		sp_rtrace_print_comment(proc->rp_data->fp, "Process/Thread %d (%s) has forked %d\n",
+		rp_stage_begin(proc);
+		rp_print_comment(proc->rp_data, "Process/Thread %d (%s) has forked %d\n",
 			 proc->pid, buf, child_pid);
+		staged = rp_stage_end();
 		free(buf);
 
 	}
+	callback_unlock(staged);
 }
 
 static void process_kill(struct process *proc, int signo)
 {
+	int staged = 0;
+
 	debug(3, "process/thread killed by signal (pid=%d, signo=%d)",
 	      proc->pid, signo);
 
+	callback_lock();
 	if (trace_enabled(proc) && proc->rp_data) {
-		sp_rtrace_print_comment(proc->rp_data->fp, "Process/Thread %d was killed by signal %d\n",
+		rp_stage_begin(proc);
+		rp_print_comment(proc->rp_data, "Process/Thread %d was killed by signal %d\n",
 			 proc->pid, signo);
+		staged = rp_stage_end();
 	}
-}
+	callback_unlock(staged);
 
-static void toggle_tracing(struct process *proc, int dummy __unused)
-{
-	if (trace_enabled(proc)) {
-		rp_finish(proc);
-		proc->trace_control = 0;
-	} else {
-		proc->trace_control = rp_init(proc) < 0 ? 0 : 1;
-	}
+	callback_lock();
+	if (trace_enabled(proc) && proc->rp_data)
+		rp_flush(proc->rp_data);
+	pthread_mutex_unlock(&cb_lock);
 }
 
 static void process_signal(struct process *proc, int signo)
 {
+	int staged = 0;
+
 	debug(3, "processi/thread received signal (pid=%d, signo=%d)",
 	      proc->pid, signo);
 
+	callback_lock();
 	if (signo == SIGUSR1) {
-		for_each_process(toggle_tracing, 0);
+		toggle_requests++;
+		worker_self()->toggles++;
+		for_each_own_process(toggle_tracing, 0);
 	} else if (trace_enabled(proc)) {
-		sp_rtrace_print_comment(proc->rp_data->fp, "Process/Thread %d received signal %d\n",
+		rp_stage_begin(proc);
+		rp_print_comment(proc->rp_data, "Process/Thread %d received signal %d\n",
 			 proc->pid, signo);
+		staged = rp_stage_end();
 	}
+	callback_unlock(staged);
 }
 
 static void process_interrupt(struct process *proc)
 {
+	int staged = 0;
+
 	debug(3, "process/thread interrupted (pid=%d)", proc->pid);
 
+	callback_lock();
 	if (trace_enabled(proc)) {
-		sp_rtrace_print_comment(proc->rp_data->fp, "Process/Thread %d was detached\n", proc->pid);
-		rp_finish(proc);
+		rp_stage_begin(proc);
+		rp_print_comment(proc->rp_data, "Process/Thread %d was detached\n", proc->pid);
+		staged = rp_stage_end();
 	}
+	callback_unlock(staged);
+
+	callback_lock();
+	if (trace_enabled(proc))
+		rp_finish(proc);
+	pthread_mutex_unlock(&cb_lock);
 }
 
 static void syscall_enter(__attribute__((unused)) struct process *proc, __attribute__((unused)) int sysno)
@@ -156,9 +245,24 @@ static void syscall_enter(__attribute__((unused)) struct process *proc, __attrib
 	debug(3, "syscall entry (pid=%d, sysno=%d)", proc->pid, sysno);
 }
 
-static void syscall_exit(__attribute__((unused)) struct process *proc, __attribute__((unused)) int sysno)
+static void syscall_exit(struct process *proc, int sysno)
 {
+	int staged = 0;
+
 	debug(3, "syscall exit (pid=%d, sysno=%d)", proc->pid, sysno);
+
+	/* Only system calls stopped by the seccomp filter are reported,
+	 * and not those made by the traced functions */
+	if (!proc->in_seccomp || proc->callstack != NULL)
+		return;
+
+	callback_lock();
+	if (trace_enabled(proc)) {
+		rp_stage_begin(proc);
+		plg_syscall_exit(proc, sysno);
+		staged = rp_stage_end();
+	}
+	callback_unlock(staged);
 }
 
 static void function_enter(__attribute__((unused)) struct process *proc, __attribute__((unused)) const char *name)
@@ -168,6 +272,8 @@ static void function_enter(__attribute__((unused)) struct process *proc, __attri
 
 static void function_exit(struct process *proc, const char *name)
 {
+	int staged = 0;
+
 	debug(3, "function return (pid=%d, name=%s)", proc->pid, name);
 
 	/* Avoid reporting internal/recursive calls */
@@ -175,28 +281,40 @@ static void function_exit(struct process *proc, const char *name)
 		return;
 
 	/* then check for plugin function */
+	callback_lock();
 	if (trace_enabled(proc)) {
+		/* The reported records are collected by the worker, so that
+		 * their backtraces can be unwound after releasing the lock,
+		 * in parallel with the other workers. */
+		rp_stage_begin(proc);
 		/* first check for context handling function */
-		if (!context_function_exit(proc, name)) return;
-		
-		plg_function_exit(proc, name);
+		if (context_function_exit(proc, name))
+			plg_function_exit(proc, name);
+		staged = rp_stage_end();
 	}
+	callback_unlock(staged);
 }
 
 static void library_load(struct process *proc, addr_t start_addr,
 			 addr_t end_addr, char *path)
 {
+	int staged = 0;
+
 	debug(3, "library load (pid=%d, start=0x%08x, end=0x%08x, path=%s)",
 	      proc->pid, start_addr, end_addr, path);
 
+	callback_lock();
 	if (trace_enabled(proc)) {
 		sp_rtrace_mmap_t mmap = {
 				.module = path,
 				.from = start_addr,
 				.to = end_addr,
 		};
-		sp_rtrace_print_mmap(proc->rp_data->fp, &mmap);
+		rp_stage_begin(proc);
+		rp_print_mmap(proc->rp_data, &mmap);
+		staged = rp_stage_end();
 	}
+	callback_unlock(staged);
 }
 
 static void cb_register(struct callback *cb)
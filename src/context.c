@@ -36,6 +36,13 @@
 
 int context_mask = 0;
 
+const char *context_symbols[] = {
+	"sp_context_create",
+	"sp_context_enter",
+	"sp_context_exit",
+	NULL
+};
+
 int context_function_exit(struct process *proc, const char *name)
 {
 	if (!strcmp(name, "sp_context_create")) {
@@ -46,7 +53,7 @@ int context_function_exit(struct process *proc, const char *name)
 				.id = fn_return_value(proc),
 				.name = context_name,
 		};
-		sp_rtrace_print_context(proc->rp_data->fp, &context);
+		rp_print_context(proc->rp_data, &context);
 		return 0;
 	}
 	else if (!strcmp(name, "sp_context_enter")) {
@@ -64,6 +71,9 @@ int context_function_exit(struct process *proc, const char *name)
 
 int context_match(const char *symname)
 {
+	/* called for every library symbol, reject most of them quickly */
+	if (strncmp(symname, "sp_context_", 11) != 0)
+		return 0;
 	return  strcmp(symname, "sp_context_create") == 0 ||
 			strcmp(symname, "sp_context_enter") == 0 ||
 			strcmp(symname, "sp_context_exit") == 0;
@@ -37,7 +37,7 @@
 
 struct dict_entry {
 	unsigned int hash;
-	void *key;
+	const void *key;
 	void *value;
 	struct dict_entry *next;
 };
@@ -50,12 +50,12 @@ struct dict_entry {
 
 struct dict {
 	struct dict_entry *buckets[DICTTABLESIZE];
-	unsigned int (*key2hash) (void *);
-	int (*key_cmp) (void *, void *);
+	unsigned int (*key2hash) (const void *);
+	int (*key_cmp) (const void *, const void *);
 };
 
-struct dict *dict_init(unsigned int (*key2hash) (void *),
-		       int (*key_cmp) (void *, void *))
+struct dict *dict_init(unsigned int (*key2hash) (const void *),
+		       int (*key_cmp) (const void *, const void *))
 {
 	struct dict *d;
 	int i;
@@ -89,7 +89,7 @@ void dict_clear(struct dict *d)
 	free(d);
 }
 
-int dict_enter(struct dict *d, void *key, void *value)
+int dict_enter(struct dict *d, const void *key, void *value)
 {
 	struct dict_entry *entry, *newentry;
 	unsigned int hash = d->key2hash(key);
@@ -120,7 +120,7 @@ int dict_enter(struct dict *d, void *key, void *value)
 	return 0;
 }
 
-void *dict_find_entry(struct dict *d, void *key)
+void *dict_find_entry(struct dict *d, const void *key)
 {
 	unsigned int hash = d->key2hash(key);
 	unsigned int bucketpos = hash % DICTTABLESIZE;
@@ -138,9 +138,30 @@ void *dict_find_entry(struct dict *d, void *key)
 	return entry ? entry->value : NULL;
 }
 
+void *dict_remove(struct dict *d, const void *key)
+{
+	unsigned int hash = d->key2hash(key);
+	unsigned int bucketpos = hash % DICTTABLESIZE;
+	struct dict_entry *entry, **link;
+	void *value;
+
+	assert(d);
+	for (link = &d->buckets[bucketpos]; (entry = *link) != NULL;
+	     link = &entry->next) {
+		if (hash == entry->hash && !d->key_cmp(key, entry->key))
+			break;
+	}
+	if (entry == NULL)
+		return NULL;
+	*link = entry->next;
+	value = entry->value;
+	free(entry);
+	return value;
+}
+
 void
 dict_apply_to_all(struct dict *d,
-		  void (*func) (void *key, void *value, void *data), void *data)
+		  void (*func) (const void *key, void *value, void *data), void *data)
 {
 	int i;
 
@@ -158,7 +179,7 @@ dict_apply_to_all(struct dict *d,
 
 /*****************************************************************************/
 
-unsigned int dict_key2hash_string(void *key)
+unsigned int dict_key2hash_string(const void *key)
 {
 	const char *s = (const char *)key;
 	unsigned int total = 0, shift = 0;
@@ -174,19 +195,19 @@ unsigned int dict_key2hash_string(void *key)
 	return total;
 }
 
-int dict_key_cmp_string(void *key1, void *key2)
+int dict_key_cmp_string(const void *key1, const void *key2)
 {
 	assert(key1);
 	assert(key2);
 	return strcmp((const char *)key1, (const char *)key2);
 }
 
-unsigned int dict_key2hash_int(void *key)
+unsigned int dict_key2hash_int(const void *key)
 {
 	return (unsigned long)key;
 }
 
-int dict_key_cmp_int(void *key1, void *key2)
+int dict_key_cmp_int(const void *key1, const void *key2)
 {
 	return (uintptr_t)key1 - (uintptr_t)key2;
 }
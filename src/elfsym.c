@@ -0,0 +1,748 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <elf.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libiberty.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "elfsym.h"
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define ELF_NATIVE_DATA		ELFDATA2LSB
+#else
+#define ELF_NATIVE_DATA		ELFDATA2MSB
+#endif
+
+/* directory of the separate debug symbol files */
+#define DEBUG_FILE_DIR		"/usr/lib/debug"
+/* debug file locations: next to the file, .debug and DEBUG_FILE_DIR */
+#define DEBUG_PATHS		3
+
+/* ELF32/ELF64 section header and symbol fields used by the reader */
+struct elf_shdr {
+	uint32_t name;
+	uint32_t type;
+	uint64_t flags;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t link;
+	uint64_t entsize;
+};
+
+struct elf_sym {
+	uint32_t name;
+	unsigned char info;
+	uint16_t shndx;
+	uint64_t value;
+};
+
+struct elf_file {
+	const unsigned char *map;
+	/* the mapping, kept writable for munmap() */
+	void *base;
+	size_t size;
+	int is64;
+	uint64_t entry;
+	uint64_t shoff, phoff;
+	unsigned int shnum, phnum;
+	const char *shstrtab;
+	uint64_t shstrtab_size;
+};
+
+/* Checks that the range is inside the mapped file. */
+static int in_file(struct elf_file *ef, uint64_t offset, uint64_t size)
+{
+	return offset <= ef->size && size <= ef->size - offset;
+}
+
+static void get_shdr(struct elf_file *ef, unsigned int i, struct elf_shdr *sh)
+{
+	if (ef->is64) {
+		const Elf64_Shdr *s = (const Elf64_Shdr *)(ef->map + ef->shoff) + i;
+		sh->name = s->sh_name;
+		sh->type = s->sh_type;
+		sh->flags = s->sh_flags;
+		sh->offset = s->sh_offset;
+		sh->size = s->sh_size;
+		sh->link = s->sh_link;
+		sh->entsize = s->sh_entsize;
+	} else {
+		const Elf32_Shdr *s = (const Elf32_Shdr *)(ef->map + ef->shoff) + i;
+		sh->name = s->sh_name;
+		sh->type = s->sh_type;
+		sh->flags = s->sh_flags;
+		sh->offset = s->sh_offset;
+		sh->size = s->sh_size;
+		sh->link = s->sh_link;
+		sh->entsize = s->sh_entsize;
+	}
+}
+
+static void get_sym(struct elf_file *ef, const void *table, size_t i,
+		    struct elf_sym *sym)
+{
+	if (ef->is64) {
+		const Elf64_Sym *s = (const Elf64_Sym *)table + i;
+		sym->name = s->st_name;
+		sym->info = s->st_info;
+		sym->shndx = s->st_shndx;
+		sym->value = s->st_value;
+	} else {
+		const Elf32_Sym *s = (const Elf32_Sym *)table + i;
+		sym->name = s->st_name;
+		sym->info = s->st_info;
+		sym->shndx = s->st_shndx;
+		sym->value = s->st_value;
+	}
+}
+
+static int find_section(struct elf_file *ef, const char *name,
+			struct elf_shdr *sh)
+{
+	unsigned int i;
+
+	for (i = 1; i < ef->shnum; i++) {
+		get_shdr(ef, i, sh);
+		if (sh->name < ef->shstrtab_size &&
+		    strcmp(ef->shstrtab + sh->name, name) == 0)
+			return 0;
+	}
+	return -1;
+}
+
+static struct elf_file *elf_map(int fd)
+{
+	struct elf_file *ef;
+	struct elf_shdr sh;
+	const Elf32_Ehdr *ehdr32;
+	const Elf64_Ehdr *ehdr64;
+	unsigned int shentsize, phentsize, shstrndx;
+	struct stat st;
+	void *map;
+
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(Elf64_Ehdr))
+		return NULL;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	ef = xcalloc(1, sizeof(struct elf_file));
+	ef->map = map;
+	ef->base = map;
+	ef->size = st.st_size;
+
+	ehdr32 = map;
+	ehdr64 = map;
+	if (memcmp(ehdr32->e_ident, ELFMAG, SELFMAG) != 0 ||
+	    ehdr32->e_ident[EI_DATA] != ELF_NATIVE_DATA)
+		goto fail;
+	switch (ehdr32->e_ident[EI_CLASS]) {
+	case ELFCLASS32:
+		ef->entry = ehdr32->e_entry;
+		ef->shoff = ehdr32->e_shoff;
+		ef->shnum = ehdr32->e_shnum;
+		ef->phoff = ehdr32->e_phoff;
+		ef->phnum = ehdr32->e_phnum;
+		shentsize = ehdr32->e_shentsize;
+		phentsize = ehdr32->e_phentsize;
+		shstrndx = ehdr32->e_shstrndx;
+		if ((ef->shnum && shentsize != sizeof(Elf32_Shdr)) ||
+		    (ef->phnum && phentsize != sizeof(Elf32_Phdr)))
+			goto fail;
+		break;
+	case ELFCLASS64:
+		ef->is64 = 1;
+		ef->entry = ehdr64->e_entry;
+		ef->shoff = ehdr64->e_shoff;
+		ef->shnum = ehdr64->e_shnum;
+		ef->phoff = ehdr64->e_phoff;
+		ef->phnum = ehdr64->e_phnum;
+		shentsize = ehdr64->e_shentsize;
+		phentsize = ehdr64->e_phentsize;
+		shstrndx = ehdr64->e_shstrndx;
+		if ((ef->shnum && shentsize != sizeof(Elf64_Shdr)) ||
+		    (ef->phnum && phentsize != sizeof(Elf64_Phdr)))
+			goto fail;
+		break;
+	default:
+		goto fail;
+	}
+	/* files with extended section numbering (e_shnum 0) are left to
+	 * libbfd */
+	if (!in_file(ef, ef->shoff, (uint64_t)ef->shnum * shentsize) ||
+	    !in_file(ef, ef->phoff, (uint64_t)ef->phnum * phentsize) ||
+	    ef->shnum == 0 || shstrndx >= ef->shnum)
+		goto fail;
+
+	get_shdr(ef, shstrndx, &sh);
+	if (!in_file(ef, sh.offset, sh.size) || sh.size == 0 ||
+	    ef->map[sh.offset + sh.size - 1] != '\0')
+		goto fail;
+	ef->shstrtab = (const char *)ef->map + sh.offset;
+	ef->shstrtab_size = sh.size;
+
+	return ef;
+
+fail:
+	elf_close(ef);
+	return NULL;
+}
+
+struct elf_file *elf_open(const char *filename)
+{
+	struct elf_file *ef;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		errno = 0;
+		return NULL;
+	}
+	ef = elf_map(fd);
+	close(fd);
+	errno = 0;
+	if (ef == NULL)
+		debug(2, "\"%s\": not read as native ELF file", filename);
+	return ef;
+}
+
+void elf_close(struct elf_file *ef)
+{
+	if (ef == NULL)
+		return;
+	munmap(ef->base, ef->size);
+	free(ef);
+}
+
+int elf_has_section(struct elf_file *ef, const char *name)
+{
+	struct elf_shdr sh;
+
+	return find_section(ef, name, &sh) == 0;
+}
+
+int elf_is_prelinked(struct elf_file *ef)
+{
+	return elf_has_section(ef, ".gnu.prelink_undo");
+}
+
+/* CRC used by .gnu_debuglink (the one of zlib and gdb) */
+static uint32_t crc_table[256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void crc_table_init(void)
+{
+	uint32_t i, c;
+	int j;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crc_table[i] = c;
+	}
+}
+
+static uint32_t debuglink_crc32(const unsigned char *buf, size_t len)
+{
+	uint32_t *table = crc_table;
+	uint32_t crc = 0xffffffff;
+	size_t i;
+
+	/* libraries may be read by several threads */
+	pthread_once(&crc_table_once, crc_table_init);
+	for (i = 0; i < len; i++)
+		crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+/* Returns the path of the debug file named by .gnu_debuglink section at
+ * the location I (< DEBUG_PATHS), or -1 if the section is missing. */
+static int debug_path(struct elf_file *ef, const char *filename, int i,
+		      char *path, size_t size, uint32_t *crc)
+{
+	struct elf_shdr sh;
+	const char *name, *slash;
+	char dir[PATH_MAX];
+	size_t len;
+
+	if (find_section(ef, ".gnu_debuglink", &sh) == -1 ||
+	    !in_file(ef, sh.offset, sh.size))
+		return -1;
+	name = (const char *)ef->map + sh.offset;
+	len = strnlen(name, sh.size);
+	/* the name is followed by the CRC at the next 4 byte boundary */
+	if (len == 0 || ((len + 4) & ~3) + 4 > sh.size)
+		return -1;
+	memcpy(crc, name + ((len + 4) & ~3), 4);
+
+	slash = strrchr(filename, '/');
+	len = slash ? (size_t)(slash - filename) : 0;
+	if (len >= sizeof(dir))
+		return -1;
+	memcpy(dir, filename, len);
+	dir[len] = '\0';
+
+	if (i == 0)
+		snprintf(path, size, "%s/%s", dir, name);
+	else if (i == 1)
+		snprintf(path, size, "%s/.debug/%s", dir, name);
+	else
+		snprintf(path, size, DEBUG_FILE_DIR "%s/%s", dir, name);
+	return 0;
+}
+
+struct elf_file *elf_open_debug(struct elf_file *ef, const char *filename)
+{
+	struct elf_file *dbg;
+	char path[PATH_MAX];
+	uint32_t crc;
+	int i;
+
+	for (i = 0; i < DEBUG_PATHS; i++) {
+		if (debug_path(ef, filename, i, path, sizeof(path), &crc) == -1)
+			return NULL;
+		dbg = elf_open(path);
+		if (dbg == NULL)
+			continue;
+		if (debuglink_crc32(dbg->map, dbg->size) == crc) {
+			debug(2, "debug symbols of \"%s\" from \"%s\"", filename, path);
+			return dbg;
+		}
+		elf_close(dbg);
+	}
+	return NULL;
+}
+
+int elf_find_debug(struct elf_file *ef, const char *filename, char *path,
+		   size_t size)
+{
+	uint32_t crc;
+	int i;
+
+	for (i = 0; i < DEBUG_PATHS; i++) {
+		if (debug_path(ef, filename, i, path, size, &crc) == -1)
+			return -1;
+		if (access(path, R_OK) == 0)
+			return 0;
+	}
+	return -1;
+}
+
+/* Locates the symbol table and its string table. */
+static long symtab(struct elf_file *ef, enum elf_symtab table,
+		   const void **syms, const char **strtab,
+		   uint64_t *strtab_size)
+{
+	uint32_t type = table == ELF_DYNSYM ? SHT_DYNSYM : SHT_SYMTAB;
+	size_t entsize = ef->is64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+	struct elf_shdr sh, str;
+	unsigned int i;
+
+	for (i = 1; i < ef->shnum; i++) {
+		get_shdr(ef, i, &sh);
+		if (sh.type == type)
+			break;
+	}
+	if (i == ef->shnum || sh.entsize != entsize ||
+	    !in_file(ef, sh.offset, sh.size) || sh.link >= ef->shnum)
+		return -1;
+	get_shdr(ef, sh.link, &str);
+	if (!in_file(ef, str.offset, str.size) || str.size == 0 ||
+	    ef->map[str.offset + str.size - 1] != '\0')
+		return -1;
+
+	*syms = ef->map + sh.offset;
+	*strtab = (const char *)ef->map + str.offset;
+	*strtab_size = str.size;
+	return sh.size / entsize;
+}
+
+static int is_function(struct elf_sym *sym)
+{
+	switch (ELF32_ST_TYPE(sym->info)) {
+	case STT_FUNC:
+	case STT_GNU_IFUNC:
+#ifdef __arm__
+	case STT_ARM_TFUNC:
+#endif
+		return sym->shndx != SHN_UNDEF;
+	default:
+		return 0;
+	}
+}
+
+static addr_t function_address(struct elf_sym *sym)
+{
+	addr_t value = sym->value;
+
+#ifdef __arm__
+	/* STT_ARM_TFUNC was used before binutils-2.22 */
+	if (ELF32_ST_TYPE(sym->info) == STT_ARM_TFUNC)
+		value |= 1;
+#endif
+	return value;
+}
+
+long elf_for_each_function(struct elf_file *ef, enum elf_symtab table,
+		void (*func)(const char *name, addr_t value, void *data),
+		void *data)
+{
+	const void *syms;
+	const char *strtab;
+	uint64_t strtab_size;
+	struct elf_sym sym;
+	long nsyms, i;
+
+	nsyms = symtab(ef, table, &syms, &strtab, &strtab_size);
+	for (i = 1; i < nsyms; i++) {
+		get_sym(ef, syms, i, &sym);
+		if (!is_function(&sym) || sym.name >= strtab_size)
+			continue;
+		func(strtab + sym.name, function_address(&sym), data);
+	}
+	return nsyms;
+}
+
+/* Locates the dynamic symbol hash table, preferring the GNU one. */
+static int hash_section(struct elf_file *ef, struct elf_shdr *sh)
+{
+	struct elf_shdr hash;
+	unsigned int i;
+	int found = 0;
+
+	for (i = 1; i < ef->shnum; i++) {
+		get_shdr(ef, i, sh);
+		if (sh->type == SHT_GNU_HASH)
+			break;
+		if (sh->type == SHT_HASH && !found) {
+			hash = *sh;
+			found = 1;
+		}
+	}
+	if (i == ef->shnum) {
+		if (!found)
+			return -1;
+		*sh = hash;
+	}
+	return in_file(ef, sh->offset, sh->size) ? 0 : -1;
+}
+
+static uint32_t gnu_hash(const char *name)
+{
+	const unsigned char *p = (const unsigned char *)name;
+	uint32_t h = 5381;
+
+	while (*p)
+		h = h * 33 + *p++;
+	return h;
+}
+
+static uint32_t sysv_hash(const char *name)
+{
+	const unsigned char *p = (const unsigned char *)name;
+	uint32_t h = 0, g;
+
+	while (*p) {
+		h = (h << 4) + *p++;
+		g = h & 0xf0000000;
+		h ^= g >> 24;
+		h &= ~g;
+	}
+	return h;
+}
+
+/* Reports the symbol if it is a defined function of the given name. */
+static int match_symbol(struct elf_file *ef, const void *syms, size_t i,
+			const char *strtab, uint64_t strtab_size,
+			const char *name,
+			void (*func)(const char *name, addr_t value, void *data),
+			void *data)
+{
+	struct elf_sym sym;
+
+	get_sym(ef, syms, i, &sym);
+	if (!is_function(&sym) || sym.name >= strtab_size ||
+	    strcmp(strtab + sym.name, name) != 0)
+		return 0;
+	func(strtab + sym.name, function_address(&sym), data);
+	return 1;
+}
+
+/* See "GNU Hash ELF Sections" by Ali Bahrami for the table layout. */
+static int gnu_hash_lookup(struct elf_file *ef, struct elf_shdr *sh,
+			   const void *syms, long nsyms, const char *strtab,
+			   uint64_t strtab_size, const char *name,
+			   void (*func)(const char *name, addr_t value, void *data),
+			   void *data)
+{
+	const uint32_t *table = (const uint32_t *)(ef->map + sh->offset);
+	uint32_t nbuckets, symoffset, bloom_size, bloom_shift;
+	uint32_t h, h2, nchain, i;
+	const uint32_t *buckets, *chain;
+	unsigned int bits = ef->is64 ? 64 : 32;
+	uint64_t word, mask, words;
+	int found = 0;
+
+	if (sh->size < 4 * sizeof(uint32_t))
+		return 0;
+	nbuckets = table[0];
+	symoffset = table[1];
+	bloom_size = table[2];
+	bloom_shift = table[3];
+	/* bloom filter words are of the ELF class size */
+	words = (uint64_t)bloom_size * (bits / 32);
+	if (nbuckets == 0 || bloom_size == 0 ||
+	    (4 + words + nbuckets) * sizeof(uint32_t) > sh->size)
+		return 0;
+	buckets = table + 4 + words;
+	chain = buckets + nbuckets;
+	nchain = sh->size / sizeof(uint32_t) - (chain - table);
+
+	h = gnu_hash(name);
+	if (ef->is64)
+		word = ((const uint64_t *)(table + 4))[(h / bits) % bloom_size];
+	else
+		word = table[4 + (h / bits) % bloom_size];
+	mask = (1ULL << (h % bits)) | (1ULL << ((h >> bloom_shift) % bits));
+	if ((word & mask) != mask)
+		return 0;
+
+	/* symbols with the same hash are next to each other, the chain
+	 * value of the last one has the lowest bit set */
+	i = buckets[h % nbuckets];
+	if (i == 0)
+		return 0;
+	for (; i >= symoffset && i < nsyms; i++) {
+		if (i - symoffset >= nchain)
+			break;
+		h2 = chain[i - symoffset];
+		if ((h | 1) == (h2 | 1))
+			found += match_symbol(ef, syms, i, strtab, strtab_size,
+					      name, func, data);
+		if (h2 & 1)
+			break;
+	}
+	return found;
+}
+
+static int sysv_hash_lookup(struct elf_file *ef, struct elf_shdr *sh,
+			    const void *syms, long nsyms, const char *strtab,
+			    uint64_t strtab_size, const char *name,
+			    void (*func)(const char *name, addr_t value, void *data),
+			    void *data)
+{
+	const uint32_t *table = (const uint32_t *)(ef->map + sh->offset);
+	uint32_t nbucket, nchain, i, n;
+	int found = 0;
+
+	if (sh->size < 2 * sizeof(uint32_t))
+		return 0;
+	nbucket = table[0];
+	nchain = table[1];
+	if (nbucket == 0 ||
+	    (2 + (uint64_t)nbucket + nchain) * sizeof(uint32_t) > sh->size)
+		return 0;
+
+	/* the loop count limit protects against corrupted chains */
+	i = table[2 + sysv_hash(name) % nbucket];
+	for (n = 0; i != STN_UNDEF && i < nchain && i < nsyms && n < nchain; n++) {
+		found += match_symbol(ef, syms, i, strtab, strtab_size, name,
+				      func, data);
+		i = table[2 + nbucket + i];
+	}
+	return found;
+}
+
+int elf_has_dynamic_hash(struct elf_file *ef)
+{
+	struct elf_shdr sh;
+
+	return hash_section(ef, &sh) == 0;
+}
+
+int elf_lookup_dynamic(struct elf_file *ef, const char *name,
+		void (*func)(const char *name, addr_t value, void *data),
+		void *data)
+{
+	const void *syms;
+	const char *strtab;
+	uint64_t strtab_size;
+	struct elf_shdr sh;
+	long nsyms;
+
+	if (hash_section(ef, &sh) == -1)
+		return -1;
+	nsyms = symtab(ef, ELF_DYNSYM, &syms, &strtab, &strtab_size);
+	if (nsyms < 0)
+		return -1;
+	/* the tables are arrays of 32-bit words */
+	if (sh.offset % sizeof(uint32_t))
+		return -1;
+	if (sh.type == SHT_GNU_HASH) {
+		if (ef->is64 && sh.offset % sizeof(uint64_t))
+			return -1;
+		return gnu_hash_lookup(ef, &sh, syms, nsyms, strtab,
+				       strtab_size, name, func, data);
+	}
+	return sysv_hash_lookup(ef, &sh, syms, nsyms, strtab, strtab_size,
+				name, func, data);
+}
+
+addr_t elf_lookup_function(struct elf_file *ef, const char *name)
+{
+	enum elf_symtab tables[] = { ELF_SYMTAB, ELF_DYNSYM };
+	const void *syms;
+	const char *strtab;
+	uint64_t strtab_size;
+	struct elf_sym sym;
+	struct elf_shdr sh;
+	long nsyms, i;
+	unsigned int t;
+
+	for (t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+		nsyms = symtab(ef, tables[t], &syms, &strtab, &strtab_size);
+		for (i = 1; i < nsyms; i++) {
+			get_sym(ef, syms, i, &sym);
+			if (sym.name >= strtab_size ||
+			    strcmp(strtab + sym.name, name) != 0)
+				continue;
+			if (sym.shndx == SHN_UNDEF || sym.shndx >= ef->shnum)
+				continue;
+			get_shdr(ef, sym.shndx, &sh);
+			if (!(sh.flags & SHF_EXECINSTR))
+				continue;
+			return function_address(&sym);
+		}
+	}
+	return 0;
+}
+
+addr_t elf_entry(struct elf_file *ef)
+{
+	return ef->entry;
+}
+
+/* Returns the type, offset, virtual address and size of a program
+ * header. */
+static void get_phdr(struct elf_file *ef, unsigned int i, uint32_t *type,
+		     uint64_t *offset, uint64_t *vaddr, uint64_t *filesz)
+{
+	if (ef->is64) {
+		const Elf64_Phdr *p = (const Elf64_Phdr *)(ef->map + ef->phoff) + i;
+		*type = p->p_type;
+		*offset = p->p_offset;
+		*vaddr = p->p_vaddr;
+		*filesz = p->p_filesz;
+	} else {
+		const Elf32_Phdr *p = (const Elf32_Phdr *)(ef->map + ef->phoff) + i;
+		*type = p->p_type;
+		*offset = p->p_offset;
+		*vaddr = p->p_vaddr;
+		*filesz = p->p_filesz;
+	}
+}
+
+int elf_is_pic(struct elf_file *ef)
+{
+	uint64_t offset, vaddr, filesz;
+	uint32_t type;
+	unsigned int i;
+
+	for (i = 0; i < ef->phnum; i++) {
+		get_phdr(ef, i, &type, &offset, &vaddr, &filesz);
+		if (type == PT_LOAD && offset == 0)
+			return vaddr == 0;
+	}
+	return 0;
+}
+
+addr_t elf_dynamic(struct elf_file *ef)
+{
+	uint64_t offset, vaddr, filesz;
+	uint32_t type;
+	unsigned int i;
+
+	for (i = 0; i < ef->phnum; i++) {
+		get_phdr(ef, i, &type, &offset, &vaddr, &filesz);
+		if (type == PT_DYNAMIC)
+			return vaddr;
+	}
+	return 0;
+}
+
+int elf_load_range(struct elf_file *ef, addr_t *lo, addr_t *hi)
+{
+	uint64_t offset, vaddr, filesz, start = UINT64_MAX, end = 0;
+	uint64_t page_size = sysconf(_SC_PAGESIZE);
+	uint32_t type;
+	unsigned int i;
+
+	for (i = 0; i < ef->phnum; i++) {
+		get_phdr(ef, i, &type, &offset, &vaddr, &filesz);
+		if (type != PT_LOAD)
+			continue;
+		if (vaddr < start)
+			start = vaddr;
+		/* the memory size may be larger, but the file size covers
+		 * the code */
+		if (vaddr + filesz > end)
+			end = vaddr + filesz;
+	}
+	if (end == 0)
+		return -1;
+	*lo = start & ~(page_size - 1);
+	*hi = (end + page_size - 1) & ~(page_size - 1);
+	return 0;
+}
+
+const char *elf_interp(struct elf_file *ef)
+{
+	uint64_t offset, vaddr, filesz;
+	uint32_t type;
+	unsigned int i;
+
+	for (i = 0; i < ef->phnum; i++) {
+		get_phdr(ef, i, &type, &offset, &vaddr, &filesz);
+		if (type != PT_INTERP)
+			continue;
+		if (!in_file(ef, offset, filesz) || filesz == 0 ||
+		    ef->map[offset + filesz - 1] != '\0')
+			return NULL;
+		return (const char *)ef->map + offset;
+	}
+	return NULL;
+}
@@ -25,6 +25,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <libiberty.h>
 
 #include <sys/ptrace.h>
@@ -34,6 +35,8 @@
 #include "breakpoint.h"
 #include "debug.h"
 #include "function.h"
+#include "sample.h"
+#include "seccomp.h"
 #include "ssol.h"
 #include "target_mem.h"
 
@@ -48,6 +51,10 @@ long fn_argument(struct process *proc, int arg_num)
 	addr_t sp;
 
 	debug(3, "fn_argument(pid=%d, arg_num=%d)", proc->pid, arg_num);
+	if (proc->in_seccomp)
+		return seccomp_argument(proc, arg_num);
+	if (proc->sample)
+		return sample_argument(proc->sample, arg_num);
 	if (proc->callstack == NULL) {
 		debug(1, "no function argument data is saved");
 		if (arg_num < 4)
@@ -72,6 +79,8 @@ long fn_argument(struct process *proc, int arg_num)
 
 long fn_return_value(struct process *proc)
 {
+	if (proc->in_seccomp)
+		return seccomp_return_value(proc);
 	return trace_user_readw(proc, off_r0);
 }
 
@@ -146,8 +155,58 @@ void fn_callstack_restore(struct process *proc, int original)
 	}
 }
 
+void fn_callstack_clone(struct process *dst, struct process *src,
+			char *(*map_name)(char *name, void *data), void *data)
+{
+	struct callstack *from, *cs, **link = &dst->callstack;
+
+	for (from = src->callstack; from; from = from->next) {
+		cs = xmalloc(sizeof(struct callstack));
+		cs->data[0] = xmalloc(sizeof(struct pt_regs));
+		memcpy(cs->data[0], from->data[0], sizeof(struct pt_regs));
+		cs->data[1] = from->data[1];
+		cs->data[2] = map_name((char *)from->data[2], data);
+		*link = cs;
+		link = &cs->next;
+	}
+	*link = NULL;
+#ifdef DEBUG
+	dst->callstack_depth = src->callstack_depth;
+#endif
+}
+
+addr_t fn_return_address_slot(struct callstack *cs)
+{
+	struct pt_regs *regs = (struct pt_regs *)cs->data[0];
+
+	/* the usual place of the saved lr, but not guaranteed */
+	return regs->ARM_sp - 4;
+}
+
 char *fn_name(struct process *proc)
 {
 	assert(proc->callstack != NULL);
 	return (char *)proc->callstack->data[2];
 }
+
+void fn_setup_call(struct process *proc __unused, void *regs_, addr_t fn,
+		   unsigned int argnum, long *args, addr_t ret_addr)
+{
+	struct pt_regs *regs = regs_;
+	unsigned int i;
+
+	/* the arguments are passed in r0-r3 */
+	assert(argnum <= 4);
+	for (i = 0; i < argnum; i++)
+		regs->uregs[i] = args[i];
+	regs->ARM_sp &= ~7UL;
+	regs->ARM_lr = ret_addr;
+	regs->ARM_pc = fn & ~1UL;
+	/* Thumb functions have the lowest bit set */
+	if (fn & 1)
+		regs->ARM_cpsr |= (1 << 5);
+	else
+		regs->ARM_cpsr &= ~(1 << 5);
+	/* an interrupted system call is not restarted */
+	regs->ARM_ORIG_r0 = -1;
+}
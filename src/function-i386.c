@@ -28,10 +28,13 @@
 #include <libiberty.h>
 #include <sys/ptrace.h>
 #include <linux/ptrace.h>
+#include <sys/procfs.h>
 
 #include "breakpoint.h"
 #include "debug.h"
 #include "function.h"
+#include "sample.h"
+#include "seccomp.h"
 #include "ssol.h"
 
 static addr_t get_stack_pointer(struct process *proc)
@@ -44,6 +47,10 @@ long fn_argument(struct process *proc, int arg_num)
 	addr_t sp;
 
 	debug(3, "fn_argument(pid=%d, arg_num=%d)", proc->pid, arg_num);
+	if (proc->in_seccomp)
+		return seccomp_argument(proc, arg_num);
+	if (proc->sample)
+		return sample_argument(proc->sample, arg_num);
 	if (proc->callstack == NULL) {
 		debug(1, "callstack is empty");
 		sp = get_stack_pointer(proc);
@@ -55,6 +62,8 @@ long fn_argument(struct process *proc, int arg_num)
 
 long fn_return_value(struct process *proc)
 {
+	if (proc->in_seccomp)
+		return seccomp_return_value(proc);
 	return trace_user_readw(proc, 4 * EAX);
 }
 
@@ -133,8 +142,51 @@ void fn_callstack_restore(struct process *proc, int original)
 	}
 }
 
+void fn_callstack_clone(struct process *dst, struct process *src,
+			char *(*map_name)(char *name, void *data), void *data)
+{
+	struct callstack *from, *cs, **link = &dst->callstack;
+
+	for (from = src->callstack; from; from = from->next) {
+		cs = xmalloc(sizeof(struct callstack));
+		cs->data[0] = from->data[0];
+		cs->data[1] = from->data[1];
+		cs->data[2] = map_name((char *)from->data[2], data);
+		*link = cs;
+		link = &cs->next;
+	}
+	*link = NULL;
+#ifdef DEBUG
+	dst->callstack_depth = src->callstack_depth;
+#endif
+}
+
+addr_t fn_return_address_slot(struct callstack *cs)
+{
+	return (addr_t)cs->data[0];
+}
+
 char *fn_name(struct process *proc)
 {
 	assert(proc->callstack != NULL);
 	return (char *)proc->callstack->data[2];
 }
+
+void fn_setup_call(struct process *proc, void *regs_, addr_t fn,
+		   unsigned int argnum, long *args, addr_t ret_addr)
+{
+	elf_greg_t *regs = regs_;
+	addr_t sp = regs[UESP];
+	unsigned int i;
+
+	/* the arguments are pushed on the stack, aligned like at a call */
+	sp = (sp - 4 * argnum) & ~(addr_t)15;
+	for (i = 0; i < argnum; i++)
+		trace_mem_writew(proc, sp + 4 * i, args[i]);
+	sp -= 4;
+	trace_mem_writew(proc, sp, ret_addr);
+	regs[UESP] = sp;
+	regs[EIP] = fn;
+	/* an interrupted system call is not restarted */
+	regs[ORIG_EAX] = -1;
+}
@@ -29,12 +29,17 @@
 #include <unistd.h>
 #include <sys/syscall.h>
 
+#include "agent.h"
 #include "callback.h"
 #include "debug.h"
 #include "options.h"
 #include "process.h"
+#include "seccomp.h"
+#include "symcache.h"
 #include "trace.h"
+#include "uprobe.h"
 #include "filter.h"
+#include "worker.h"
 
 #define CAPACITY(a)        (sizeof(a) / sizeof(*a))
 
@@ -96,19 +101,21 @@ static void signal_attach(void)
 
 int main(int argc, char *argv[])
 {
-	int prog_index, ret, i;
+	int prog_index, ret;
 
 	signal_attach();
 	if ((ret = process_options(argc, argv, &prog_index)))
 		exit(ret);
 
 	cb_init();
-	for (i = 0; i < arguments.npids; i++)
-		trace_attach_child(arguments.pid[i]);
-	if (!arguments.npids)
-		trace_execute(arguments.remaining_args[0],
-				arguments.remaining_args);
-	ret = trace_main_loop();
+	symcache_init();
+	seccomp_init();
+	uprobe_init();
+	agent_init();
+	ret = worker_run();
+	agent_finish();
+	uprobe_finish();
+	symcache_finish();
 
 	/* Do cleanup before exiting to keep valgrind happy.
 	 * FIXME: cleanup when functracer is interrupted with CTRL+C too. */
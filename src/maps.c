@@ -22,61 +22,129 @@
  *
  */
 
-#include <errno.h>
-#include <limits.h>
-#include <stdio.h>
+#include <libiberty.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 
 #include "debug.h"
 #include "maps.h"
+#include "process.h"
+#include "procfs.h"
 
 int maps_init(struct maps_data *md, pid_t pid)
 {
-	char path[PATH_MAX];
-	FILE *fp;
-
-	snprintf(path, sizeof(path), "/proc/%d/maps", pid);
-	fp = fopen(path, "r");
-	if (fp == NULL) {
-		msg_err("fopen: %s", path);
+	md->pos = procfs_read(pid, PROCFS_MAPS, NULL);
+	if (md->pos == NULL) {
+		msg_err("read: /proc/%d/maps", pid);
 		return -1;
 	}
-	md->fp = fp;
 	return 0;
 }
 
 int maps_next(struct maps_data *md)
 {
-	static char path_buf[PATH_MAX];
+	char *p = md->pos, *end;
 
-	if (fscanf(md->fp, "%lx-%lx %4s %lx %x:%x %d%*[ ]", &md->lo, &md->hi,
-	    md->perm, &md->off, &md->maj, &md->min, &md->inum) == EOF) {
+	if (*p == '\0') {
 		/* no more lines to read */
 		return 0;
 	}
-	if (fgets(path_buf, sizeof(path_buf), md->fp) == NULL && errno != EOF) {
-		msg_err("fgets");
-		return -1;
-	}
-	if (path_buf[strlen(path_buf) - 1] != '\n') {
-		msg_err("truncated path returned (too long path?)");
+	end = strchr(p, '\n');
+	if (end == NULL) {
+		msg_err("truncated line in maps file");
 		return -1;
 	}
+	*end = '\0';
+	md->pos = end + 1;
 
-	/* remove trailing newline */
-	path_buf[strlen(path_buf) - 1] = '\0';
-
-	/* return pointer to static data, avoiding unnecessary allocations */
-	/* string in path_buf is only valid until next maps_next() call */
-	md->path = path_buf;
+	/* "lo-hi perm off maj:min inum   path" */
+	md->lo = strtoul(p, &p, 16);
+	md->hi = strtoul(p + 1, &p, 16);
+	while (*p == ' ')
+		p++;
+	memcpy(md->perm, p, 4);
+	md->perm[4] = '\0';
+	md->off = strtoul(p + 4, &p, 16);
+	md->maj = strtoul(p, &p, 16);
+	md->min = strtoul(p + 1, &p, 16);
+	md->inum = strtoul(p, &p, 10);
+	while (*p == ' ')
+		p++;
+	/* points to the procfs buffer, avoiding unnecessary allocations */
+	md->path = p;
 
 	return 1;
 }
 
 int maps_finish(struct maps_data *md)
 {
-	fclose(md->fp);
+	md->pos = NULL;
 
 	return 0;
 }
+
+static struct maps_index *maps_read(pid_t pid)
+{
+	struct maps_index *index;
+	struct maps_data md;
+	int size = 0;
+
+	if (maps_init(&md, pid) == -1)
+		return NULL;
+	index = xcalloc(1, sizeof(struct maps_index));
+	/* the kernel lists the mappings in address order */
+	while (maps_next(&md) == 1) {
+		if (index->nmaps == size) {
+			size = size ? size * 2 : 64;
+			index->maps = xrealloc(index->maps,
+					       size * sizeof(struct maps_data));
+		}
+		index->maps[index->nmaps] = md;
+		index->maps[index->nmaps].pos = NULL;
+		index->maps[index->nmaps].path = xstrdup(md.path);
+		index->nmaps++;
+	}
+	maps_finish(&md);
+	debug(3, "%d mappings read for pid %d", index->nmaps, pid);
+	return index;
+}
+
+struct maps_index *maps_get(struct process *proc)
+{
+	struct process_shared *shared = proc->shared;
+
+	if (shared->maps == NULL)
+		shared->maps = maps_read(shared->main->pid);
+	return shared->maps;
+}
+
+void maps_invalidate(struct process *proc)
+{
+	struct maps_index *index = proc->shared->maps;
+	int i;
+
+	if (index == NULL)
+		return;
+	for (i = 0; i < index->nmaps; i++)
+		free(index->maps[i].path);
+	free(index->maps);
+	free(index);
+	proc->shared->maps = NULL;
+}
+
+struct maps_data *maps_lookup(struct maps_index *index, addr_t addr)
+{
+	int lo = 0, hi = index->nmaps - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (addr < index->maps[mid].lo)
+			hi = mid - 1;
+		else if (addr >= index->maps[mid].hi)
+			lo = mid + 1;
+		else
+			return &index->maps[mid];
+	}
+	return NULL;
+}
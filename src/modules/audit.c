@@ -109,7 +109,7 @@ static void audit_function_exit(struct process *proc, const char *name)
 				.res_size = RES_SIZE,
 				.res_id = (pointer_t)RES_ID,
 			};
-			sp_rtrace_print_call(rd->fp, &call);
+			rp_print_call(rd, &call);
 			rp_write_backtraces(proc, &call);
 			break;
 		}
@@ -213,7 +213,7 @@ static int get_symbols(struct plg_symbol **syms)
 static void audit_report_init(struct process *proc)
 {
 	assert(proc->rp_data != NULL);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_audit);
+	rp_print_resource(proc->rp_data, &res_audit);
 }
 
 
@@ -29,9 +29,11 @@
 #include <string.h>
 #include <linux/fcntl.h>
 #include <limits.h>
+#include <sys/syscall.h>
 #include <sp_rtrace_formatter.h>
 #include <sp_rtrace_defs.h>
 
+#include "config.h"
 #include "debug.h"
 #include "function.h"
 #include "options.h"
@@ -41,7 +43,7 @@
 #include "context.h"
 #include "util.h"
 
-#define FILE_API_VERSION "2.0"
+#define FILE_API_VERSION "2.1"
 #define RES_SIZE 1
 
 #define MAX_DETAILS_LEN 512
@@ -84,9 +86,9 @@ static void write_function(struct process *proc, const char *name, unsigned int
 		.res_type = res_type,
 		.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME,
 	};
-	sp_rtrace_print_call(rd->fp, &call);
+	rp_print_call(rd, &call);
 	if (args) {
-		sp_rtrace_print_args(rd->fp, args);
+		rp_print_args(rd, args);
 	}
 	rp_write_backtraces(proc, &call);
 	(rd->rp_number)++;
@@ -192,6 +194,19 @@ static void file_function_exit(struct process *proc, const char *name)
 			write_function(proc, name, SP_RTRACE_FTYPE_ALLOC, args, res_fd.type, RES_SIZE, retval);
 		}
 
+	} else if (strcmp(name, "openat") == 0) {
+		/* reported only by system call tracing */
+		if (retval != (addr_t)-1) {
+			trace_mem_readstr(proc, fn_argument(proc, 1), path, sizeof(path));
+			snprintf(mode, sizeof(mode), "%ld", fn_argument(proc, 2));
+			sp_rtrace_farg_t args[] = {
+				{.name = "path", .value = path},
+				{.name = "flags", .value = mode},
+				{.name = NULL}
+			};
+			write_function(proc, name, SP_RTRACE_FTYPE_ALLOC, args, res_fd.type, RES_SIZE, retval);
+		}
+
 	} else if (strcmp(name, "__close") == 0) {
 		if (retval == 0) {
 			size_t arg0 = fn_argument(proc, 0);
@@ -343,12 +358,52 @@ static int get_symbols(struct plg_symbol **syms)
 	return ARRAY_SIZE(symbols);
 }
 
+/* File descriptor functions are tracked also at system call level. The
+ * FILE* functions are still traced with breakpoints. */
+static struct plg_syscall syscalls[] = {
+	{.sysno = SYS_open, .name = "__open"},
+	{.sysno = SYS_openat, .name = "openat"},
+	{.sysno = SYS_creat, .name = "creat"},
+	{.sysno = SYS_close, .name = "__close"},
+	{.sysno = SYS_dup, .name = "dup"},
+	{.sysno = SYS_dup2, .name = "__dup2"},
+	{.sysno = SYS_dup3, .name = "dup3"},
+	{.sysno = SYS_fcntl, .name = "fcntl"},
+	{.sysno = SYS_fcntl64, .name = "fcntl"},
+	{.sysno = SYS_pipe, .name = "pipe"},
+	{.sysno = SYS_pipe2, .name = "pipe2"},
+#ifdef ARCH_ARM
+	/* x86 multiplexes socket calls through socketcall() */
+	{.sysno = SYS_accept, .name = "accept"},
+#ifdef SYS_accept4
+	{.sysno = SYS_accept4, .name = "accept4"},
+#endif
+	{.sysno = SYS_socket, .name = "socket"},
+	{.sysno = SYS_socketpair, .name = "socketpair"},
+#endif
+	{.sysno = SYS_eventfd, .name = "eventfd"},
+	{.sysno = SYS_eventfd2, .name = "eventfd"},
+	{.sysno = SYS_signalfd, .name = "signalfd"},
+	{.sysno = SYS_signalfd4, .name = "signalfd"},
+	{.sysno = SYS_timerfd_create, .name = "timerfd_create"},
+	{.sysno = SYS_epoll_create, .name = "epoll_create"},
+	{.sysno = SYS_epoll_create1, .name = "epoll_create1"},
+	{.sysno = SYS_inotify_init, .name = "inotify_init"},
+	{.sysno = SYS_inotify_init1, .name = "inotify_init1"},
+};
+
+static int get_syscalls(struct plg_syscall **sysc)
+{
+	*sysc = syscalls;
+	return ARRAY_SIZE(syscalls);
+}
+
 
 static void file_report_init(struct process *proc)
 {
 	assert(proc->rp_data != NULL);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_fd);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_fp);
+	rp_print_resource(proc->rp_data, &res_fd);
+	rp_print_resource(proc->rp_data, &res_fp);
 }
 
 struct plg_api *init(void)
@@ -358,6 +413,7 @@ struct plg_api *init(void)
 		.function_exit = file_function_exit,
 		.get_symbols = get_symbols,
 		.report_init = file_report_init,
+		.get_syscalls = get_syscalls,
 	};
 	return &ma;
 }
@@ -0,0 +1,567 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Recording agent preloaded into the programs started with --agent option,
+ * or loaded into the attached processes by functracer. See agent.h.
+ */
+
+#define AGENT_LIBRARY
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <link.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agent.h"
+
+/* frames of the agent itself in the backtrace */
+#define AGENT_FRAMES	2
+
+#if defined(__x86_64__)
+#define R_JUMP_SLOT	R_X86_64_JUMP_SLOT
+#define R_GLOB_DAT	R_X86_64_GLOB_DAT
+#elif defined(__i386__)
+#define R_JUMP_SLOT	R_386_JMP_SLOT
+#define R_GLOB_DAT	R_386_GLOB_DAT
+#elif defined(__arm__)
+#define R_JUMP_SLOT	R_ARM_JUMP_SLOT
+#define R_GLOB_DAT	R_ARM_GLOB_DAT
+#endif
+
+#if __ELF_NATIVE_CLASS == 64
+#define R_SYM(info)	ELF64_R_SYM(info)
+#define R_TYPE(info)	ELF64_R_TYPE(info)
+#else
+#define R_SYM(info)	ELF32_R_SYM(info)
+#define R_TYPE(info)	ELF32_R_TYPE(info)
+#endif
+
+static struct agent_ring *ring;
+
+/* set while a hooked function is running, so that the calls made by the
+ * allocator itself are not recorded */
+static __thread int in_hook __attribute__((tls_model("initial-exec")));
+
+static void *(*real_malloc)(size_t);
+static void (*real_free)(void *);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+static void *(*real_valloc)(size_t);
+static void *(*real_dlopen)(const char *, int);
+
+/* The preloaded agent calls the functions it interposes, the agent loaded
+ * into an attached process calls the functions its hooks replace. */
+static void *resolve_handle = RTLD_NEXT;
+
+/* dlsym() may allocate memory before the real allocator is known */
+static char bootstrap_heap[4096];
+static size_t bootstrap_used;
+static int resolving;
+
+static void *bootstrap_alloc(size_t size)
+{
+	void *ptr;
+
+	size = (size + 7) & ~7;
+	if (bootstrap_used + size > sizeof(bootstrap_heap))
+		return NULL;
+	ptr = bootstrap_heap + bootstrap_used;
+	bootstrap_used += size;
+
+	return ptr;
+}
+
+static int is_bootstrap(void *ptr)
+{
+	return (char *)ptr >= bootstrap_heap &&
+		(char *)ptr < bootstrap_heap + sizeof(bootstrap_heap);
+}
+
+static void agent_resolve(void)
+{
+	resolving = 1;
+	real_malloc = dlsym(resolve_handle, "malloc");
+	real_free = dlsym(resolve_handle, "free");
+	real_calloc = dlsym(resolve_handle, "calloc");
+	real_realloc = dlsym(resolve_handle, "realloc");
+	real_posix_memalign = dlsym(resolve_handle, "posix_memalign");
+	real_memalign = dlsym(resolve_handle, "memalign");
+	real_valloc = dlsym(resolve_handle, "valloc");
+	real_dlopen = dlsym(resolve_handle, "dlopen");
+	resolving = 0;
+}
+
+static int ring_open(const char *path)
+{
+	struct agent_ring *r;
+	void *frames[1];
+	int fd;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0)
+		return -1;
+	r = mmap(NULL, AGENT_RING_LENGTH(AGENT_RING_SIZE),
+		 PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (r == MAP_FAILED)
+		return -1;
+	if (r->magic != AGENT_MAGIC || r->version != AGENT_VERSION ||
+	    r->size != AGENT_RING_SIZE) {
+		munmap(r, AGENT_RING_LENGTH(AGENT_RING_SIZE));
+		return -1;
+	}
+	/* the first backtrace() call loads the unwinder, which allocates */
+	in_hook = 1;
+	backtrace(frames, 1);
+	in_hook = 0;
+	ring = r;
+
+	return 0;
+}
+
+static void __attribute__((constructor)) agent_init(void)
+{
+	const char *path = getenv(AGENT_RING_ENV);
+
+	/* the agent loaded by functracer is set up by ftagent_attach() */
+	if (path == NULL)
+		return;
+	if (real_malloc == NULL)
+		agent_resolve();
+	ring_open(path);
+}
+
+/* Reserves and claims the record of the call. The record is reserved
+ * before calling the functions releasing memory, so that the release is
+ * ordered before the allocations returning the same memory in the other
+ * threads. */
+static struct agent_record * __attribute__((noinline)) agent_begin(
+	int function, unsigned long arg0, unsigned long arg1,
+	unsigned long arg2)
+{
+	void *frames[AGENT_MAX_FRAMES + AGENT_FRAMES];
+	struct agent_record *rec;
+	struct timespec now;
+	unsigned long head, seq;
+	int i, n = 0;
+
+	if (ring == NULL || !(ring->functions & (1UL << function)))
+		return NULL;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ring->depth)
+		n = backtrace(frames, ring->depth + AGENT_FRAMES);
+
+	do {
+		head = ring->head;
+		if (head - ring->tail >= ring->size) {
+			__sync_fetch_and_add(&ring->lost, 1);
+			return NULL;
+		}
+	} while (!__sync_bool_compare_and_swap(&ring->head, head, head + 1));
+
+	rec = &ring->records[head % ring->size];
+	/* The slot must still hold the previous record, the reader may have
+	 * given up this one already. */
+	seq = rec->seq;
+	if ((head < ring->size ? seq != 0 :
+	     (seq & ~AGENT_SEQ_SKIPPED) != head + 1 - ring->size) ||
+	    !__sync_bool_compare_and_swap(&rec->seq, seq,
+					  (head + 1) | AGENT_SEQ_BUSY))
+		return NULL;
+	rec->function = function;
+	rec->tid = syscall(SYS_gettid);
+	rec->time = now;
+	rec->args[0] = arg0;
+	rec->args[1] = arg1;
+	rec->args[2] = arg2;
+	rec->retval = 0;
+	rec->result = 0;
+	rec->nframes = n > AGENT_FRAMES ? n - AGENT_FRAMES : 0;
+	for (i = 0; i < (int)rec->nframes; i++)
+		rec->frames[i] = (unsigned long)frames[i + AGENT_FRAMES];
+
+	return rec;
+}
+
+/* Completes the record unless the reader has given it up. */
+static void agent_end(struct agent_record *rec, unsigned long retval,
+		      unsigned long result)
+{
+	unsigned long seq;
+
+	if (rec == NULL)
+		return;
+	rec->retval = retval;
+	rec->result = result;
+	seq = rec->seq;
+	if (!(seq & AGENT_SEQ_BUSY))
+		return;
+	__sync_synchronize();
+	__sync_bool_compare_and_swap(&rec->seq, seq, seq & ~AGENT_SEQ_BUSY);
+}
+
+/* inlined, so that the backtrace has AGENT_FRAMES frames of the agent */
+static inline __attribute__((always_inline)) void agent_record(int function,
+	unsigned long arg0, unsigned long arg1, unsigned long arg2,
+	unsigned long retval, unsigned long result)
+{
+	agent_end(agent_begin(function, arg0, arg1, arg2), retval, result);
+}
+
+static void *hook_malloc(size_t size)
+{
+	void *ptr;
+
+	if (real_malloc == NULL) {
+		if (resolving)
+			return bootstrap_alloc(size);
+		agent_resolve();
+	}
+	if (in_hook)
+		return real_malloc(size);
+	in_hook = 1;
+	ptr = real_malloc(size);
+	agent_record(AGENT_MALLOC, size, 0, 0, (unsigned long)ptr, 0);
+	in_hook = 0;
+
+	return ptr;
+}
+
+static void hook_free(void *ptr)
+{
+	if (is_bootstrap(ptr))
+		return;
+	if (real_free == NULL)
+		agent_resolve();
+	if (in_hook) {
+		real_free(ptr);
+		return;
+	}
+	in_hook = 1;
+	agent_record(AGENT_FREE, (unsigned long)ptr, 0, 0, 0, 0);
+	real_free(ptr);
+	in_hook = 0;
+}
+
+static void *hook_calloc(size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if (real_calloc == NULL) {
+		/* the bootstrap heap is zero filled */
+		if (resolving)
+			return bootstrap_alloc(nmemb * size);
+		agent_resolve();
+	}
+	if (in_hook)
+		return real_calloc(nmemb, size);
+	in_hook = 1;
+	ptr = real_calloc(nmemb, size);
+	agent_record(AGENT_CALLOC, nmemb, size, 0, (unsigned long)ptr, 0);
+	in_hook = 0;
+
+	return ptr;
+}
+
+static void *hook_realloc(void *old, size_t size)
+{
+	struct agent_record *rec;
+	void *ptr;
+
+	if (real_realloc == NULL)
+		agent_resolve();
+	if (is_bootstrap(old)) {
+		ptr = hook_malloc(size);
+		if (ptr) {
+			size_t left = bootstrap_heap + sizeof(bootstrap_heap) -
+				(char *)old;
+			memcpy(ptr, old, size < left ? size : left);
+		}
+		return ptr;
+	}
+	if (in_hook)
+		return real_realloc(old, size);
+	in_hook = 1;
+	rec = agent_begin(AGENT_REALLOC, (unsigned long)old, size, 0);
+	ptr = real_realloc(old, size);
+	agent_end(rec, (unsigned long)ptr, 0);
+	in_hook = 0;
+
+	return ptr;
+}
+
+static int hook_posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	int ret;
+
+	if (real_posix_memalign == NULL)
+		agent_resolve();
+	if (in_hook)
+		return real_posix_memalign(memptr, alignment, size);
+	in_hook = 1;
+	ret = real_posix_memalign(memptr, alignment, size);
+	agent_record(AGENT_POSIX_MEMALIGN, (unsigned long)memptr, alignment,
+		     size, ret, ret ? 0 : (unsigned long)*memptr);
+	in_hook = 0;
+
+	return ret;
+}
+
+static void *hook_memalign(size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if (real_memalign == NULL)
+		agent_resolve();
+	if (in_hook)
+		return real_memalign(alignment, size);
+	in_hook = 1;
+	ptr = real_memalign(alignment, size);
+	agent_record(AGENT_MEMALIGN, alignment, size, 0, (unsigned long)ptr, 0);
+	in_hook = 0;
+
+	return ptr;
+}
+
+static void *hook_valloc(size_t size)
+{
+	void *ptr;
+
+	if (real_valloc == NULL)
+		agent_resolve();
+	if (in_hook)
+		return real_valloc(size);
+	in_hook = 1;
+	ptr = real_valloc(size);
+	agent_record(AGENT_VALLOC, size, 0, 0, (unsigned long)ptr, 0);
+	in_hook = 0;
+
+	return ptr;
+}
+
+/* The hooks are exported for interposing the functions, and called
+ * directly through the GOT entries in the attached processes. */
+void *malloc(size_t) __attribute__((alias("hook_malloc")));
+void free(void *) __attribute__((alias("hook_free")));
+void *calloc(size_t, size_t) __attribute__((alias("hook_calloc")));
+void *realloc(void *, size_t) __attribute__((alias("hook_realloc")));
+int posix_memalign(void **, size_t, size_t)
+	__attribute__((alias("hook_posix_memalign")));
+void *memalign(size_t, size_t) __attribute__((alias("hook_memalign")));
+void *valloc(size_t) __attribute__((alias("hook_valloc")));
+
+static void hook_objects(void);
+
+/* The libraries loaded later get their hooks too. */
+static void *agent_dlopen(const char *file, int mode)
+{
+	void *handle = real_dlopen(file, mode);
+
+	if (handle)
+		hook_objects();
+	return handle;
+}
+
+static const struct {
+	const char *name;
+	void *hook;
+} hooks[] = {
+	{ "malloc", hook_malloc },
+	{ "free", hook_free },
+	{ "calloc", hook_calloc },
+	{ "realloc", hook_realloc },
+	{ "posix_memalign", hook_posix_memalign },
+	{ "memalign", hook_memalign },
+	{ "valloc", hook_valloc },
+	{ "dlopen", agent_dlopen },
+};
+
+static void *hook_find(const char *name)
+{
+	unsigned int i;
+
+	/* without dlopen() in the process there's nothing to hook */
+	if (real_dlopen == NULL && strcmp(name, "dlopen") == 0)
+		return NULL;
+	for (i = 0; i < sizeof(hooks) / sizeof(hooks[0]); i++) {
+		if (strcmp(hooks[i].name, name) == 0)
+			return hooks[i].hook;
+	}
+	return NULL;
+}
+
+struct hook_object {
+	ElfW(Addr) base;
+	const ElfW(Sym) *symtab;
+	const char *strtab;
+	/* read-only after relocation */
+	ElfW(Addr) relro, relro_end;
+};
+
+/* Points the GOT entries of the hooked functions to the hooks. The table
+ * is either REL or RELA, both starting with r_offset and r_info. */
+static void hook_relocs(struct hook_object *obj, ElfW(Addr) table,
+			size_t size, size_t entsize)
+{
+	const ElfW(Rel) *rel;
+	ElfW(Addr) slot, page;
+	long page_size = sysconf(_SC_PAGESIZE);
+	void *hook;
+	size_t i;
+
+	for (i = 0; i + entsize <= size; i += entsize) {
+		rel = (const ElfW(Rel) *)(table + i);
+		if (R_TYPE(rel->r_info) != R_JUMP_SLOT &&
+		    R_TYPE(rel->r_info) != R_GLOB_DAT)
+			continue;
+		hook = hook_find(obj->strtab +
+				 obj->symtab[R_SYM(rel->r_info)].st_name);
+		slot = obj->base + rel->r_offset;
+		if (hook == NULL || *(void **)slot == hook)
+			continue;
+		if (slot >= obj->relro && slot < obj->relro_end) {
+			page = slot & ~(ElfW(Addr))(page_size - 1);
+			if (mprotect((void *)page, page_size,
+				     PROT_READ | PROT_WRITE) < 0)
+				continue;
+			*(void **)slot = hook;
+			mprotect((void *)page, page_size, PROT_READ);
+		} else {
+			*(void **)slot = hook;
+		}
+	}
+}
+
+static int hook_object(struct dl_phdr_info *info, size_t size, void *self)
+{
+	struct hook_object obj;
+	const ElfW(Dyn) *dyn = NULL, *d;
+	ElfW(Addr) jmprel = 0, rel = 0, rela = 0, ptr;
+	size_t pltrelsz = 0, relsz = 0, relasz = 0;
+	int i, pltrel = DT_REL;
+
+	(void)size;
+	/* the agent calls the real functions */
+	if (strcmp(info->dlpi_name, self) == 0)
+		return 0;
+	memset(&obj, 0, sizeof(obj));
+	obj.base = info->dlpi_addr;
+	for (i = 0; i < info->dlpi_phnum; i++) {
+		const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+
+		if (phdr->p_type == PT_DYNAMIC)
+			dyn = (const ElfW(Dyn) *)(obj.base + phdr->p_vaddr);
+		if (phdr->p_type == PT_GNU_RELRO) {
+			obj.relro = obj.base + phdr->p_vaddr;
+			obj.relro_end = obj.relro + phdr->p_memsz;
+		}
+	}
+	if (dyn == NULL)
+		return 0;
+	for (d = dyn; d->d_tag != DT_NULL; d++) {
+		/* the dynamic linker relocates the pointers of the
+		 * writable dynamic sections only */
+		ptr = d->d_un.d_ptr;
+		if (ptr < obj.base)
+			ptr += obj.base;
+		switch (d->d_tag) {
+		case DT_SYMTAB:
+			obj.symtab = (const ElfW(Sym) *)ptr;
+			break;
+		case DT_STRTAB:
+			obj.strtab = (const char *)ptr;
+			break;
+		case DT_JMPREL:
+			jmprel = ptr;
+			break;
+		case DT_PLTRELSZ:
+			pltrelsz = d->d_un.d_val;
+			break;
+		case DT_PLTREL:
+			pltrel = d->d_un.d_val;
+			break;
+		case DT_REL:
+			rel = ptr;
+			break;
+		case DT_RELSZ:
+			relsz = d->d_un.d_val;
+			break;
+		case DT_RELA:
+			rela = ptr;
+			break;
+		case DT_RELASZ:
+			relasz = d->d_un.d_val;
+			break;
+		}
+	}
+	if (obj.symtab == NULL || obj.strtab == NULL)
+		return 0;
+	if (jmprel)
+		hook_relocs(&obj, jmprel, pltrelsz, pltrel == DT_RELA ?
+			    sizeof(ElfW(Rela)) : sizeof(ElfW(Rel)));
+	if (rel)
+		hook_relocs(&obj, rel, relsz, sizeof(ElfW(Rel)));
+	if (rela)
+		hook_relocs(&obj, rela, relasz, sizeof(ElfW(Rela)));
+
+	return 0;
+}
+
+static void hook_objects(void)
+{
+	Dl_info self;
+
+	if (dladdr(hook_objects, &self) == 0)
+		return;
+	dl_iterate_phdr(hook_object, (void *)self.dli_fname);
+}
+
+/*
+ * Sets up the agent loaded into an attached process. The loaded agent
+ * doesn't interpose the functions, so the GOT entries of the functions in
+ * the loaded objects are pointed to the hooks instead.
+ *
+ * Called by functracer in the stopped process, see agent_inject().
+ */
+int ftagent_attach(const char *path)
+{
+	resolve_handle = RTLD_DEFAULT;
+	agent_resolve();
+	if (real_malloc == NULL || ring_open(path) < 0)
+		return -1;
+	hook_objects();
+
+	return 0;
+}
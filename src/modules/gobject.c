@@ -71,7 +71,7 @@ static void gobject_function_exit(struct process *proc, const char *name)
 				.res_size = RES_SIZE,
 				.res_id = (pointer_t)retval,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		rp_write_backtraces(proc, &call);
 
 	} else if (strcmp(name, "g_object_ref") == 0) {
@@ -87,7 +87,7 @@ static void gobject_function_exit(struct process *proc, const char *name)
 				.res_size = RES_SIZE,
 				.res_id = (pointer_t)fn_argument(proc, 0),
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		rp_write_backtraces(proc, &call);
 
 	} else if (strcmp(name, "g_object_unref") == 0) {
@@ -100,7 +100,7 @@ static void gobject_function_exit(struct process *proc, const char *name)
 				.res_size = 0,
 				.res_id = (pointer_t)fn_argument(proc, 0),
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		rp_write_backtraces(proc, &call);
 	} else {
 		msg_warn("unexpected function exit (%s)\n", name);
@@ -124,7 +124,7 @@ static int get_symbols(struct plg_symbol **syms)
 static void gobject_report_init(struct process *proc)
 {
 	assert(proc->rp_data != NULL);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_gobject);
+	rp_print_resource(proc->rp_data, &res_gobject);
 }
 
 struct plg_api *init(void)
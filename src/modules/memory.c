@@ -64,7 +64,7 @@ static void write_function(struct process *proc, const char *name, unsigned int
 		.res_size = size,
 		.res_id = id
 	};
-	sp_rtrace_print_call(rd->fp, &call);
+	rp_print_call(rd, &call);
 	rp_write_backtraces(proc, &call);
 	(rd->rp_number)++;
 }
@@ -158,7 +158,7 @@ static int get_symbols(struct plg_symbol **syms)
 static void mem_report_init(struct process *proc)
 {
 	assert(proc->rp_data != NULL);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_memory);
+	rp_print_resource(proc->rp_data, &res_memory);
 }
 
 struct plg_api *init(void)
@@ -33,6 +33,7 @@
 #include <search.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sp_rtrace_formatter.h>
 #include <sp_rtrace_defs.h>
 
@@ -46,7 +47,10 @@
 #include "context.h"
 #include "util.h"
 
-#define MODULE_API_VERSION "2.0"
+#define MODULE_API_VERSION "2.1"
+
+/* mmap2 system call offset unit */
+#define MMAP2_UNIT 4096
 
 static char module_api_version[] = MODULE_API_VERSION;
 
@@ -524,7 +528,7 @@ static void module_function_exit(struct process *proc, const char *name)
 				.res_size = (size_t)1,
 				.index = rd->rp_number++,
 			};
-			sp_rtrace_print_call(rd->fp, &call);
+			rp_print_call(rd, &call);
 
 
 			sp_rtrace_farg_t args[] = {
@@ -533,7 +537,7 @@ static void module_function_exit(struct process *proc, const char *name)
 				{.name="mode", .value=arg_mode},
 				{.name = NULL}
 			};
-			sp_rtrace_print_args(rd->fp, args);
+			rp_print_args(rd, args);
 			rp_write_backtraces(proc, &call);
 
 		}
@@ -548,7 +552,7 @@ static void module_function_exit(struct process *proc, const char *name)
 			.res_size = (size_t)1,
 			.index = rd->rp_number,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 
 		sp_rtrace_farg_t args[] = {
 			{.name="name", .value=arg_name},
@@ -556,7 +560,7 @@ static void module_function_exit(struct process *proc, const char *name)
 			{.name="mode", .value=arg_mode},
 			{.name = NULL}
 		};
-		sp_rtrace_print_args(rd->fp, args);
+		rp_print_args(rd, args);
 		rp_write_backtraces(proc, &call);
 	}
 	else if (strcmp(name, "shm_unlink") == 0) {
@@ -574,13 +578,13 @@ static void module_function_exit(struct process *proc, const char *name)
 			.res_size = (size_t)0,
 			.index = rd->rp_number,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		
 		sp_rtrace_farg_t args[] = {
 			{.name="name", .value=arg_name},
 			{.name = NULL}
 		};
-		sp_rtrace_print_args(rd->fp, args);
+		rp_print_args(rd, args);
 		rp_write_backtraces(proc, &call);
 	}
 	else if (strcmp(name, "open") == 0) {
@@ -595,13 +599,21 @@ static void module_function_exit(struct process *proc, const char *name)
 		fdreg_store_fd(rc, arg_name, FD_FILE, fn_argument(proc, 1));
 		return;
 	}
+	else if (strcmp(name, "openat") == 0) {
+		/* reported only by system call tracing */
+		if (rc == (addr_t)-1) return;
+		char arg_name[PATH_MAX]; trace_mem_readstr(proc, fn_argument(proc, 1), arg_name, sizeof(arg_name));
+		fdreg_store_fd(rc, arg_name, FD_FILE, fn_argument(proc, 2));
+		return;
+	}
 	else if (strcmp(name, "creat") == 0) {
 		if (rc == (addr_t)-1) return;
 		char arg_name[PATH_MAX]; trace_mem_readstr(proc, fn_argument(proc, 0), arg_name, sizeof(arg_name));
 		fdreg_store_fd(rc, arg_name, FD_FILE, O_CREAT|O_WRONLY|O_TRUNC);
 		return;
 	}
-	/* handle mmap2 together with mmap as the offset is ignored by tracker */
+	/* handle mmap2 together with mmap as the offset is ignored by tracker,
+	 * the mmap2 system call is reported as mmap with the offset in bytes */
 	else if (strcmp(name, "mmap") == 0 || strcmp(name, "mmap2") == 0 || strcmp(name, "mmap64") == 0) {
 		if (rc == (addr_t)-1) return;
 		addr_t fd = fn_argument(proc, 4);
@@ -616,18 +628,23 @@ static void module_function_exit(struct process *proc, const char *name)
 			.timestamp = RP_TIMESTAMP,
 			.res_type = (void*)(pfd ? (pfd->type == FD_POSIX ? res_pshmmap.type : res_fshmmap.type) : res_shmmap.type),
 			.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME,
-			.name = (char *)name, /* not modified by libsp-rtrace */
+			.name = strcmp(name, "mmap2") == 0 ? "mmap" : (char *)name, /* not modified by libsp-rtrace */
 			.res_id = (pointer_t)rc,
 			.res_size = (size_t)fn_argument(proc, 1),
 			.index = rd->rp_number,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
+
+		/* mmap2 takes the offset in 4096 byte units */
+		unsigned long long offset = fn_argument(proc, 5);
+		if (strcmp(name, "mmap2") == 0)
+			offset *= MMAP2_UNIT;
 		
 		char arg_length[16]; snprintf(arg_length, sizeof(arg_length), "0x%lx", fn_argument(proc, 1));
 		char arg_prot[16]; snprintf(arg_prot, sizeof(arg_prot), "0x%lx", fn_argument(proc, 2));
 		char arg_flags[16]; snprintf(arg_flags, sizeof(arg_flags), "0x%x", flags);
 		char arg_fd[16]; snprintf(arg_fd, sizeof(arg_fd), "%d", fd);
-		char arg_offset[16]; snprintf(arg_offset, sizeof(arg_offset), "0x%lx", fn_argument(proc, 5));
+		char arg_offset[24]; snprintf(arg_offset, sizeof(arg_offset), "0x%llx", offset);
 		char arg_mode[16];
 		sp_rtrace_farg_t args[] = {
 			{.name="length", .value=arg_length},
@@ -651,7 +668,7 @@ static void module_function_exit(struct process *proc, const char *name)
 			args[6].value = arg_mode;
 			snprintf(arg_mode, sizeof(arg_mode), "0x%x", pfd->mode);
 		}
-		sp_rtrace_print_args(rd->fp, args);
+		rp_print_args(rd, args);
 		rp_write_backtraces(proc, &call);
 	}
 	else if (strcmp(name, "munmap") == 0) {
@@ -673,14 +690,14 @@ static void module_function_exit(struct process *proc, const char *name)
 			.res_size = (size_t)0,
 			.index = rd->rp_number,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		
 		char arg_length[16]; snprintf(arg_length, sizeof(arg_length), "%ld", fn_argument(proc, 1));
 		sp_rtrace_farg_t args[] = {
 			{.name="length", .value=arg_length},
 			{.name = NULL}
 		};
-		sp_rtrace_print_args(rd->fp, args);
+		rp_print_args(rd, args);
 		rp_write_backtraces(proc, &call);
 	}
 	else if (strcmp(name, "close") == 0) {
@@ -699,7 +716,7 @@ static void module_function_exit(struct process *proc, const char *name)
 					.res_size = (size_t)0,
 					.index = rd->rp_number,
 				};
-				sp_rtrace_print_call(rd->fp, &call);
+				rp_print_call(rd, &call);
 				rp_write_backtraces(proc, &call);
 			}
 			//fdreg_remove(fd);
@@ -731,14 +748,31 @@ static int get_symbols(struct plg_symbol **syms)
 	return ARRAY_SIZE(symbols);
 }
 
+/* Descriptor and mapping functions are tracked also at system call level.
+ * shm_open() and shm_unlink() are still traced with breakpoints. */
+static struct plg_syscall syscalls[] = {
+		{.sysno = SYS_open, .name = "open"},
+		{.sysno = SYS_openat, .name = "openat"},
+		{.sysno = SYS_creat, .name = "creat"},
+		{.sysno = SYS_mmap2, .name = "mmap2"},
+		{.sysno = SYS_munmap, .name = "munmap"},
+		{.sysno = SYS_close, .name = "close"},
+};
+
+static int get_syscalls(struct plg_syscall **sysc)
+{
+	*sysc = syscalls;
+	return ARRAY_SIZE(syscalls);
+}
+
 static void module_report_init(struct process *proc)
 {
 	assert(proc->rp_data != NULL);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_pshmmap);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_fshmmap);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_shmmap);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_shmobj);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_shmfd);
+	rp_print_resource(proc->rp_data, &res_pshmmap);
+	rp_print_resource(proc->rp_data, &res_fshmmap);
+	rp_print_resource(proc->rp_data, &res_shmmap);
+	rp_print_resource(proc->rp_data, &res_shmobj);
+	rp_print_resource(proc->rp_data, &res_shmfd);
 }
 
 struct plg_api *init(void)
@@ -748,6 +782,7 @@ struct plg_api *init(void)
 		.function_exit = module_function_exit,
 		.get_symbols = get_symbols,
 		.report_init = module_report_init,
+		.get_syscalls = get_syscalls,
 	};
 	return &ma;
 }
@@ -49,12 +49,14 @@
 #include <unistd.h>
 #include <sched.h>
 #include <sys/shm.h>
+#include <sys/syscall.h>
 #include <errno.h>
 #include <search.h>
 #include <sp_rtrace_formatter.h>
 #include <sp_rtrace_defs.h>
 #include "util.h"
 
+#include "config.h"
 #include "debug.h"
 #include "function.h"
 #include "options.h"
@@ -64,7 +66,7 @@
 #include "context.h"
 #include "util.h"
 
-#define SHMSYSV_API_VERSION "2.0"
+#define SHMSYSV_API_VERSION "2.1"
 #define RES_SIZE 1
 
 static sp_rtrace_resource_t res_segment = {
@@ -150,7 +152,7 @@ static void function_exit(struct process *proc, const char *name)
 				.res_type = (void*)res_segment.type,
 				.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		rp_write_backtraces(proc, &call);
 	}
 	else if (strcmp(name, "shmctl") == 0) {
@@ -162,7 +164,8 @@ static void function_exit(struct process *proc, const char *name)
 		 * 3) if the following stat command for the segment fails with EIDRM (removed identifier) or EINVAL (invalid argument) error.
 		 */
 		int shmid = fn_argument(proc, 0);
-		int cmd = fn_argument(proc, 1);
+		/* the system call gets the command with IPC_64 flag */
+		int cmd = fn_argument(proc, 1) & ~IPC_64;
 		if (cmd != IPC_RMID || retval == (addr_t)-1) return;
 
 		/* report shmctl call with IPC_RMID command */
@@ -181,8 +184,8 @@ static void function_exit(struct process *proc, const char *name)
 				{.name = "cmd", .value = "IPC_RMID"},
 				{.name = NULL}
 		};
-		sp_rtrace_print_call(rd->fp, &call1);
-		sp_rtrace_print_args(rd->fp, args);
+		rp_print_call(rd, &call1);
+		rp_print_args(rd, args);
 		rp_write_backtraces(proc, &call1);
 
 		/* */
@@ -201,7 +204,7 @@ static void function_exit(struct process *proc, const char *name)
 				.res_type = (void*)res_segment.type,
 				.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME,
 		};
-		sp_rtrace_print_call(rd->fp, &call2);
+		rp_print_call(rd, &call2);
 		rp_write_backtraces(proc, &call2);
 	}
 	else if (strcmp(name, "shmat") == 0) {
@@ -243,14 +246,14 @@ static void function_exit(struct process *proc, const char *name)
 				.res_type = (void*)res_address.type,
 				.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 
 		sp_rtrace_farg_t args[] = {
 				{.name = "shmid", .value = shmid_s},
 				{.name = "cpid", .value = cpid_s},
 				{.name = NULL}
 		};
-		sp_rtrace_print_args(rd->fp, args);
+		rp_print_args(rd, args);
 	}
 	else if (strcmp(name, "shmdt") == 0) {
 		if (retval == (addr_t)-1) return;
@@ -269,7 +272,7 @@ static void function_exit(struct process *proc, const char *name)
 				.res_type = (void*)res_address.type,
 				.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		rp_write_backtraces(proc, &call);
 
 		/* if the address was attached by the target process (it's stored in the addr2shmid mapping) check if
@@ -292,7 +295,7 @@ static void function_exit(struct process *proc, const char *name)
 						.res_type = (void*)res_segment.type,
 						.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME,
 				};
-				sp_rtrace_print_call(rd->fp, &call);
+				rp_print_call(rd, &call);
 				rp_write_backtraces(proc, &call);
 			}
 			/* remove the address->segment mapping */
@@ -317,6 +320,23 @@ static int get_symbols(struct plg_symbol **syms)
 	return ARRAY_SIZE(symbols);
 }
 
+/* x86 multiplexes the shared memory calls through ipc() system call,
+ * so they can be tracked at system call level only on ARM. */
+static struct plg_syscall syscalls[] = {
+#ifdef ARCH_ARM
+		{.sysno = SYS_shmget, .name = "shmget"},
+		{.sysno = SYS_shmctl, .name = "shmctl"},
+		{.sysno = SYS_shmdt, .name = "shmdt"},
+		{.sysno = SYS_shmat, .name = "shmat"},
+#endif
+};
+
+static int get_syscalls(struct plg_syscall **sysc)
+{
+	*sysc = syscalls;
+	return ARRAY_SIZE(syscalls);
+}
+
 /**
  * Registers tracked resources.
  * @param proc
@@ -324,9 +344,9 @@ static int get_symbols(struct plg_symbol **syms)
 static void report_init(struct process *proc)
 {
 	assert(proc->rp_data != NULL);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_segment);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_address);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_control);
+	rp_print_resource(proc->rp_data, &res_segment);
+	rp_print_resource(proc->rp_data, &res_address);
+	rp_print_resource(proc->rp_data, &res_control);
 }
 
 /**
@@ -340,6 +360,7 @@ struct plg_api *init(void)
 		.function_exit = function_exit,
 		.get_symbols = get_symbols,
 		.report_init = report_init,
+		.get_syscalls = get_syscalls,
 	};
 	return &ma;
 }
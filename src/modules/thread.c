@@ -140,7 +140,7 @@ static void thread_function_exit(struct process *proc, const char *name)
 				.res_type = (void*)res_thread.type,
 				.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		rp_write_backtraces(proc, &call);
 
 	} else if (strcmp(name, "pthread_create") == 0) {
@@ -173,7 +173,7 @@ static void thread_function_exit(struct process *proc, const char *name)
 			call.res_type = (void*)res_thread_detached.type;
 		}
 
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		rp_write_backtraces(proc, &call);
 
 	} else if (strcmp(name, "pthread_detach") == 0) {
@@ -192,7 +192,7 @@ static void thread_function_exit(struct process *proc, const char *name)
 				.res_type = (void*)res_thread.type,
 				.res_type_flag = SP_RTRACE_FCALL_RFIELD_NAME,
 		};
-		sp_rtrace_print_call(rd->fp, &call);
+		rp_print_call(rd, &call);
 		rp_write_backtraces(proc, &call);
 
 	} else {
@@ -218,8 +218,8 @@ static int get_symbols(struct plg_symbol **syms)
 static void thread_report_init(struct process *proc)
 {
 	assert(proc->rp_data != NULL);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_thread);
-	sp_rtrace_print_resource(proc->rp_data->fp, &res_thread_detached);
+	rp_print_resource(proc->rp_data, &res_thread);
+	rp_print_resource(proc->rp_data, &res_thread_detached);
 }
 
 struct plg_api *init(void)
@@ -33,6 +33,7 @@
 #include "arch-defs.h"
 #include "config.h"
 #include "options.h"
+#include "output.h"
 #include "report.h"
 #include "backtrace.h"
 #include "filter.h"
@@ -78,6 +79,34 @@ static const struct argp_option options[] = {
 	{"output-dir",  'o', "DIR", 0,
 			"The output directory for storing trace data. If output directory is not "
 			"specified functracer dumps the data in standard output.", 0},
+	{"binary", 'B', NULL, 0,
+			"Write the trace in the binary format, which is faster to write and smaller "
+			"than rtrace text. The trace files are named PID-N.rtrace.bin(.gz) and can be "
+			"converted to rtrace text with functracer-bin2txt.", 0},
+	{"output-policy", 'W', "POLICY", 0,
+			"The trace output is written by a separate thread, so that the traced "
+			"threads don't wait for it. POLICY selects what is done when the output "
+			"buffer is full: 'block' waits for the writer (default), 'drop' drops the "
+			"output and counts it, 'spill' queues the output in memory. 'sync' writes "
+			"the output without the writer thread.", 0},
+	{"compress", 'Z', "LEVEL", OPTION_ARG_OPTIONAL,
+			"Compress the trace with gzip compression LEVEL 1-9 (default: 6). The trace "
+			"is compressed by the output writer thread in independent gzip blocks, so "
+			"a trace cut short can be decompressed with zcat up to its last block.", 0},
+	{"rotate-size", OPT_ROTATE_SIZE, "SIZE", 0,
+			"Split the trace into chunks of SIZE bytes (before compression), SIZE can have "
+			"k, M or G suffix. Every chunk starts with the trace header, the resource "
+			"declarations and the loaded libraries, so that it can be processed on its "
+			"own. The chunks are listed in PID-N.rtrace.idx file with their first event "
+			"index and start time. Needs output directory.", 0},
+	{"rotate-time", OPT_ROTATE_TIME, "SECONDS", 0,
+			"Start a new trace chunk every SECONDS seconds. Needs output directory.", 0},
+	{"collector", OPT_COLLECTOR, "PATH", 0,
+			"Send the trace records to a collector listening on UNIX socket or named "
+			"pipe PATH, instead of writing them to files. The records are framed and "
+			"numbered, so the collector can detect the records dropped. When the "
+			"collector doesn't keep up, backtraces are dropped first, other records "
+			"follow the output POLICY.", 0},
 	{"audit", 'a', "SYMBOLS", 0,
 			"Custom tracked symbol names list for audit module in format <symbol[;symbol...]>|@<filename>. "
 			"In file the symbol names are separated by newlines.", 0},
@@ -91,6 +120,37 @@ static const struct argp_option options[] = {
 			"Needed when the symbols come from dlopen()ed libraries.", 0},
 	{"quiet", 'q', NULL, 0,
 			"Hide internal event messages.", 0},
+	{"jobs", 'j', "NUMBER", 0,
+			"Number of tracer threads. Threads of the attached processes are distributed "
+			"between the tracer threads, so that their breakpoint hits can be handled in "
+			"parallel. Threads created later are traced by the tracer thread of their "
+			"creator.", 0},
+	{"syscalls", 'y', NULL, 0,
+			"Track resources at system call level when the plugin supports it. A seccomp "
+			"filter is installed into the started program, so that it stops only on the "
+			"system calls tracked by the plugin instead of hitting breakpoints in their "
+			"C-library wrappers. Can't be used with attached processes.", 0},
+	{"uprobes", 'U', NULL, 0,
+			"Trace the functions with kernel uprobes instead of breakpoints when the kernel "
+			"supports them. The traced processes are not stopped on the function calls, "
+			"the calls are reported from the registers and stack recorded by the kernel. "
+			"Can't be used with multiple tracer threads.", 0},
+	{"uprobes-system-wide", OPT_UPROBES_SYSTEM_WIDE, NULL, 0,
+			"Open each uprobe once for all the processes of the system instead of "
+			"separately for every traced process, dropping the calls of the untraced "
+			"processes. Needs CAP_PERFMON or perf_event_paranoid <= 0, otherwise "
+			"the probes are opened per process. Implies --uprobes.", 0},
+	{"agent", 'g', "LIBRARY", OPTION_ARG_OPTIONAL,
+			"Record the memory allocations in the traced program with a preloaded agent "
+			"library instead of breakpoints, so that the program is not stopped on them. "
+			"LIBRARY is the agent name or path/filename (default: ftagent). The agent is "
+			"loaded into the attached processes with dlopen() called in them, which "
+			"may deadlock if a process is stopped inside the dynamic linker.", 0},
+	{"symbol-cache", 'C', "DIR", 0,
+			"Directory of the library symbol index. The function symbols of a library are "
+			"read only when it is not yet indexed, which speeds up the following runs "
+			"(default: $XDG_CACHE_HOME/functracer or ~/.cache/functracer, 'none' disables "
+			"the index).", 0},
 	{"help", 'h', NULL, 0,
 			"Give this help list.", -1},
 	{"usage", OPT_USAGE, NULL, 0,
@@ -100,6 +160,28 @@ static const struct argp_option options[] = {
 	{NULL, 0, NULL, 0, NULL, 0},
 };
 
+/* Parses size with optional k, M or G suffix, returns 0 if invalid. */
+static unsigned long long parse_size(const char *arg)
+{
+	unsigned long long size;
+	char *end;
+
+	size = strtoull(arg, &end, 10);
+	switch (*end) {
+	case 'G':
+		size *= 1024;
+		/* fall through */
+	case 'M':
+		size *= 1024;
+		/* fall through */
+	case 'k':
+		size *= 1024;
+		end++;
+		break;
+	}
+	return *end ? 0 : size;
+}
+
 /* prototype for option handler */
 static error_t parse_opt(int key, char *arg, struct argp_state *state);
 
@@ -184,6 +266,36 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 			/* Not enough arguments. */
 			argp_usage(state);
 		}
+		/* The filter can't be removed, so the system calls would
+		 * fail after detaching from the attached processes. */
+		if (arg_data->syscalls && arg_data->npids) {
+			argp_error(state, "System call tracing can't be used with attached processes");
+			return EINVAL;
+		}
+		/* The chunks are only written to files. */
+		if ((arg_data->rotate_size || arg_data->rotate_time) &&
+		    !arg_data->save_to_file) {
+			argp_error(state, "Trace rotation needs an output directory");
+			return EINVAL;
+		}
+		/* The collector gets the trace records framed. */
+		if (arg_data->collector && arg_data->save_to_file) {
+			argp_error(state, "The collector can't be used with an output directory");
+			return EINVAL;
+		}
+		if (arg_data->collector && arg_data->compress) {
+			argp_error(state, "The collector output can't be compressed");
+			return EINVAL;
+		}
+		if (arg_data->collector && arg_data->output_policy == OUTPUT_SYNC) {
+			argp_error(state, "The collector output needs the writer thread");
+			return EINVAL;
+		}
+		/* The probe samples are read by a single event loop. */
+		if (arg_data->uprobes && arg_data->jobs > 1) {
+			argp_error(state, "Uprobes can't be used with multiple tracer threads");
+			return EINVAL;
+		}
 		break;
 	case ARGP_KEY_ARGS:
 		if (arg_data->npids) {
@@ -201,6 +313,63 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 	case 'S':
 		arg_data->skip_symbol_check = true;
 		break;
+	case 'y':
+		arg_data->syscalls = true;
+		break;
+	case 'U':
+		arg_data->uprobes = true;
+		break;
+	case OPT_UPROBES_SYSTEM_WIDE:
+		arg_data->uprobes = true;
+		arg_data->uprobes_system_wide = true;
+		break;
+	case 'g':
+		arg_data->agent = arg ? arg : "ftagent";
+		break;
+	case 'C':
+		arg_data->symbol_cache = arg;
+		break;
+	case 'B':
+		arg_data->binary = true;
+		break;
+	case 'Z':
+		arg_data->compress = arg ? atoi(arg) : 6;
+		if (arg_data->compress < 1 || arg_data->compress > 9) {
+			argp_error(state, "Compression level must be between 1 and 9");
+			return EINVAL;
+		}
+		break;
+	case OPT_ROTATE_SIZE:
+		arg_data->rotate_size = parse_size(arg);
+		if (arg_data->rotate_size == 0) {
+			argp_error(state, "Invalid trace chunk size %s", arg);
+			return EINVAL;
+		}
+		break;
+	case OPT_ROTATE_TIME:
+		arg_data->rotate_time = atoi(arg);
+		if (arg_data->rotate_time <= 0) {
+			argp_error(state, "Invalid trace chunk interval %s", arg);
+			return EINVAL;
+		}
+		break;
+	case OPT_COLLECTOR:
+		arg_data->collector = arg;
+		break;
+	case 'W':
+		arg_data->output_policy = output_policy(arg);
+		if (arg_data->output_policy < 0) {
+			argp_error(state, "Unknown output policy %s", arg);
+			return EINVAL;
+		}
+		break;
+	case 'j':
+		arg_data->jobs = atoi(arg);
+		if (arg_data->jobs < 1 || arg_data->jobs > MAX_JOBS) {
+			argp_error(state, "Number of tracer threads must be between 1 and %d", MAX_JOBS);
+			return EINVAL;
+		}
+		break;
 
 	default:
 		return ARGP_ERR_UNKNOWN;
@@ -219,6 +388,8 @@ int process_options(int argc, char *argv[], int *remaining)
 	arguments.plugin = PLUGIN_DEFAULT;
 	arguments.time = -1;
 	arguments.verbose = 1;
+	arguments.jobs = 1;
+	arguments.output_policy = OUTPUT_BLOCK;
 
 	/* parse and process arguments */
 	ret = argp_parse(&argp, argc, argv,
@@ -0,0 +1,602 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libiberty.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "collector.h"
+#include "debug.h"
+#include "options.h"
+#include "output.h"
+
+/* stdio buffer of the text output */
+#define OUTPUT_STREAM_BUFFER	(64 * 1024)
+
+/* size of the compressed blocks, and the time in seconds an incomplete
+ * block is kept when there is no more output */
+#define OUTPUT_BLOCK_SIZE	(1024 * 1024)
+#define OUTPUT_BLOCK_TIMEOUT	1
+
+/* record queued outside of the ring with OUTPUT_SPILL policy */
+struct spill {
+	struct spill *next;
+	size_t len;
+	unsigned char data[];
+};
+
+struct output {
+	int fd;
+	int close_fd;
+	enum output_policy policy;
+	pthread_t thread;
+	/* Ring buffer written by the tracer thread and read by the writer
+	 * thread. head and tail are only increased, by the tracer and the
+	 * writer thread respectively. */
+	unsigned char *ring;
+	volatile unsigned long head;
+	volatile unsigned long tail;
+	/* records waiting for room in the ring, written after the ring */
+	struct spill *volatile spill;
+	struct spill *volatile *spill_tail;
+	/* wakeups of the sleeping thread */
+	pthread_mutex_t lock;
+	pthread_cond_t data_cond;
+	pthread_cond_t room_cond;
+	volatile int writer_waiting;
+	volatile int tracer_waiting;
+	int closing;
+	int error;
+	/* bytes queued by the tracer thread */
+	unsigned long long size;
+	/* dropped and spilled records */
+	unsigned long dropped;
+	unsigned long spilled;
+	/* block collected for compression */
+	int compress;
+	z_stream zs;
+	unsigned char *block;
+	size_t nblock;
+	unsigned char *zbuf;
+	size_t zbuf_size;
+	/* incomplete line of the text output */
+	char *line;
+	size_t nline;
+	size_t line_size;
+	/* frame of the collector output the records are written in */
+	int framed;
+	unsigned int sequence;
+	pid_t frame_trace;
+	int frame_type;
+	int frame_format;
+	unsigned long dropped_backtraces;
+};
+
+int output_policy(const char *name)
+{
+	static const char *const names[] = {
+		[OUTPUT_BLOCK] = "block",
+		[OUTPUT_DROP] = "drop",
+		[OUTPUT_SPILL] = "spill",
+		[OUTPUT_SYNC] = "sync",
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strcmp(name, names[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/* Called on the writer thread, or on the tracer thread with OUTPUT_SYNC
+ * policy. After a failed write the rest of the output is discarded. */
+static void write_out(struct output *out, const unsigned char *data, size_t len)
+{
+	struct pollfd pfd = { .fd = out->fd, .events = POLLOUT };
+	ssize_t ret;
+
+	while (len > 0 && !out->error) {
+		ret = write(out->fd, data, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			/* the collector socket is non-blocking */
+			if (errno == EAGAIN) {
+				poll(&pfd, 1, -1);
+				continue;
+			}
+			msg_warn("write trace output");
+			out->error = 1;
+			break;
+		}
+		data += ret;
+		len -= ret;
+	}
+}
+
+/* Compresses the collected block into a gzip member of its own, so that
+ * a trace cut short can be decompressed up to its last complete block. */
+static void write_block(struct output *out)
+{
+	if (out->nblock == 0)
+		return;
+	deflateReset(&out->zs);
+	out->zs.next_in = out->block;
+	out->zs.avail_in = out->nblock;
+	out->zs.next_out = out->zbuf;
+	out->zs.avail_out = out->zbuf_size;
+	if (deflate(&out->zs, Z_FINISH) == Z_STREAM_END)
+		write_out(out, out->zbuf, out->zbuf_size - out->zs.avail_out);
+	else if (!out->error) {
+		msg_warn("trace compression failed: %s", out->zs.msg ? : "");
+		out->error = 1;
+	}
+	out->nblock = 0;
+}
+
+static void put_data(struct output *out, const unsigned char *data, size_t len)
+{
+	size_t n;
+
+	if (!out->compress) {
+		write_out(out, data, len);
+		return;
+	}
+	while (len > 0) {
+		n = OUTPUT_BLOCK_SIZE - out->nblock;
+		if (n > len)
+			n = len;
+		memcpy(out->block + out->nblock, data, n);
+		out->nblock += n;
+		data += n;
+		len -= n;
+		if (out->nblock == OUTPUT_BLOCK_SIZE)
+			write_block(out);
+	}
+}
+
+static void wake(struct output *out, volatile int *waiting, pthread_cond_t *cond)
+{
+	__sync_synchronize();
+	if (*waiting) {
+		pthread_mutex_lock(&out->lock);
+		pthread_cond_signal(cond);
+		pthread_mutex_unlock(&out->lock);
+	}
+}
+
+static void *output_thread(void *data)
+{
+	struct output *out = data;
+	unsigned long head, tail;
+	struct spill *spill, *next;
+	struct timespec timeout;
+	size_t len, pos;
+	int idle;
+
+	for (;;) {
+		head = out->head;
+		tail = out->tail;
+		__sync_synchronize();
+		if (head != tail) {
+			pos = tail % OUTPUT_RING_SIZE;
+			len = head - tail;
+			if (len > OUTPUT_RING_SIZE - pos)
+				len = OUTPUT_RING_SIZE - pos;
+			put_data(out, out->ring + pos, len);
+			__sync_synchronize();
+			out->tail = tail + len;
+			wake(out, &out->tracer_waiting, &out->room_cond);
+			continue;
+		}
+
+		/* The spilled records are newer than the ones in the ring,
+		 * and the tracer thread doesn't use the ring while there are
+		 * spilled records. */
+		pthread_mutex_lock(&out->lock);
+		spill = out->spill;
+		if (spill != NULL) {
+			out->spill = NULL;
+			out->spill_tail = &out->spill;
+			pthread_mutex_unlock(&out->lock);
+			for (; spill != NULL; spill = next) {
+				next = spill->next;
+				put_data(out, spill->data, spill->len);
+				free(spill);
+			}
+			continue;
+		}
+		out->writer_waiting = 1;
+		__sync_synchronize();
+		idle = 0;
+		if (out->head == out->tail) {
+			if (out->closing) {
+				pthread_mutex_unlock(&out->lock);
+				break;
+			}
+			if (out->nblock) {
+				/* write out the incomplete block if there is
+				 * no more output for a while */
+				clock_gettime(CLOCK_REALTIME, &timeout);
+				timeout.tv_sec += OUTPUT_BLOCK_TIMEOUT;
+				idle = pthread_cond_timedwait(&out->data_cond, &out->lock,
+							      &timeout) == ETIMEDOUT;
+			} else
+				pthread_cond_wait(&out->data_cond, &out->lock);
+		}
+		out->writer_waiting = 0;
+		pthread_mutex_unlock(&out->lock);
+		if (idle)
+			write_block(out);
+	}
+
+	return NULL;
+}
+
+struct output *output_open(int fd, int close_fd)
+{
+	struct output *out;
+
+	out = xcalloc(1, sizeof(struct output));
+	out->fd = fd;
+	out->close_fd = close_fd;
+	out->policy = arguments.output_policy;
+	out->spill_tail = &out->spill;
+	if (arguments.compress) {
+		if (deflateInit2(&out->zs, arguments.compress, Z_DEFLATED,
+				 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+			out->compress = 1;
+			out->block = xmalloc(OUTPUT_BLOCK_SIZE);
+			out->zbuf_size = deflateBound(&out->zs, OUTPUT_BLOCK_SIZE);
+			out->zbuf = xmalloc(out->zbuf_size);
+		} else
+			msg_warn("trace compression failed, writing uncompressed output");
+	}
+	if (out->policy == OUTPUT_SYNC)
+		return out;
+
+	out->ring = xmalloc(OUTPUT_RING_SIZE);
+	pthread_mutex_init(&out->lock, NULL);
+	pthread_cond_init(&out->data_cond, NULL);
+	pthread_cond_init(&out->room_cond, NULL);
+	if (pthread_create(&out->thread, NULL, output_thread, out) != 0) {
+		msg_warn("pthread_create");
+		free(out->ring);
+		out->ring = NULL;
+		out->policy = OUTPUT_SYNC;
+	}
+
+	return out;
+}
+
+void output_close(struct output *out)
+{
+	if (out->policy != OUTPUT_SYNC) {
+		pthread_mutex_lock(&out->lock);
+		out->closing = 1;
+		pthread_cond_signal(&out->data_cond);
+		pthread_mutex_unlock(&out->lock);
+		pthread_join(out->thread, NULL);
+		pthread_mutex_destroy(&out->lock);
+		pthread_cond_destroy(&out->data_cond);
+		pthread_cond_destroy(&out->room_cond);
+	}
+	if (out->compress) {
+		write_block(out);
+		deflateEnd(&out->zs);
+		free(out->block);
+		free(out->zbuf);
+	}
+	if (out->dropped)
+		msg_warn("%lu trace output records were dropped, the output ring "
+			 "buffer was full", out->dropped);
+	if (out->dropped_backtraces)
+		msg_warn("%lu backtraces were dropped, the collector didn't keep up",
+			 out->dropped_backtraces);
+	debug(1, "%lu trace output records spilled from the ring buffer",
+	      out->spilled);
+	if (out->close_fd)
+		close(out->fd);
+	free(out->ring);
+	free(out->line);
+	free(out);
+}
+
+static void ring_put(struct output *out, const unsigned char *data, size_t len)
+{
+	unsigned long head = out->head;
+	size_t pos = head % OUTPUT_RING_SIZE, n;
+
+	n = len < OUTPUT_RING_SIZE - pos ? len : OUTPUT_RING_SIZE - pos;
+	memcpy(out->ring + pos, data, n);
+	memcpy(out->ring, data + n, len - n);
+	__sync_synchronize();
+	out->head = head + len;
+	wake(out, &out->writer_waiting, &out->data_cond);
+}
+
+static size_t ring_room(struct output *out)
+{
+	return OUTPUT_RING_SIZE - (out->head - out->tail);
+}
+
+/* Waits for the room in the ring piece by piece, records bigger than the
+ * ring don't fit in it at once. */
+static void ring_wait_put(struct output *out, const unsigned char *p, size_t len)
+{
+	size_t n;
+
+	while (len > 0) {
+		n = ring_room(out);
+		if (n == 0) {
+			pthread_mutex_lock(&out->lock);
+			out->tracer_waiting = 1;
+			__sync_synchronize();
+			if (ring_room(out) == 0)
+				pthread_cond_wait(&out->room_cond, &out->lock);
+			out->tracer_waiting = 0;
+			pthread_mutex_unlock(&out->lock);
+			continue;
+		}
+		if (n > len)
+			n = len;
+		ring_put(out, p, n);
+		p += n;
+		len -= n;
+	}
+}
+
+/* Queues the frame header, if any, and the record together, so that
+ * either both or neither of them are dropped. */
+static int queue(struct output *out, const unsigned char *hdr, size_t hlen,
+		 const unsigned char *p, size_t len)
+{
+	struct spill *spill;
+
+	out->size += hlen + len;
+	if (out->policy == OUTPUT_SYNC) {
+		if (hlen)
+			put_data(out, hdr, hlen);
+		put_data(out, p, len);
+		return out->error ? -1 : 0;
+	}
+	if (out->error)
+		return -1;
+
+	if (out->spill == NULL && ring_room(out) >= hlen + len) {
+		if (hlen)
+			ring_put(out, hdr, hlen);
+		ring_put(out, p, len);
+		return 0;
+	}
+
+	switch (out->policy) {
+	case OUTPUT_DROP:
+		out->dropped++;
+		return -1;
+	case OUTPUT_SPILL:
+		spill = xmalloc(sizeof(struct spill) + hlen + len);
+		spill->next = NULL;
+		spill->len = hlen + len;
+		if (hlen)
+			memcpy(spill->data, hdr, hlen);
+		memcpy(spill->data + hlen, p, len);
+		pthread_mutex_lock(&out->lock);
+		*out->spill_tail = spill;
+		out->spill_tail = &spill->next;
+		pthread_mutex_unlock(&out->lock);
+		out->spilled++;
+		wake(out, &out->writer_waiting, &out->data_cond);
+		return 0;
+	default:
+		ring_wait_put(out, hdr, hlen);
+		ring_wait_put(out, p, len);
+		return 0;
+	}
+}
+
+static void put_u32(unsigned char *p, unsigned int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+int output_write(struct output *out, const void *data, size_t len)
+{
+	unsigned char frame[COLLECTOR_FRAME_SIZE];
+
+	if (!out->framed)
+		return queue(out, NULL, 0, data, len);
+
+	/* the sequence number is taken also by the dropped frames, so
+	 * that the collector sees the gap */
+	put_u32(frame, len);
+	put_u32(frame + 4, out->sequence++);
+	put_u32(frame + 8, out->frame_trace);
+	frame[12] = out->frame_type;
+	frame[13] = out->frame_format;
+	frame[14] = 0;
+	frame[15] = 0;
+	/* backtraces are dropped first, leaving the rest of the ring for
+	 * the events */
+	if (out->frame_type == COLLECTOR_BACKTRACE &&
+	    (out->spill != NULL || ring_room(out) < OUTPUT_RING_SIZE / 2)) {
+		out->dropped_backtraces++;
+		return -1;
+	}
+	return queue(out, frame, sizeof(frame), data, len);
+}
+
+void output_set_frame(struct output *out, pid_t trace, int type)
+{
+	out->frame_trace = trace;
+	out->frame_type = type;
+}
+
+/* Connects to the collector socket, or opens the collector pipe. The
+ * pipe can't be opened without a reader. */
+static int collector_open(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat buf;
+	int fd;
+
+	if (stat(path, &buf) < 0) {
+		msg_warn("Collector %s not found", path);
+		return -1;
+	}
+	if (S_ISFIFO(buf.st_mode)) {
+		fd = open(path, O_WRONLY | O_NONBLOCK);
+		if (fd < 0)
+			msg_warn("Failed to open collector pipe %s", path);
+		return fd;
+	}
+	if (!S_ISSOCK(buf.st_mode)) {
+		msg_warn("Collector %s is not a socket or a named pipe", path);
+		return -1;
+	}
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		msg_warn("Collector socket path %s is too long", path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		msg_warn("socket");
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		msg_warn("Failed to connect to collector %s", path);
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+struct output *output_connect(const char *path, int format)
+{
+	unsigned char header[COLLECTOR_HEADER_SIZE] = COLLECTOR_MAGIC;
+	struct output *out;
+	int fd;
+
+	fd = collector_open(path);
+	if (fd < 0)
+		return NULL;
+	/* a collector going away is reported by the failing write */
+	signal(SIGPIPE, SIG_IGN);
+
+	out = output_open(fd, 1);
+	header[4] = COLLECTOR_VERSION;
+	header[5] = COLLECTOR_VERSION >> 8;
+	queue(out, NULL, 0, header, sizeof(header));
+	out->framed = 1;
+	out->frame_format = format;
+
+	return out;
+}
+
+unsigned long long output_size(struct output *out)
+{
+	return out->size;
+}
+
+/* Hands the complete lines over to the output, and keeps the last
+ * incomplete line until the rest of it is written. */
+static ssize_t stream_write(void *cookie, const char *buf, size_t size)
+{
+	struct output *out = cookie;
+	const char *end;
+	size_t len;
+
+	end = memrchr(buf, '\n', size);
+	if (end == NULL) {
+		len = 0;
+	} else if (out->nline == 0) {
+		len = end + 1 - buf;
+		output_write(out, buf, len);
+	} else {
+		len = end + 1 - buf;
+		if (out->nline + len > out->line_size) {
+			out->line_size = out->nline + len;
+			out->line = xrealloc(out->line, out->line_size);
+		}
+		memcpy(out->line + out->nline, buf, len);
+		output_write(out, out->line, out->nline + len);
+		out->nline = 0;
+	}
+
+	if (out->nline + size - len > out->line_size) {
+		out->line_size = out->nline + size - len;
+		out->line = xrealloc(out->line, out->line_size);
+	}
+	memcpy(out->line + out->nline, buf + len, size - len);
+	out->nline += size - len;
+
+	return size;
+}
+
+static int stream_close(void *cookie)
+{
+	struct output *out = cookie;
+
+	if (out->nline)
+		output_write(out, out->line, out->nline);
+	out->nline = 0;
+
+	return 0;
+}
+
+FILE *output_fopen(struct output *out)
+{
+	cookie_io_functions_t io = {
+		.read = NULL,
+		.write = stream_write,
+		.seek = NULL,
+		.close = stream_close,
+	};
+	FILE *fp;
+
+	fp = fopencookie(out, "w", io);
+	if (fp != NULL)
+		setvbuf(fp, NULL, _IOFBF, OUTPUT_STREAM_BUFFER);
+	return fp;
+}
@@ -23,7 +23,9 @@
  */
 
 #include <dlfcn.h>
+#include <libiberty.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,15 +36,20 @@
 
 #include "config.h"
 #include "debug.h"
+#include "dict.h"
 #include "options.h"
 #include "plugins.h"
 #include "process.h"
+#include "seccomp.h"
 #include "util.h"
 
-#define FT_API_VERSION "2.0"
+#define FT_API_VERSION "2.1"
+/* plugins using older API version miss the new plg_api fields */
+#define FT_API_VERSION_2_0 "2.0"
 
 static void *handle = NULL;
 static struct plg_api *plg_api;
+static bool plg_api_2_0;
 
 
 static void *plg_get_symbol(const char *name)
@@ -56,7 +63,8 @@ static int plg_check_version(void)
 
 	if (version == NULL)
 		return 0;
-	return (strcmp(version, FT_API_VERSION) == 0);
+	plg_api_2_0 = (strcmp(version, FT_API_VERSION_2_0) == 0);
+	return plg_api_2_0 || (strcmp(version, FT_API_VERSION) == 0);
 }
 
 static int plg_load_module(const char *modname)
@@ -109,8 +117,217 @@ void plg_function_exit(struct process *proc, const char *name)
 	plg_api->function_exit(proc, name);
 }
 
+int plg_get_syscalls(struct plg_syscall **syscalls)
+{
+	if (handle == NULL || plg_api_2_0 || plg_api->get_syscalls == NULL)
+		return 0;
+	return plg_api->get_syscalls(syscalls);
+}
+
+static const char *plg_syscall_name(int sysno)
+{
+	struct plg_syscall *syscalls;
+	int nsyscalls = plg_get_syscalls(&syscalls);
+	int i;
+
+	for (i = 0; i < nsyscalls; i++) {
+		if (syscalls[i].sysno == sysno)
+			return syscalls[i].name;
+	}
+	return NULL;
+}
+
+/* Checks if the symbol is handled by a system call traced with seccomp
+ * filter, so that no breakpoint is needed for it. */
+static int plg_syscall_symbol(const char *symname)
+{
+	struct plg_syscall *syscalls;
+	int nsyscalls, i;
+
+	if (!seccomp_enabled())
+		return 0;
+	nsyscalls = plg_get_syscalls(&syscalls);
+	for (i = 0; i < nsyscalls; i++) {
+		if (strcmp(syscalls[i].name, symname) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+void plg_syscall_exit(struct process *proc, int sysno)
+{
+	const char *name;
+
+	if (handle == NULL || plg_api->function_exit == NULL)
+		return;
+
+	name = plg_syscall_name(sysno);
+	if (name == NULL) {
+		msg_warn("unexpected system call %d", sysno);
+		return;
+	}
+	plg_api->function_exit(proc, name);
+}
+
+/*
+ * Plugin symbol patterns compiled for matching the library symbols.
+ *
+ * Patterns without wildcards are looked up from a hash table. The other
+ * patterns are grouped by their first character, so that only the
+ * patterns starting like the symbol name are tried. Among the matching
+ * patterns the first one in the plugin symbol table wins, like when the
+ * patterns were tried in order.
+ */
+struct plg_pattern {
+	int index;		/* index in the plugin symbol table */
+	const char *name;
+	size_t prefix_len;	/* length of the literal prefix */
+	bool prefix_only;	/* the literal prefix followed by a single '*' */
+	struct plg_pattern *next;
+};
+
+#define ANY_CHAR	256	/* patterns starting with a wildcard */
+
+static struct {
+	struct dict *exact;	/* name -> index + 1 */
+	struct plg_pattern *globs[ANY_CHAR + 1];
+	/* a pattern may match demangled C++ names */
+	bool demangle;
+	/* names of the patterns without wildcards */
+	const char **names;
+	int nnames;
+	bool has_globs;
+} matcher;
+
+static void plg_compile_symbols(void)
+{
+	struct plg_symbol *syms;
+	struct plg_pattern *pat, **tail;
+	const char *name;
+	intptr_t index;
+	size_t len;
+	int nsyms, i, c;
+
+	if (plg_api->get_symbols == NULL)
+		return;
+	matcher.exact = dict_init(dict_key2hash_string, dict_key_cmp_string);
+	nsyms = plg_api->get_symbols(&syms);
+	for (i = 0; i < nsyms; i++) {
+		name = syms[i].name;
+		len = strcspn(name, "*?[\\");
+		if (strpbrk(name, "(: ") != NULL || name[len] != '\0')
+			matcher.demangle = true;
+		if (name[len] == '\0') {
+			/* keep the first one of duplicate patterns */
+			if (dict_find_entry(matcher.exact, name) != NULL)
+				continue;
+			/* 0 is stored as NULL, the index is stored plus one */
+			index = i + 1;
+			dict_enter(matcher.exact, name, (void *)index);
+			matcher.names = xrealloc(matcher.names,
+				(matcher.nnames + 1) * sizeof(char *));
+			matcher.names[matcher.nnames++] = name;
+			continue;
+		}
+		matcher.has_globs = true;
+		pat = xcalloc(1, sizeof(struct plg_pattern));
+		pat->index = i;
+		pat->name = name;
+		pat->prefix_len = len;
+		pat->prefix_only = strcmp(name + len, "*") == 0;
+		c = len ? (unsigned char)name[0] : ANY_CHAR;
+		for (tail = &matcher.globs[c]; *tail; tail = &(*tail)->next)
+			;
+		*tail = pat;
+	}
+	debug(1, "compiled %d plugin symbols (demangle=%d)", nsyms,
+	      matcher.demangle);
+}
+
+static void plg_free_symbols(void)
+{
+	struct plg_pattern *pat, *next;
+	int c;
+
+	if (matcher.exact != NULL)
+		dict_clear(matcher.exact);
+	free(matcher.names);
+	for (c = 0; c <= ANY_CHAR; c++) {
+		for (pat = matcher.globs[c]; pat; pat = next) {
+			next = pat->next;
+			free(pat);
+		}
+	}
+	memset(&matcher, 0, sizeof(matcher));
+}
+
+/* Returns the plugin symbol table index of the first pattern matching the
+ * name, or -1. */
+static int plg_match_index(const char *name)
+{
+	struct plg_pattern *lists[] = {
+		matcher.globs[(unsigned char)name[0]], matcher.globs[ANY_CHAR]
+	};
+	struct plg_pattern *pat;
+	intptr_t index;
+	void *entry;
+	int best, i;
+
+	entry = dict_find_entry(matcher.exact, name);
+	index = (intptr_t)entry;
+	best = index - 1;
+	for (i = 0; i < 2; i++) {
+		for (pat = lists[i]; pat && (best < 0 || pat->index < best); pat = pat->next) {
+			if (strncmp(name, pat->name, pat->prefix_len) != 0)
+				continue;
+			if (pat->prefix_only || !fnmatch(pat->name, name, 0)) {
+				best = pat->index;
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+/* Returns the plugin symbol matching the library symbol name, or NULL.
+ *
+ * Demangled names of C++ symbols are matched instead of their mangled
+ * names. Only names with the C++ ABI mangling prefix are demangled, and
+ * only if a pattern may match a demangled name. */
+static struct plg_symbol *plg_find_symbol(const char *symname)
+{
+	struct plg_symbol *syms;
+	char *demangled_name = NULL;
+	bool mangled;
+	int index;
+
+	if (matcher.exact == NULL)
+		return NULL;
+	if (symname[0] == 'I' && symname[1] == 'A' && symname[2] == '_' && symname[3] == '_') {
+		symname += 4;
+	}
+	mangled = symname[0] == '_' && symname[1] == 'Z';
+
+	if (mangled && matcher.demangle)
+		demangled_name = cplus_demangle(symname, DMGL_ANSI | DMGL_PARAMS);
+	index = plg_match_index(demangled_name ? demangled_name : symname);
+	if (index >= 0 && mangled && !matcher.demangle) {
+		/* the mangled name matches only if it can't be demangled */
+		demangled_name = cplus_demangle(symname, DMGL_ANSI | DMGL_PARAMS);
+		if (demangled_name)
+			index = -1;
+	}
+	free(demangled_name);
+	if (index < 0)
+		return NULL;
+	plg_api->get_symbols(&syms);
+	return &syms[index];
+}
+
 int plg_match(const char *symname)
 {
+	struct plg_symbol *sym;
+
 	if (handle == NULL)
 		return 0;
 
@@ -118,27 +335,47 @@ int plg_match(const char *symname)
 		msg_warn("Could not read symbol");
 		return 0;
 	}
-	int rc = 0;
 
-	if (symname[0] == 'I' && symname[1] == 'A' && symname[2] == '_' && symname[3] == '_') {
-		symname += 4;
-	}
+	sym = plg_find_symbol(symname);
+	if (sym == NULL)
+		return 0;
+	sym->hit++;
+	return !plg_syscall_symbol(sym->name);
+}
 
-	char *demangled_name = (char*)cplus_demangle(symname, DMGL_ANSI | DMGL_PARAMS);
-	const char *target_name = demangled_name ? demangled_name : symname;
+int plg_lookup(const char *symname)
+{
+	if (handle == NULL || plg_api->get_symbols == NULL)
+		return 0;
+	return plg_find_symbol(symname) != NULL;
+}
 
+int plg_exact_symbols(const char ***names)
+{
+	if (matcher.has_globs || matcher.demangle)
+		return -1;
+	*names = matcher.names;
+	return matcher.nnames;
+}
+
+unsigned int plg_symbols_hash(void)
+{
 	struct plg_symbol *syms;
-	int nsyms = plg_api->get_symbols(&syms);
-	int i;
+	unsigned int hash = 2166136261u;	/* FNV-1a */
+	const char *s;
+	int nsyms, i;
+
+	if (handle == NULL || plg_api->get_symbols == NULL)
+		return 0;
+	nsyms = plg_api->get_symbols(&syms);
 	for (i = 0; i < nsyms; i++) {
-		if (!fnmatch(syms[i].name, target_name, 0)) {
-			syms[i].hit++;
-			rc = 1;
-			break;
-		}
+		/* include the terminating null to separate the names */
+		s = syms[i].name;
+		do {
+			hash = (hash ^ (unsigned char)*s) * 16777619u;
+		} while (*s++);
 	}
-	if (demangled_name) free(demangled_name);
-	return rc;
+	return hash;
 }
 
 int plg_check_symbols(bool silent)
@@ -186,10 +423,13 @@ void plg_init(void)
 		 	 arguments.plugin);
 		plg_load_module(plg_name);
 	}
+	if (handle != NULL)
+		plg_compile_symbols();
 }
 
 void plg_finish(void)
 {
+	plg_free_symbols();
 	if (handle != NULL) {
 		dlclose(handle);
 		handle = NULL;
@@ -36,86 +36,59 @@
 #include "debug.h"
 #include "options.h"
 #include "process.h"
+#include "procfs.h"
 #include "report.h"
 #include "trace.h"
 #include "solib.h"
+#include "uprobe.h"
+#include "worker.h"
 
-#define BUF_SIZE	4096
+/* registry slice of the calling worker */
+#define list_of_processes	(worker_self()->processes)
 
-static struct process *list_of_processes = NULL;
+pid_t get_tgid(pid_t pid)
+{
+	return procfs_status(pid, "Tgid:");
+}
 
-static pid_t get_pid_from_status(pid_t pid, const char *field_name)
+pid_t get_ppid(pid_t pid)
 {
-	char path[255];
-	char *file_buf, *pos;
-	FILE *fp;
-	pid_t retval;
-	size_t field_size = strlen(field_name);
-
-	file_buf = malloc(BUF_SIZE);
-	if (file_buf == NULL)
-		return -1;
-
-	snprintf(path, sizeof(path), "/proc/%d/status", pid);
-	fp = fopen(path, "r");
-	if (fp == NULL) {
-		perror("open");
-		retval = -1;
-		goto open_error;
-	}
+	return procfs_status(pid, "PPid:");
+}
 
-	retval = fread(file_buf, BUF_SIZE, 1, fp);
-	if (retval != 1 && ferror(fp)) {
-		perror("read");
-		retval = -1;
-		goto read_error;
-	}
-	file_buf[BUF_SIZE - 1] = '\0';
-
-	retval = -1;
-	pos = file_buf;
-	while (1) {
-		if (pos + field_size + 1 > file_buf + BUF_SIZE)
-			break;
-		if (strncmp(pos, field_name, field_size) == 0) {
-			char *val = strchr(pos, ':');
-			assert(val != NULL);
-			retval = atoi(val + 2);
-			break;
-		}
-		pos = strchr(pos, '\n');
-		if (pos == NULL)
-			break;
-		pos += 1;
-	}
+struct for_each_data {
+	for_each_process_t callback;
+	int value;
+};
 
-read_error:
-	fclose(fp);
-open_error:
-	free(file_buf);
+static void for_each_worker_process(struct worker *w, void *data)
+{
+	struct for_each_data *fed = data;
+	struct process *tmp;
 
-	return retval;
+	tmp = w->processes;
+	while (tmp) {
+		fed->callback(tmp, fed->value);
+		tmp = tmp->next;
+	}
 }
 
-pid_t get_tgid(pid_t pid)
+void for_each_process(for_each_process_t callback, int value)
 {
-	return get_pid_from_status(pid, "Tgid:");
-}
+	struct for_each_data fed = {
+		.callback = callback,
+		.value = value,
+	};
 
-pid_t get_ppid(pid_t pid)
-{
-	return get_pid_from_status(pid, "PPid:");
+	worker_for_each(for_each_worker_process, &fed);
 }
 
-void for_each_process(for_each_process_t callback, int value)
+void for_each_own_process(for_each_process_t callback, int value)
 {
 	struct process *tmp;
 
-	tmp = list_of_processes;
-	while (tmp) {
+	for (tmp = list_of_processes; tmp; tmp = tmp->next)
 		callback(tmp, value);
-		tmp = tmp->next;
-	}
 }
 
 struct process *process_from_pid(pid_t pid)
@@ -128,6 +101,35 @@ struct process *process_from_pid(pid_t pid)
 	return tmp;
 }
 
+struct lookup_data {
+	pid_t pid;
+	struct process *proc;
+};
+
+static void lookup_worker_process(struct worker *w, void *data)
+{
+	struct lookup_data *ld = data;
+	struct process *tmp;
+
+	for (tmp = w->processes; tmp && !ld->proc; tmp = tmp->next) {
+		if (tmp->pid == ld->pid)
+			ld->proc = tmp;
+	}
+}
+
+/* Like process_from_pid(), but looks also into the registry slices of the
+ * other workers. Must be called with registry lock held. */
+struct process *process_lookup(pid_t pid)
+{
+	struct lookup_data ld = {
+		.pid = pid,
+		.proc = NULL,
+	};
+
+	worker_for_each(lookup_worker_process, &ld);
+	return ld.proc;
+}
+
 char *name_from_pid(pid_t pid)
 {
 	char proc_exe[PATH_MAX];
@@ -151,42 +153,22 @@ char *name_from_pid(pid_t pid)
 
 char *cmd_from_pid(pid_t pid, int noargs)
 {
-	char proc_cmd[1024], buf[1024];
-	char *pos, *new_pos;
-	FILE *fp;
-	int ret;
-
-	if (kill(pid, 0) == 0) {
-		snprintf(proc_cmd, sizeof(proc_cmd), "/proc/%d/cmdline", pid);
-		if (access(proc_cmd, F_OK) < 0)
-			error_exit("access");
-		fp = fopen(proc_cmd, "r");
-		if (fp == NULL)
-			error_exit("fopen");
-		memset(buf, 0, sizeof(buf));
-		ret = fscanf(fp, "%1024c", buf);
-		if (ret < 0 || ferror(fp)) {
-			return strdup("<none>");
-		}
-		fclose(fp);
-		/* Truncate string */
-		buf[sizeof(buf) - 2] = '\0';
-		buf[sizeof(buf) - 1] = '\0';
-		pos = buf;
-		while (!noargs) {
-			new_pos = rawmemchr(pos, '\0');
-			if (new_pos == pos) {
-				/* Remove last whitespace */
-				*(new_pos - 1) = '\0';
-				break;
-			}
-			*new_pos = ' ';
-			pos = new_pos + 1;
-
-		}
-		return strdup(buf);
+	char *buf, *pos;
+	size_t len;
+
+	buf = procfs_read(pid, PROCFS_CMDLINE, &len);
+	if (buf == NULL || len == 0)
+		return strdup("<none>");
+	/* Truncate string */
+	if (len > 1023)
+		len = 1023;
+	buf[len] = '\0';
+	/* the arguments are separated by NUL characters */
+	for (pos = buf; !noargs && pos < buf + len - 1; pos++) {
+		if (*pos == '\0')
+			*pos = ' ';
 	}
-	return strdup("<none>");
+	return strdup(buf);
 }
 
 struct process *add_process(pid_t pid)
@@ -198,22 +180,26 @@ struct process *add_process(pid_t pid)
 	if (!tmp)
 		error_exit("malloc");
 	tmp->pid = pid;
+	tmp->mem_fd = -1;
 	tmp->filename = name_from_pid(pid);
 	/* Start with tracing enabled or not, depending on command
 	 * line option. */
 	if (arguments.enabled)
 		tmp->trace_control = 1;
-	tmp->next = list_of_processes;
-	list_of_processes = tmp;
 
 	tgid = get_tgid(pid);
+	worker_registry_lock();
+	tmp->next = list_of_processes;
+	list_of_processes = tmp;
 	if (tgid != pid) {
-		tmp->parent = process_from_pid(tgid);
+		/* main thread can be traced by another worker */
+		tmp->parent = process_lookup(tgid);
 		/* Set tracing status according to whether parent has tracing
 		 * enabled or not. */
 		if (tmp->parent)
 			tmp->trace_control = tmp->parent->trace_control;
 	}
+	worker_registry_unlock();
 	solib_initialize(tmp);
 
 	debug(1, "Adding PID %d, filename = \"%s\"", pid, tmp->filename);
@@ -224,8 +210,11 @@ struct process *add_process(pid_t pid)
 static void free_process(struct process *proc, struct process **prev_next)
 {
 	*prev_next = proc->next;
+	procfs_close(proc->pid);
 	if (proc->filename)
 		free(proc->filename);
+	uprobe_release(proc);
+	trace_mem_close(proc);
 	free(proc);
 }
 
@@ -235,18 +224,21 @@ void remove_process(struct process *proc)
 
 	debug(1, "Removing PID %d", proc->pid);
 
+	worker_registry_lock();
 	if (list_of_processes->pid == proc->pid) {
 		free_process(list_of_processes, &list_of_processes);
-		return;
+		goto out;
 	}
 	tmp = list_of_processes;
 	while (tmp->next) {
 		if (tmp->next->pid == proc->pid) {
 			free_process(tmp->next, &tmp->next);
-			return;
+			goto out;
 		}
 		tmp = tmp->next;
 	}
+out:
+	worker_registry_unlock();
 }
 
 void remove_all_processes(void)
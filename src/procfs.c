@@ -0,0 +1,161 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libiberty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "procfs.h"
+
+/* number of processes with descriptors kept open per thread */
+#define PROCFS_SLOTS		16
+
+static const char *const file_names[PROCFS_NFILES] = {
+	[PROCFS_STATUS] = "status",
+	[PROCFS_CMDLINE] = "cmdline",
+	[PROCFS_MAPS] = "maps",
+};
+
+struct procfs_slot {
+	pid_t pid;
+	/* descriptor + 1, 0 if not open */
+	int fd[PROCFS_NFILES];
+};
+
+struct procfs_buf {
+	char *data;
+	size_t size;
+};
+
+/* descriptors and buffers of the calling thread, the slot of a process
+ * is selected by its PID */
+static __thread struct procfs_slot slots[PROCFS_SLOTS];
+static __thread struct procfs_buf bufs[PROCFS_NFILES];
+
+static void close_slot(struct procfs_slot *slot)
+{
+	int i;
+
+	for (i = 0; i < PROCFS_NFILES; i++) {
+		if (slot->fd[i])
+			close(slot->fd[i] - 1);
+		slot->fd[i] = 0;
+	}
+	slot->pid = 0;
+}
+
+static int open_file(pid_t pid, enum procfs_file file, int reopen)
+{
+	struct procfs_slot *slot = &slots[pid % PROCFS_SLOTS];
+	char path[64];
+
+	if (slot->pid != pid) {
+		close_slot(slot);
+		slot->pid = pid;
+	}
+	if (slot->fd[file] && !reopen)
+		return slot->fd[file] - 1;
+	if (slot->fd[file])
+		close(slot->fd[file] - 1);
+	snprintf(path, sizeof(path), "/proc/%d/%s", pid, file_names[file]);
+	slot->fd[file] = open(path, O_RDONLY | O_CLOEXEC) + 1;
+	return slot->fd[file] - 1;
+}
+
+/* Reads the file from the beginning, growing the buffer as needed. */
+static ssize_t read_file(int fd, struct procfs_buf *buf)
+{
+	size_t len = 0;
+	ssize_t ret;
+
+	for (;;) {
+		if (buf->size - len < 2) {
+			buf->size = buf->size ? buf->size * 2 : 4096;
+			buf->data = xrealloc(buf->data, buf->size);
+		}
+		ret = pread(fd, buf->data + len, buf->size - len - 1, len);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -1;
+		if (ret == 0)
+			break;
+		len += ret;
+	}
+	buf->data[len] = '\0';
+	return len;
+}
+
+char *procfs_read(pid_t pid, enum procfs_file file, size_t *len)
+{
+	struct procfs_buf *buf = &bufs[file];
+	ssize_t ret = -1;
+	int fd, retry;
+
+	/* a descriptor of an exited or executed process reads nothing or
+	 * fails, try once more with a new one */
+	for (retry = 0; retry < 2 && ret <= 0; retry++) {
+		fd = open_file(pid, file, retry);
+		if (fd == -1)
+			break;
+		ret = read_file(fd, buf);
+	}
+	errno = 0;
+	if (ret < 0) {
+		procfs_close(pid);
+		return NULL;
+	}
+	if (len)
+		*len = ret;
+	return buf->data;
+}
+
+long procfs_status(pid_t pid, const char *field)
+{
+	size_t field_size = strlen(field);
+	char *pos;
+
+	pos = procfs_read(pid, PROCFS_STATUS, NULL);
+	while (pos) {
+		if (strncmp(pos, field, field_size) == 0)
+			return strtol(pos + field_size, NULL, 10);
+		pos = strchr(pos, '\n');
+		if (pos)
+			pos++;
+	}
+	return -1;
+}
+
+void procfs_close(pid_t pid)
+{
+	struct procfs_slot *slot = &slots[pid % PROCFS_SLOTS];
+
+	if (slot->pid == pid)
+		close_slot(slot);
+}
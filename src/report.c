@@ -19,91 +19,649 @@
 
 #include <assert.h>
 #include <libiberty.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <time.h>
+#include <unistd.h>
 #include <sp_rtrace_formatter.h>
 #include <sp_rtrace_filter.h>
 
 #include "arch-defs.h"
 #include "backtrace.h"
+#include "collector.h"
 #include "config.h"
 #include "debug.h"
 #include "report.h"
 #include "options.h"
+#include "output.h"
 #include "plugins.h"
+#include "rtbin.h"
 
-#define FNAME_FMT "%s/%d-%d.rtrace.txt"
+#define FNAME_FMT "%s/%d-%d%s.rtrace.%s%s"
+#define FNAME_INDEX_FMT "%s/%d-%d.rtrace.idx"
 
-void rp_write_backtraces(struct process *proc, sp_rtrace_fcall_t *fcall)
+/* connection to the collector, shared by all traces */
+static struct output *collector;
+static int collector_users;
+
+/* Hands the records written so far over to the collector as a frame of
+ * the given type. The records are framed only for the collector. */
+static void rp_frame(struct rp_data *rd, int type)
 {
-	/* check if the backtrace must be printed */
-	if (!sp_rtrace_filter_validate(arguments.filter, fcall)) {
-		/* The record does not match backtrace filtering options.
-		 * Print empty backtrace. */
-		sp_rtrace_print_comment(proc->rp_data->fp, "\n");
+	if (!arguments.collector)
 		return;
+	output_set_frame(rd->out, rd->pid, type);
+	if (rd->bw)
+		rtbin_flush(rd->bw);
+	else
+		fflush(rd->fp);
+}
+
+static char *rp_strdup(const char *str)
+{
+	return str ? xstrdup(str) : NULL;
+}
+
+/*
+ * With several tracer workers the records reported by the callbacks are
+ * collected in a buffer of the worker, and written to the trace in the
+ * order the workers collected them, after their backtraces are unwound
+ * without the callback lock. See rp_stage_begin().
+ */
+enum {
+	RP_RECORD_CALL,
+	RP_RECORD_ARGS,
+	RP_RECORD_TRACE,
+	RP_RECORD_CONTEXT,
+	RP_RECORD_COMMENT,
+	RP_RECORD_MMAP,
+};
+
+struct rp_record {
+	int type;
+	/* call, context ID, library address range */
+	sp_rtrace_fcall_t call;
+	int id;
+	pointer_t from, to;
+	/* argument names and values, context name, comment text or library
+	 * path */
+	char **strings;
+	int nstrings;
+	/* backtrace of the process, unless filtered out */
+	struct process *proc;
+	int filtered;
+	int nframes;
+	void **frames;
+	char **names;
+};
+
+struct rp_stage {
+	/* trace the records are being collected for */
+	struct rp_data *rd;
+	/* trace and order of the collected records */
+	struct rp_data *target;
+	unsigned int ticket;
+	struct rp_record *records;
+	int nrecords;
+	int size;
+};
+
+static __thread struct rp_stage stage;
+
+/* time of the recorded event being reported, see rp_set_event_time() */
+static __thread struct timespec event_time;
+static __thread int event_time_set;
+
+/* Serializes the writes to the traces, which share the collector output.
+ * The records are collected under the callback lock, but written under
+ * this one. */
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* signalled when a worker has written its records */
+static pthread_cond_t stage_cond = PTHREAD_COND_INITIALIZER;
+
+void rp_set_event_time(const struct timespec *ts)
+{
+	event_time_set = ts != NULL;
+	if (ts)
+		event_time = *ts;
+}
+
+int rp_timestamp(void)
+{
+	struct timespec now, mono;
+	struct tm tm;
+	long long ns;
+	time_t sec;
+
+	/* -1 lets the trace writer stamp the call when it's written */
+	if (!arguments.time || !event_time_set)
+		return arguments.time;
+	/* move the event time from the monotonic to the wall clock */
+	clock_gettime(CLOCK_REALTIME, &now);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	ns = (mono.tv_sec - event_time.tv_sec) * 1000000000LL +
+		mono.tv_nsec - event_time.tv_nsec;
+	ns = now.tv_sec * 1000000000LL + now.tv_nsec - ns;
+	sec = ns / 1000000000;
+	localtime_r(&sec, &tm);
+	/* milliseconds since midnight */
+	return ((tm.tm_hour * 60 + tm.tm_min) * 60 + tm.tm_sec) * 1000 +
+		(ns % 1000000000) / 1000000;
+}
+
+static int rp_staging(struct rp_data *rd)
+{
+	return stage.rd != NULL && stage.rd == rd;
+}
+
+static struct rp_record *rp_stage_record(int type, int nstrings)
+{
+	struct rp_record *r;
+
+	if (stage.nrecords == stage.size) {
+		stage.size = stage.size ? stage.size * 2 : 16;
+		stage.records = xrealloc(stage.records,
+					 stage.size * sizeof(struct rp_record));
+	}
+	r = &stage.records[stage.nrecords++];
+	memset(r, 0, sizeof(struct rp_record));
+	r->type = type;
+	if (nstrings) {
+		r->strings = xmalloc(nstrings * sizeof(char *));
+		r->nstrings = nstrings;
 	}
+	return r;
+}
 
-	/* print the backtrace */
-	int bt_depth, i;
+static int rp_rotate_due(struct rp_data *rd)
+{
+	if (rd->index == NULL)
+		return 0;
+	if (arguments.rotate_size &&
+	    output_size(rd->out) + (rd->bw ? rtbin_buffered(rd->bw) : 0) >=
+	    arguments.rotate_size)
+		return 1;
+	if (arguments.rotate_time &&
+	    time(NULL) - rd->chunk_time >= arguments.rotate_time)
+		return 1;
+	return 0;
+}
+
+static void rp_rotate(struct rp_data *rd, int index);
+
+void rp_print_call(struct rp_data *rd, const sp_rtrace_fcall_t *call)
+{
+	struct rp_record *r;
+
+	if (rp_staging(rd)) {
+		r = rp_stage_record(RP_RECORD_CALL, 0);
+		r->call = *call;
+		r->call.name = rp_strdup(call->name);
+		return;
+	}
+	/* the chunks are rotated between the calls, so that the arguments
+	 * and the backtrace stay with their call */
+	if (rp_rotate_due(rd))
+		rp_rotate(rd, call->index);
+	/* the call is framed together with its arguments */
+	rp_frame(rd, COLLECTOR_EVENT);
+	if (rd->bw)
+		rtbin_write_call(rd->bw, call);
+	else
+		sp_rtrace_print_call(rd->fp, call);
+}
+
+void rp_print_args(struct rp_data *rd, const sp_rtrace_farg_t *args)
+{
+	struct rp_record *r;
+	int i, n;
+
+	if (rp_staging(rd)) {
+		for (n = 0; args[n].name != NULL; n++)
+			;
+		r = rp_stage_record(RP_RECORD_ARGS, 2 * n);
+		for (i = 0; i < n; i++) {
+			r->strings[2 * i] = rp_strdup(args[i].name);
+			r->strings[2 * i + 1] = rp_strdup(args[i].value);
+		}
+		return;
+	}
+	if (rd->bw)
+		rtbin_write_args(rd->bw, args);
+	else
+		sp_rtrace_print_args(rd->fp, args);
+}
+
+void rp_print_trace(struct rp_data *rd, const sp_rtrace_ftrace_t *trace)
+{
+	if (rd->bw)
+		rtbin_write_trace(rd->bw, trace);
+	else
+		sp_rtrace_print_trace(rd->fp, trace);
+}
+
+/* Keeps the resources, contexts and libraries declared in the trace, so
+ * that they can be repeated at the start of every chunk. */
+static void rp_keep_resource(struct rp_data *rd, const sp_rtrace_resource_t *res)
+{
+	sp_rtrace_resource_t *r;
+
+	rd->resources = xrealloc(rd->resources,
+				 (rd->nresources + 1) * sizeof(sp_rtrace_resource_t));
+	r = &rd->resources[rd->nresources++];
+	*r = *res;
+	r->type = rp_strdup(res->type);
+	r->desc = rp_strdup(res->desc);
+}
+
+static void rp_keep_context(struct rp_data *rd, const sp_rtrace_context_t *context)
+{
+	sp_rtrace_context_t *c;
+
+	rd->contexts = xrealloc(rd->contexts,
+				(rd->ncontexts + 1) * sizeof(sp_rtrace_context_t));
+	c = &rd->contexts[rd->ncontexts++];
+	*c = *context;
+	c->name = rp_strdup(context->name);
+}
+
+static void rp_keep_mmap(struct rp_data *rd, const sp_rtrace_mmap_t *mmap)
+{
+	sp_rtrace_mmap_t *m;
+	int i = 0;
+
+	/* a library loaded over an earlier one replaces it */
+	while (i < rd->nmmaps) {
+		m = &rd->mmaps[i];
+		if (m->from < mmap->to && mmap->from < m->to) {
+			free(m->module);
+			*m = rd->mmaps[--rd->nmmaps];
+		} else
+			i++;
+	}
+	rd->mmaps = xrealloc(rd->mmaps, (rd->nmmaps + 1) * sizeof(sp_rtrace_mmap_t));
+	m = &rd->mmaps[rd->nmmaps++];
+	*m = *mmap;
+	m->module = rp_strdup(mmap->module);
+}
+
+static void rp_write_resource(struct rp_data *rd, const sp_rtrace_resource_t *res)
+{
+	if (rd->bw)
+		rtbin_write_resource(rd->bw, res);
+	else
+		sp_rtrace_print_resource(rd->fp, res);
+}
+
+static void rp_write_context(struct rp_data *rd, const sp_rtrace_context_t *context)
+{
+	if (rd->bw)
+		rtbin_write_context(rd->bw, context);
+	else
+		sp_rtrace_print_context(rd->fp, context);
+}
+
+static void rp_write_mmap(struct rp_data *rd, const sp_rtrace_mmap_t *mmap)
+{
+	if (rd->bw)
+		rtbin_write_mmap(rd->bw, mmap);
+	else
+		sp_rtrace_print_mmap(rd->fp, mmap);
+}
+
+void rp_print_resource(struct rp_data *rd, const sp_rtrace_resource_t *res)
+{
+	if (rd->index)
+		rp_keep_resource(rd, res);
+	rp_frame(rd, COLLECTOR_EVENT);
+	rp_write_resource(rd, res);
+	rp_frame(rd, COLLECTOR_EVENT);
+}
+
+void rp_print_context(struct rp_data *rd, const sp_rtrace_context_t *context)
+{
+	struct rp_record *r;
+
+	if (rp_staging(rd)) {
+		r = rp_stage_record(RP_RECORD_CONTEXT, 1);
+		r->id = context->id;
+		r->strings[0] = rp_strdup(context->name);
+		return;
+	}
+	if (rd->index)
+		rp_keep_context(rd, context);
+	rp_frame(rd, COLLECTOR_EVENT);
+	rp_write_context(rd, context);
+	rp_frame(rd, COLLECTOR_EVENT);
+}
+
+void rp_print_mmap(struct rp_data *rd, const sp_rtrace_mmap_t *mmap)
+{
+	struct rp_record *r;
+
+	if (rp_staging(rd)) {
+		r = rp_stage_record(RP_RECORD_MMAP, 1);
+		r->from = mmap->from;
+		r->to = mmap->to;
+		r->strings[0] = rp_strdup(mmap->module);
+		return;
+	}
+	if (rd->index)
+		rp_keep_mmap(rd, mmap);
+	rp_frame(rd, COLLECTOR_EVENT);
+	rp_write_mmap(rd, mmap);
+	rp_frame(rd, COLLECTOR_EVENT);
+}
+
+void rp_print_comment(struct rp_data *rd, const char *fmt, ...)
+{
+	char buf[512], *text = buf;
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	if (len < 0)
+		return;
+	if ((size_t)len >= sizeof(buf)) {
+		text = xmalloc(len + 1);
+		va_start(args, fmt);
+		vsnprintf(text, len + 1, fmt, args);
+		va_end(args);
+	}
+	if (rp_staging(rd)) {
+		rp_stage_record(RP_RECORD_COMMENT, 1)->strings[0] = xstrdup(text);
+	} else {
+		rp_frame(rd, COLLECTOR_EVENT);
+		if (rd->bw)
+			rtbin_write_comment(rd->bw, text, len);
+		else
+			sp_rtrace_print_comment(rd->fp, "%s", text);
+		rp_frame(rd, COLLECTOR_EVENT);
+	}
+	if (text != buf)
+		free(text);
+}
+
+void rp_flush(struct rp_data *rd)
+{
+	pthread_mutex_lock(&write_lock);
+	rp_frame(rd, COLLECTOR_EVENT);
+	if (rd->bw)
+		rtbin_flush(rd->bw);
+	else
+		fflush(rd->fp);
+	pthread_mutex_unlock(&write_lock);
+}
+
+/* Writes the backtrace of a call, or an empty backtrace if the call is
+ * filtered out. */
+static void rp_write_trace(struct rp_data *rd, int filtered, int nframes,
+			   void **frames, char **names)
+{
+	/* the backtrace is sent to the collector in a frame of its own,
+	 * which is dropped first when the collector doesn't keep up */
+	rp_frame(rd, COLLECTOR_EVENT);
+	if (filtered) {
+		if (rd->bw)
+			rtbin_write_comment(rd->bw, "\n", 1);
+		else
+			sp_rtrace_print_comment(rd->fp, "\n");
+	} else {
+		sp_rtrace_ftrace_t trace = {
+				.nframes = nframes,
+				.frames = (pointer_t*)frames,
+				.resolved_names = arguments.resolve_name ? names : NULL,
+		};
+		rp_print_trace(rd, &trace);
+	}
+	rp_frame(rd, COLLECTOR_BACKTRACE);
+}
+
+static void rp_free_names(char **names, int nframes)
+{
+	int i;
+
+	if (arguments.resolve_name) {
+		for (i = 0; i < nframes; i++) {
+			free(names[i]);
+		}
+	}
+}
+
+void rp_write_backtraces(struct process *proc, sp_rtrace_fcall_t *fcall)
+{
+	struct rp_data *rd = proc->rp_data;
+	struct rp_record *r;
+	int filtered, bt_depth;
 	char *names[MAX_BT_DEPTH];
 	void *frames[MAX_BT_DEPTH];
-	struct rp_data *rd = proc->rp_data;
 
+	/* check if the backtrace must be printed. The record that does not
+	 * match backtrace filtering options gets an empty backtrace. */
+	filtered = !sp_rtrace_filter_validate(arguments.filter, fcall);
+
+	if (rp_staging(rd)) {
+		/* unwound in rp_stage_commit() */
+		r = rp_stage_record(RP_RECORD_TRACE, 0);
+		r->proc = proc;
+		r->filtered = filtered;
+		return;
+	}
+	if (filtered) {
+		rp_write_trace(rd, 1, 0, NULL, NULL);
+		return;
+	}
+
+	/* print the backtrace */
 	bt_depth = bt_backtrace(proc->bt_data, frames, names, arguments.depth);
 
 	debug(3, "rp_write_backtraces(pid=%d)", rd->pid);
 
-	sp_rtrace_ftrace_t trace = {
-			.nframes = bt_depth,
-			.frames = (pointer_t*)frames,
-			.resolved_names = arguments.resolve_name ? names : NULL,
-	};
+	rp_write_trace(rd, 0, bt_depth, frames, names);
+	rp_free_names(names, bt_depth);
+}
 
-	sp_rtrace_print_trace(rd->fp, &trace);
+void rp_stage_begin(struct process *proc)
+{
+	/* a single worker writes the records directly */
+	if (arguments.jobs > 1)
+		stage.rd = proc->rp_data;
+}
 
-	if (arguments.resolve_name) {
-		for (i = 0; i < bt_depth; i++) {
-			free(names[i]);
+int rp_stage_end(void)
+{
+	struct rp_data *rd = stage.rd;
+
+	stage.rd = NULL;
+	if (rd == NULL || stage.nrecords == 0)
+		return 0;
+	/* the workers write the records of a trace in the order they
+	 * collected them */
+	stage.target = rd;
+	stage.ticket = rd->stage_tickets++;
+	return 1;
+}
+
+/* Writes a collected record to the trace, and frees it. */
+static void rp_write_record(struct rp_data *rd, struct rp_record *r)
+{
+	sp_rtrace_farg_t *args;
+	int i;
+
+	switch (r->type) {
+	case RP_RECORD_CALL:
+		rp_print_call(rd, &r->call);
+		free(r->call.name);
+		break;
+	case RP_RECORD_ARGS:
+		args = xcalloc(r->nstrings / 2 + 1, sizeof(sp_rtrace_farg_t));
+		for (i = 0; i < r->nstrings / 2; i++) {
+			args[i].name = r->strings[2 * i];
+			args[i].value = r->strings[2 * i + 1];
 		}
+		rp_print_args(rd, args);
+		free(args);
+		break;
+	case RP_RECORD_CONTEXT: {
+		sp_rtrace_context_t context = {
+			.id = r->id,
+			.name = r->strings[0],
+		};
+		rp_print_context(rd, &context);
+		break;
 	}
+	case RP_RECORD_COMMENT:
+		rp_print_comment(rd, "%s", r->strings[0]);
+		break;
+	case RP_RECORD_MMAP: {
+		sp_rtrace_mmap_t mmap = {
+			.module = r->strings[0],
+			.from = r->from,
+			.to = r->to,
+		};
+		rp_print_mmap(rd, &mmap);
+		break;
+	}
+	case RP_RECORD_TRACE:
+		rp_write_trace(rd, r->filtered, r->nframes, r->frames, r->names);
+		if (!r->filtered)
+			rp_free_names(r->names, r->nframes);
+		free(r->frames);
+		free(r->names);
+		break;
+	}
+	for (i = 0; i < r->nstrings; i++)
+		free(r->strings[i]);
+	free(r->strings);
 }
 
+void rp_stage_commit(void)
+{
+	struct rp_data *rd = stage.target;
+	struct rp_record *r;
+	int i;
+
+	for (i = 0; i < stage.nrecords; i++) {
+		r = &stage.records[i];
+		if (r->type != RP_RECORD_TRACE || r->filtered)
+			continue;
+		r->frames = xmalloc(MAX_BT_DEPTH * sizeof(void *));
+		r->names = xmalloc(MAX_BT_DEPTH * sizeof(char *));
+		r->nframes = bt_backtrace(r->proc->bt_data, r->frames, r->names,
+					  arguments.depth);
+	}
+
+	pthread_mutex_lock(&write_lock);
+	while (rd->commit_tickets != stage.ticket)
+		pthread_cond_wait(&stage_cond, &write_lock);
+	for (i = 0; i < stage.nrecords; i++)
+		rp_write_record(rd, &stage.records[i]);
+	rd->commit_tickets++;
+	pthread_cond_broadcast(&stage_cond);
+	pthread_mutex_unlock(&write_lock);
 
-static int rp_write_header(struct process *proc)
+	stage.nrecords = 0;
+	stage.target = NULL;
+}
+
+static int rp_rotating(void)
 {
-	struct rp_data *rd = proc->rp_data;
-	char path[256], *buf, pid_s[8], btdepth_s[8];
+	return arguments.rotate_size || arguments.rotate_time;
+}
 
-	if (arguments.save_to_file) {
-		struct stat buf;
-		/* Do not overwrite existing trace file so it will use a
-		 * non-existing path.
-		 */
-		do {
-			snprintf(path, sizeof(path), FNAME_FMT,
-				 arguments.path ? : getenv("HOME"), rd->pid,
-				 rd->step++);
-		} while (stat(path, &buf) == 0);
-		rd->step--;
+static void rp_fname(char *path, size_t size, struct rp_data *rd, int step)
+{
+	char chunk[16] = "";
+
+	/* the chunks of a rotated trace are numbered after the step */
+	if (rp_rotating())
+		snprintf(chunk, sizeof(chunk), ".%d", rd->chunk);
+	snprintf(path, size, FNAME_FMT, arguments.path ? : getenv("HOME"),
+		 rd->pid, step, chunk, arguments.binary ? "bin" : "txt",
+		 arguments.compress ? ".gz" : "");
+}
+
+/* The traces share the collector connection, which is closed with the
+ * last trace. */
+static void rp_release_output(struct rp_data *rd)
+{
+	if (rd->out != collector)
+		output_close(rd->out);
+	else if (--collector_users == 0) {
+		output_close(collector);
+		collector = NULL;
+	}
+	rd->out = NULL;
+}
 
-		rd->fp = fopen(path, "a");
-		if (rd->fp == NULL) {
-			msg_warn("Failed to create report file");
-			free(rd);
-			proc->rp_data = rd = NULL;
-			return -1;
+static int rp_open_output(struct rp_data *rd, const char *path)
+{
+	int fd = STDOUT_FILENO;
+
+	if (arguments.collector) {
+		if (collector == NULL) {
+			collector = output_connect(arguments.collector,
+						   arguments.binary ? COLLECTOR_BINARY :
+						   COLLECTOR_TEXT);
+			if (collector == NULL)
+				return -1;
 		}
-	} else
-		rd->fp = stdout;
+		collector_users++;
+		rd->out = collector;
+		output_set_frame(rd->out, rd->pid, COLLECTOR_EVENT);
+	} else {
+		if (path != NULL) {
+			/* the traces of earlier runs are not overwritten or
+			 * appended to, also with rotated chunks */
+			fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+			if (fd < 0) {
+				msg_warn("Failed to create report file");
+				return -1;
+			}
+		}
+		rd->out = output_open(fd, path != NULL);
+	}
+
+	if (arguments.binary)
+		rd->bw = rtbin_open(rd->out);
+	else
+		rd->fp = output_fopen(rd->out);
+	if (rd->bw == NULL && rd->fp == NULL) {
+		msg_warn("Failed to start report output");
+		rp_release_output(rd);
+		return -1;
+	}
+	return 0;
+}
+
+static void rp_close_output(struct rp_data *rd)
+{
+	rp_frame(rd, COLLECTOR_EVENT);
+	if (rd->bw) {
+		rtbin_close(rd->bw);
+		rd->bw = NULL;
+	} else {
+		fclose(rd->fp);
+		rd->fp = NULL;
+	}
+	/* waits for the writer thread to write out the trace */
+	rp_release_output(rd);
+}
+
+static void rp_write_header(struct rp_data *rd)
+{
+	char pid_s[8], btdepth_s[8];
 
-	buf = cmd_from_pid(proc->pid, 1);
-	snprintf(pid_s, sizeof(pid_s), "%d", proc->pid);
+	snprintf(pid_s, sizeof(pid_s), "%d", rd->process_pid);
 	snprintf(btdepth_s, sizeof(btdepth_s), "%d", arguments.depth);
 
 	sp_rtrace_header_t header =  {
@@ -111,7 +669,7 @@ static int rp_write_header(struct process *proc)
 					NULL,            // HEADER_VERSION
 					BUILD_ARCH,      // HEADER_ARCH
 					NULL,            // HEADER_TIMESTAMP
-					buf,             // HEADER_PROCESS
+					rd->process,     // HEADER_PROCESS
 					pid_s,           // HEADER_PID
 					NULL,            // HEADER_FILTER
 					btdepth_s,       // HEADER_BACKTRACE_DEPTH
@@ -119,12 +677,125 @@ static int rp_write_header(struct process *proc)
 			},
 	};
 
-	sp_rtrace_print_header(rd->fp, &header);
-	free(buf);
+	if (rd->bw)
+		rtbin_write_header(rd->bw, &header);
+	else
+		sp_rtrace_print_header(rd->fp, &header);
+}
+
+/* Adds the current chunk to the index of the rotated trace. */
+static void rp_index_chunk(struct rp_data *rd, int index)
+{
+	char path[256], *name;
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	rd->chunk_time = tv.tv_sec;
+	rp_fname(path, sizeof(path), rd, rd->step);
+	name = strrchr(path, '/');
+	fprintf(rd->index, "%d %d %ld.%03ld %s\n", rd->chunk, index,
+		(long)tv.tv_sec, (long)tv.tv_usec / 1000, name ? name + 1 : path);
+	fflush(rd->index);
+}
+
+static int rp_open(struct process *proc)
+{
+	struct rp_data *rd = proc->rp_data;
+	char path[256];
+
+	if (arguments.save_to_file) {
+		char index[256];
+		struct stat buf;
+		/* Do not overwrite existing trace file so it will use a
+		 * non-existing path. The index of a rotated trace must not
+		 * exist either.
+		 */
+		do {
+			snprintf(index, sizeof(index), FNAME_INDEX_FMT,
+				 arguments.path ? : getenv("HOME"), rd->pid,
+				 rd->step);
+			rp_fname(path, sizeof(path), rd, rd->step++);
+		} while (stat(path, &buf) == 0 ||
+			 (rp_rotating() && stat(index, &buf) == 0));
+		rd->step--;
+	}
+
+	if (rp_open_output(rd, arguments.save_to_file ? path : NULL) < 0) {
+		free(rd);
+		proc->rp_data = rd = NULL;
+		return -1;
+	}
+
+	rd->process = cmd_from_pid(proc->pid, 1);
+	rd->process_pid = proc->pid;
+	rp_write_header(rd);
+	rp_frame(rd, COLLECTOR_EVENT);
+
+	if (rp_rotating()) {
+		snprintf(path, sizeof(path), FNAME_INDEX_FMT,
+			 arguments.path ? : getenv("HOME"), rd->pid, rd->step);
+		rd->index = fopen(path, "wx");
+		if (rd->index == NULL) {
+			msg_warn("Failed to create trace index, the trace is not rotated");
+			return 0;
+		}
+		fprintf(rd->index, "# chunk first-event start-time file\n");
+		rp_index_chunk(rd, rd->rp_number);
+	}
 
 	return 0;
 }
 
+/* Continues the trace in a new chunk, which starts with the header and
+ * the declarations needed for decoding it on its own. */
+static void rp_rotate(struct rp_data *rd, int index)
+{
+	struct rp_data old = *rd;
+	char path[256];
+	int i;
+
+	rd->chunk++;
+	rp_fname(path, sizeof(path), rd, rd->step);
+	if (rp_open_output(rd, path) < 0) {
+		/* keep writing to the current chunk, also when the next
+		 * one is left from an earlier run */
+		msg_warn("Failed to rotate the trace");
+		*rd = old;
+		fclose(rd->index);
+		rd->index = NULL;
+		return;
+	}
+	rp_close_output(&old);
+
+	rp_write_header(rd);
+	for (i = 0; i < rd->nresources; i++)
+		rp_write_resource(rd, &rd->resources[i]);
+	for (i = 0; i < rd->ncontexts; i++)
+		rp_write_context(rd, &rd->contexts[i]);
+	for (i = 0; i < rd->nmmaps; i++)
+		rp_write_mmap(rd, &rd->mmaps[i]);
+	rp_index_chunk(rd, index);
+}
+
+static void rp_free(struct rp_data *rd)
+{
+	int i;
+
+	for (i = 0; i < rd->nresources; i++) {
+		free(rd->resources[i].type);
+		free(rd->resources[i].desc);
+	}
+	for (i = 0; i < rd->ncontexts; i++)
+		free(rd->contexts[i].name);
+	for (i = 0; i < rd->nmmaps; i++)
+		free(rd->mmaps[i].module);
+	free(rd->resources);
+	free(rd->contexts);
+	free(rd->mmaps);
+	free(rd->process);
+	free(rd);
+}
+
 int rp_init(struct process *proc)
 {
 	struct rp_data *rd;
@@ -146,12 +817,19 @@ int rp_init(struct process *proc)
 		proc->parent->rp_data = rd;
 	proc->rp_data = rd;
 	if (rd->refcnt++ == 0) {
-		int ret = rp_write_header(proc);
+		int ret;
+
+		/* nothing is collected for the new trace yet, so its
+		 * header and declarations are written directly */
+		pthread_mutex_lock(&write_lock);
+		ret = rp_open(proc);
+		if (ret == 0)
+			plg_rp_init(proc);
+		pthread_mutex_unlock(&write_lock);
 		if (ret < 0)
 			return ret;
-		plg_rp_init(proc);
 	}
-	proc->bt_data = bt_init(proc->pid);
+	proc->bt_data = bt_init(proc);
 	if (arguments.verbose)
 		fprintf(stderr, "Started tracing %d\n", proc->pid);
 	return 0;
@@ -165,23 +843,32 @@ void rp_finish(struct process *proc)
 	bt_finish(proc->bt_data);
 	assert(rd->refcnt > 0);
 	if (--rd->refcnt == 0) {
+		pthread_mutex_lock(&write_lock);
 		rd->step++;
-		if (arguments.save_to_file)
-			fclose(rd->fp);
+		rp_close_output(rd);
+		if (rd->index) {
+			fclose(rd->index);
+			rd->index = NULL;
+		}
+		pthread_mutex_unlock(&write_lock);
 	}
 	if (arguments.verbose) {
 		char fname[256];
-		if (arguments.save_to_file)
-			snprintf(fname, sizeof(fname), FNAME_FMT,
+		if (arguments.save_to_file && rp_rotating())
+			snprintf(fname, sizeof(fname), FNAME_INDEX_FMT,
 				 arguments.path ? : getenv("HOME"), rd->pid,
 				 rd->step);
+		else if (arguments.save_to_file)
+			rp_fname(fname, sizeof(fname), rd, rd->step);
+		else if (arguments.collector)
+			snprintf(fname, sizeof(fname), "%s", arguments.collector);
 		else
 			snprintf(fname, sizeof(fname), "stdout");
 		fprintf(stderr, "Stopped tracing %d, trace saved to "
 			"%s\n", proc->pid, fname);
 	}
 	if (rd->refcnt == 0) {
-		free(rd);
+		rp_free(rd);
 		proc->rp_data = NULL;
 	}
 }
@@ -0,0 +1,427 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <libiberty.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "dict.h"
+#include "output.h"
+#include "rtbin.h"
+
+/* maximum size of a varint encoded 64-bit value */
+#define VARINT_MAX		10
+
+struct rtbin_writer {
+	struct output *out;
+	unsigned char *buf;
+	size_t len;
+	/* interned strings, the identifier of a string is its index + 1 */
+	struct dict *ids;
+	char **strings;
+	unsigned int nstrings;
+	/* number of strings defined by the records handed to the output */
+	unsigned int nflushed;
+	/* number of times the buffered records were dropped */
+	unsigned int resets;
+};
+
+static unsigned char *put_u16(unsigned char *p, uint16_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	return p + 2;
+}
+
+static unsigned char *put_u32(unsigned char *p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+	return p + 4;
+}
+
+static unsigned char *put_varint(unsigned char *p, uint64_t value)
+{
+	while (value >= 0x80) {
+		*p++ = value | 0x80;
+		value >>= 7;
+	}
+	*p++ = value;
+	return p;
+}
+
+/* Starts a record with room for the payload. The record is completed by
+ * end_record() with the end of the written payload. The records interning
+ * strings make room with reserve() first. */
+static unsigned char *begin_record(struct rtbin_writer *bw, size_t size)
+{
+	if (bw->len + RTBIN_RECORD_HEADER_SIZE + size > RTBIN_BUFFER_SIZE)
+		rtbin_flush(bw);
+	return bw->buf + bw->len + RTBIN_RECORD_HEADER_SIZE;
+}
+
+static void end_record(struct rtbin_writer *bw, int type, int flags,
+		       unsigned char *end)
+{
+	unsigned char *p = bw->buf + bw->len;
+	size_t size = end - p - RTBIN_RECORD_HEADER_SIZE;
+
+	p[0] = type;
+	p[1] = flags;
+	put_u16(p + 2, size);
+	bw->len += RTBIN_RECORD_HEADER_SIZE + size;
+}
+
+static void clear_strings(struct rtbin_writer *bw)
+{
+	unsigned int i;
+
+	dict_clear(bw->ids);
+	for (i = 0; i < bw->nstrings; i++)
+		free(bw->strings[i]);
+	free(bw->strings);
+	bw->strings = NULL;
+	bw->nstrings = 0;
+}
+
+int rtbin_flush(struct rtbin_writer *bw)
+{
+	int ret = 0;
+
+	if (bw->len == 0)
+		return 0;
+	ret = output_write(bw->out, bw->buf, bw->len);
+	bw->len = 0;
+	if (ret < 0) {
+		/* Only the strings defined by the dropped records are
+		 * interned again. Their identifiers follow the strings
+		 * already written, so they are reused in the same order. */
+		while (bw->nstrings > bw->nflushed) {
+			bw->nstrings--;
+			dict_remove(bw->ids, bw->strings[bw->nstrings]);
+			free(bw->strings[bw->nstrings]);
+		}
+		bw->resets++;
+	}
+	bw->nflushed = bw->nstrings;
+
+	return ret;
+}
+
+/* Returns the size of the RTBIN_STRING record of the string. */
+static size_t string_size(const char *str)
+{
+	size_t len;
+
+	if (str == NULL)
+		return 0;
+	len = strlen(str);
+	if (len > RTBIN_MAX_PAYLOAD - 4)
+		len = RTBIN_MAX_PAYLOAD - 4;
+	return RTBIN_RECORD_HEADER_SIZE + 4 + len;
+}
+
+/* Makes room for a record and the strings it interns, so that the buffer
+ * is not flushed between the string records and the record referring to
+ * them. If they don't fit in the buffer and the buffer is dropped in
+ * between, the strings are lost and the record is dropped too: the caller
+ * compares the returned value with bw->resets after begin_record(). */
+static unsigned int reserve(struct rtbin_writer *bw, size_t size)
+{
+	if (bw->len + RTBIN_RECORD_HEADER_SIZE + size > RTBIN_BUFFER_SIZE)
+		rtbin_flush(bw);
+	return bw->resets;
+}
+
+size_t rtbin_buffered(struct rtbin_writer *bw)
+{
+	return bw->len;
+}
+
+/* Returns the identifier of the string, writing its RTBIN_STRING record
+ * when it's used for the first time. */
+static uint32_t intern(struct rtbin_writer *bw, const char *str)
+{
+	unsigned char *p;
+	void *id;
+	size_t len;
+
+	if (str == NULL)
+		return 0;
+	id = dict_find_entry(bw->ids, str);
+	if (id != NULL)
+		return (uintptr_t)id;
+
+	len = strlen(str);
+	if (len > RTBIN_MAX_PAYLOAD - 4)
+		len = RTBIN_MAX_PAYLOAD - 4;
+	bw->strings = xrealloc(bw->strings, (bw->nstrings + 1) * sizeof(char *));
+	bw->strings[bw->nstrings++] = xstrdup(str);
+	dict_enter(bw->ids, bw->strings[bw->nstrings - 1],
+		   (void *)(uintptr_t)bw->nstrings);
+
+	p = begin_record(bw, 4 + len);
+	p = put_u32(p, bw->nstrings);
+	memcpy(p, str, len);
+	end_record(bw, RTBIN_STRING, 0, p + len);
+
+	return bw->nstrings;
+}
+
+struct rtbin_writer *rtbin_open(struct output *out)
+{
+	struct rtbin_writer *bw;
+	unsigned char header[RTBIN_FILE_HEADER_SIZE], *p;
+
+	memcpy(header, RTBIN_MAGIC, 4);
+	p = put_u16(header + 4, RTBIN_VERSION);
+	put_u16(p, 0);
+	if (output_write(out, header, sizeof(header)) < 0)
+		return NULL;
+
+	bw = xcalloc(1, sizeof(struct rtbin_writer));
+	bw->out = out;
+	bw->buf = xmalloc(RTBIN_BUFFER_SIZE);
+	bw->ids = dict_init(dict_key2hash_string, dict_key_cmp_string);
+
+	return bw;
+}
+
+int rtbin_close(struct rtbin_writer *bw)
+{
+	int ret;
+
+	ret = rtbin_flush(bw);
+	clear_strings(bw);
+	free(bw->buf);
+	free(bw);
+
+	return ret;
+}
+
+void rtbin_write_header(struct rtbin_writer *bw, const sp_rtrace_header_t *header)
+{
+	const unsigned int nfields = sizeof(header->fields) / sizeof(header->fields[0]);
+	uint32_t ids[nfields];
+	unsigned char *p;
+	unsigned int i, resets;
+	size_t size = nfields * 4;
+
+	for (i = 0; i < nfields; i++)
+		size += string_size(header->fields[i]);
+	resets = reserve(bw, size);
+	for (i = 0; i < nfields; i++)
+		ids[i] = intern(bw, header->fields[i]);
+	p = begin_record(bw, nfields * 4);
+	if (bw->resets != resets)
+		return;
+	for (i = 0; i < nfields; i++)
+		p = put_u32(p, ids[i]);
+	end_record(bw, RTBIN_HEADER, 0, p);
+}
+
+/* Milliseconds since midnight. The calls are stamped when they're
+ * recorded, not when the trace is converted to text. */
+static uint32_t timestamp(void)
+{
+	struct timeval tv;
+	struct tm tm;
+
+	gettimeofday(&tv, NULL);
+	localtime_r(&tv.tv_sec, &tm);
+	return ((tm.tm_hour * 60 + tm.tm_min) * 60 + tm.tm_sec) * 1000 +
+		tv.tv_usec / 1000;
+}
+
+void rtbin_write_call(struct rtbin_writer *bw, const sp_rtrace_fcall_t *call)
+{
+	const size_t size = 5 * 4 + 2 * VARINT_MAX;
+	const char *type_name = NULL;
+	uint32_t name, res_type;
+	unsigned int resets;
+	unsigned char *p;
+
+	if (call->res_type != NULL) {
+		/* resource references are stored by the resource type name */
+		if (call->res_type_flag == SP_RTRACE_FCALL_RFIELD_NAME)
+			type_name = call->res_type;
+		else
+			type_name = ((sp_rtrace_resource_t *)call->res_type)->type;
+	}
+	resets = reserve(bw, size + string_size(call->name) +
+			 string_size(type_name));
+	name = intern(bw, call->name);
+	res_type = intern(bw, type_name);
+
+	p = begin_record(bw, size);
+	if (bw->resets != resets)
+		return;
+	p = put_u32(p, call->index);
+	p = put_u32(p, call->context);
+	/* -1 asks for the current time, see rp_timestamp() */
+	p = put_u32(p, call->timestamp == -1 ? timestamp() : (uint32_t)call->timestamp);
+	p = put_u32(p, name);
+	p = put_u32(p, res_type);
+	p = put_varint(p, call->res_size);
+	p = put_varint(p, call->res_id);
+	end_record(bw, RTBIN_CALL, call->type, p);
+}
+
+void rtbin_write_args(struct rtbin_writer *bw, const sp_rtrace_farg_t *args)
+{
+	unsigned char *p, *start;
+	size_t len, room, size = RTBIN_MAX_PAYLOAD;
+	unsigned int i, n, resets;
+
+	for (n = 0; args[n].name != NULL; n++)
+		size += string_size(args[n].name);
+	uint32_t names[n > 0 ? n : 1];
+
+	/* the argument names are interned before starting the record */
+	resets = reserve(bw, size);
+	for (i = 0; i < n; i++)
+		names[i] = intern(bw, args[i].name);
+
+	start = p = begin_record(bw, RTBIN_MAX_PAYLOAD);
+	if (bw->resets != resets)
+		return;
+	for (i = 0; i < n; i++, args++) {
+		room = RTBIN_MAX_PAYLOAD - (p - start);
+		if (room < 4 + VARINT_MAX)
+			break;
+		len = args->value ? strlen(args->value) : 0;
+		if (len > room - 4 - VARINT_MAX)
+			len = room - 4 - VARINT_MAX;
+		p = put_u32(p, names[i]);
+		p = put_varint(p, len);
+		memcpy(p, args->value, len);
+		p += len;
+	}
+	end_record(bw, RTBIN_ARGS, 0, p);
+}
+
+void rtbin_write_trace(struct rtbin_writer *bw, const sp_rtrace_ftrace_t *trace)
+{
+	uint32_t names[trace->nframes > 0 ? trace->nframes : 1];
+	int resolved = trace->resolved_names != NULL;
+	uint64_t prev = 0, addr, delta;
+	size_t size = trace->nframes * (VARINT_MAX + 4);
+	unsigned int resets;
+	unsigned char *p;
+	int i;
+
+	if (resolved) {
+		for (i = 0; i < trace->nframes; i++)
+			size += string_size(trace->resolved_names[i]);
+	}
+	resets = reserve(bw, size);
+	if (resolved) {
+		for (i = 0; i < trace->nframes; i++)
+			names[i] = intern(bw, trace->resolved_names[i]);
+	}
+
+	/* The frames are often in the same library, so the distance to the
+	 * previous frame is stored, zigzag encoded for negative distances. */
+	p = begin_record(bw, trace->nframes * (VARINT_MAX + 4));
+	if (bw->resets != resets)
+		return;
+	for (i = 0; i < trace->nframes; i++) {
+		addr = trace->frames[i];
+		delta = addr - prev;
+		p = put_varint(p, (delta << 1) ^ -(delta >> 63));
+		if (resolved)
+			p = put_u32(p, names[i]);
+		prev = addr;
+	}
+	end_record(bw, RTBIN_TRACE, resolved ? RTBIN_TRACE_RESOLVED : 0, p);
+}
+
+void rtbin_write_resource(struct rtbin_writer *bw, const sp_rtrace_resource_t *res)
+{
+	uint32_t type, desc;
+	unsigned int resets;
+	unsigned char *p;
+
+	resets = reserve(bw, 4 * 4 + string_size(res->type) +
+			 string_size(res->desc));
+	type = intern(bw, res->type);
+	desc = intern(bw, res->desc);
+	p = begin_record(bw, 4 * 4);
+	if (bw->resets != resets)
+		return;
+	p = put_u32(p, res->id);
+	p = put_u32(p, res->flags);
+	p = put_u32(p, type);
+	p = put_u32(p, desc);
+	end_record(bw, RTBIN_RESOURCE, 0, p);
+}
+
+void rtbin_write_context(struct rtbin_writer *bw, const sp_rtrace_context_t *context)
+{
+	unsigned int resets;
+	unsigned char *p;
+	uint32_t name;
+
+	resets = reserve(bw, 2 * 4 + string_size(context->name));
+	name = intern(bw, context->name);
+	p = begin_record(bw, 2 * 4);
+	if (bw->resets != resets)
+		return;
+	p = put_u32(p, context->id);
+	p = put_u32(p, name);
+	end_record(bw, RTBIN_CONTEXT, 0, p);
+}
+
+void rtbin_write_mmap(struct rtbin_writer *bw, const sp_rtrace_mmap_t *mmap)
+{
+	unsigned int resets;
+	unsigned char *p;
+	uint32_t module;
+
+	resets = reserve(bw, 4 + 2 * VARINT_MAX + string_size(mmap->module));
+	module = intern(bw, mmap->module);
+	p = begin_record(bw, 4 + 2 * VARINT_MAX);
+	if (bw->resets != resets)
+		return;
+	p = put_u32(p, module);
+	p = put_varint(p, mmap->from);
+	p = put_varint(p, mmap->to);
+	end_record(bw, RTBIN_MMAP, 0, p);
+}
+
+void rtbin_write_comment(struct rtbin_writer *bw, const char *text, size_t len)
+{
+	unsigned char *p;
+
+	if (len > RTBIN_MAX_PAYLOAD)
+		len = RTBIN_MAX_PAYLOAD;
+	p = begin_record(bw, len);
+	memcpy(p, text, len);
+	end_record(bw, RTBIN_COMMENT, 0, p + len);
+}
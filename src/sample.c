@@ -0,0 +1,113 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "sample.h"
+
+void sample_init(struct sample *sample, pid_t pid, addr_t stack_addr,
+		 const unsigned char *stack, size_t stack_size)
+{
+	memset(sample, 0, sizeof(struct sample));
+	sample->pid = pid;
+	sample->stack_addr = stack_addr;
+	sample->stack = stack;
+	sample->stack_size = stack_size;
+	sample->mem_fd = -1;
+}
+
+void sample_finish(struct sample *sample)
+{
+	if (sample->mem_fd >= 0) {
+		close(sample->mem_fd);
+		sample->mem_fd = -1;
+	}
+}
+
+static int sample_mem_pread(struct sample *sample, addr_t addr, void *buf,
+			    size_t count)
+{
+	char path[64];
+
+	if (sample->mem_fd < 0) {
+		snprintf(path, sizeof(path), "/proc/%d/mem", sample->pid);
+		sample->mem_fd = open(path, O_RDONLY);
+		if (sample->mem_fd < 0) {
+			debug(1, "could not open %s", path);
+			return -1;
+		}
+	}
+	if (pread64(sample->mem_fd, buf, count, (off64_t)addr) != (ssize_t)count) {
+		debug(2, "could not read memory at %#x (pid=%d)", addr, sample->pid);
+		return -1;
+	}
+	return 0;
+}
+
+int sample_mem_read(struct sample *sample, addr_t addr, void *buf, size_t count)
+{
+	if (addr >= sample->stack_addr &&
+	    addr + count <= sample->stack_addr + sample->stack_size) {
+		memcpy(buf, sample->stack + (addr - sample->stack_addr), count);
+		return 0;
+	}
+	/* The memory outside the sampled stack is read from the running
+	 * process, so it may have been changed since the sample was taken. */
+	return sample_mem_pread(sample, addr, buf, count);
+}
+
+long sample_mem_readw(struct sample *sample, addr_t addr)
+{
+	long w;
+
+	if (sample_mem_read(sample, addr, &w, sizeof(w)) < 0) {
+		msg_warn("Cannot access memory at address %#x", addr);
+		return 0;
+	}
+	return w;
+}
+
+long sample_user_readw(struct sample *sample, long offset)
+{
+	const elf_greg_t *regs = (const elf_greg_t *)&sample->regs;
+
+	if (offset < 0 || offset >= (long)sizeof(elf_gregset_t)) {
+		msg_warn("invalid user area offset %ld", offset);
+		return 0;
+	}
+	return regs[offset / sizeof(elf_greg_t)];
+}
+
+long sample_argument(struct sample *sample, int arg_num)
+{
+	if (arg_num < 0 || arg_num >= SAMPLE_NARGS) {
+		msg_warn("function argument %d was not sampled", arg_num);
+		return 0;
+	}
+	return sample->args[arg_num];
+}
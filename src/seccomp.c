@@ -0,0 +1,195 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <errno.h>
+#include <libiberty.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/utsname.h>
+
+#include "arch-defs.h"
+#include "debug.h"
+#include "options.h"
+#include "plugins.h"
+#include "seccomp.h"
+#include "syscall.h"
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS	38
+#endif
+
+/* number of system call arguments saved on the seccomp stop */
+#define SYSCALL_NARGS	6
+
+/* Smallest error code returned by system calls. Return values between
+ * -MAX_ERRNO and -1 are errors. */
+#define MAX_ERRNO	4095
+
+static struct sock_filter *filter;
+static unsigned short filter_len;
+
+/* Since Linux 4.8 the seccomp stop comes after the syscall entry stop,
+ * which is not seen as the tracee runs with PTRACE_CONT. Older kernels
+ * stop on the syscall entry after the seccomp stop. */
+static int entry_stop_skipped;
+
+static int kernel_skips_entry_stop(void)
+{
+	struct utsname name;
+	int major, minor;
+
+	if (uname(&name) < 0 ||
+	    sscanf(name.release, "%d.%d", &major, &minor) != 2)
+		return 1;
+	return major > 4 || (major == 4 && minor >= 8);
+}
+
+static int kernel_supports_filter(void)
+{
+	/* With a NULL filter the kernel fails with EFAULT (or EACCES, if the
+	 * filter would need privileges), if filters are supported at all. */
+	if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, NULL) == 0)
+		return 1;
+	return errno == EFAULT || errno == EACCES;
+}
+
+static void filter_add(struct sock_filter insn)
+{
+	filter = xrealloc(filter, (filter_len + 1) * sizeof(struct sock_filter));
+	filter[filter_len++] = insn;
+}
+
+/* Creates a filter which stops the tracee (SECCOMP_RET_TRACE) on the
+ * given system calls and lets the other system calls run. The system
+ * call number is passed to the tracer as the filter return data. */
+static void filter_create(struct plg_syscall *syscalls, int nsyscalls)
+{
+	int i;
+
+	filter_add((struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+			offsetof(struct seccomp_data, arch)));
+	filter_add((struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+			FT_AUDIT_ARCH, 1, 0));
+	filter_add((struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+			SECCOMP_RET_ALLOW));
+	filter_add((struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+			offsetof(struct seccomp_data, nr)));
+	for (i = 0; i < nsyscalls; i++) {
+		filter_add((struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+				syscalls[i].sysno, 0, 1));
+		filter_add((struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+				SECCOMP_RET_TRACE | (syscalls[i].sysno & SECCOMP_RET_DATA)));
+	}
+	filter_add((struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+			SECCOMP_RET_ALLOW));
+	debug(1, "seccomp filter for %d system calls", nsyscalls);
+}
+
+void seccomp_init(void)
+{
+	struct plg_syscall *syscalls;
+	int nsyscalls;
+
+	if (!arguments.syscalls)
+		return;
+	nsyscalls = plg_get_syscalls(&syscalls);
+	if (nsyscalls <= 0) {
+		msg_warn("plugin does not support system call tracing, "
+			 "tracing functions instead");
+		arguments.syscalls = false;
+		return;
+	}
+	if (!kernel_supports_filter()) {
+		msg_warn("seccomp filters are not supported by the kernel, "
+			 "tracing functions instead");
+		arguments.syscalls = false;
+		return;
+	}
+	filter_create(syscalls, nsyscalls);
+	entry_stop_skipped = kernel_skips_entry_stop();
+}
+
+int seccomp_enabled(void)
+{
+	return filter != NULL;
+}
+
+int seccomp_install(void)
+{
+	struct sock_fprog prog = {
+		.len = filter_len,
+		.filter = filter,
+	};
+
+	if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0)
+		return 0;
+	if (errno != EACCES)
+		return -1;
+	/* Unprivileged process can install the filter only if it can't gain
+	 * new privileges, e.g. by executing set-user-ID programs. */
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
+		return -1;
+	return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+}
+
+void seccomp_syscall_enter(struct process *proc)
+{
+	int i;
+
+	debug(3, "pid=%d", proc->pid);
+	for (i = 0; i < SYSCALL_NARGS; i++)
+		proc->syscall_args[i] = get_syscall_arg(proc, i);
+	proc->in_seccomp = 1;
+	/* the next syscall stop is the exit stop, unless the kernel stops
+	 * on the syscall entry after the seccomp stop */
+	proc->in_syscall = entry_stop_skipped;
+}
+
+void seccomp_syscall_exit(struct process *proc)
+{
+	proc->in_seccomp = 0;
+}
+
+long seccomp_argument(struct process *proc, int arg_num)
+{
+	if (arg_num < 0 || arg_num >= SYSCALL_NARGS) {
+		msg_warn("invalid system call argument number %d", arg_num);
+		return 0;
+	}
+	return proc->syscall_args[arg_num];
+}
+
+long seccomp_return_value(struct process *proc)
+{
+	long retval = get_syscall_arg(proc, -1);
+
+	if (retval < 0 && retval >= -MAX_ERRNO)
+		return -1;
+	return retval;
+}
@@ -27,17 +27,28 @@
 #include <bfd.h>
 #include <errno.h>
 #include <libiberty.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <elf.h>
+#include <limits.h>
+#include <link.h>
+#include <sys/param.h>
+#include <sys/stat.h>
 
 #include "callback.h"
+#include "context.h"
 #include "debug.h"
+#include "dict.h"
+#include "elfsym.h"
 #include "maps.h"
+#include "plugins.h"
 #include "solib.h"
 #include "options.h"
 #include "filter.h"
+#include "symcache.h"
 
 /**
  * Program header structure, taken from binutils (include/elf/internal)
@@ -85,6 +96,17 @@ enum arm_st_branch_type {
 
 #define ELF_ST_TYPE(val)		((val) & 0xF)
 
+/* libbfd is not thread safe, serialize its use between tracer workers
+ * and library loader threads */
+static pthread_mutex_t bfd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* maximum number of threads reading libraries in parallel */
+#define SOLIB_MAX_LOADERS	8
+
+/* limits for reading the dynamic linker data from corrupted processes */
+#define MAX_DYNAMIC_ENTRIES	1024
+#define MAX_LINK_MAP_ENTRIES	65536
+
 /* Check whether the symbol is a thumb function, based on a hint from
  *     http://sources.redhat.com/ml/gdb-patches/2011-03/msg01105.html
  */
@@ -119,32 +141,34 @@ static void error_bfd(const char *filename, const char *msg)
 }
 
 
-static void resolve_path(char *filename, char **real_filename)
+static void resolve_path(const char *filename, char **real_filename)
 {
 	*real_filename = canonicalize_file_name(filename);
 	if (*real_filename == NULL)
 		error_file(filename, "could not resolve file path");
 }
 
-static void find_solib(char *filename, char **real_filename)
+static void find_solib(const char *filename, char **real_filename)
 {
 	resolve_path(filename, real_filename);
 }
 
-static void lib_base_address(pid_t pid, char *filename, addr_t *addr)
+static void lib_base_address(struct process *proc, char *filename, addr_t *addr)
 {
-	struct maps_data md;
+	struct maps_index *index;
+	int i;
 
 	*addr = (addr_t)NULL;
-	if (maps_init(&md, pid) == -1)
+	index = maps_get(proc);
+	if (index == NULL)
 		return;
-	while (maps_next(&md) == 1) {
-		if (MAP_EXEC(&md) && strcmp(md.path, filename) == 0) {
-			*addr = md.lo;
+	for (i = 0; i < index->nmaps; i++) {
+		if (MAP_EXEC(&index->maps[i]) &&
+		    strcmp(index->maps[i].path, filename) == 0) {
+			*addr = index->maps[i].lo;
 			break;
 		}
 	}
-	maps_finish(&md);
 }
 
 /*
@@ -299,7 +323,7 @@ static int solib_is_prelinked(bfd *abfd)
 
 
 /* Based on enable_break() code from GDB 6.6 (gdb/solib-svr4.c). */
-addr_t solib_dl_debug_address(struct process *proc)
+static addr_t dl_debug_address(struct process *proc)
 {
 	bfd *abfd;
 	asection *sect;
@@ -330,12 +354,18 @@ addr_t solib_dl_debug_address(struct process *proc)
 	for (i = 0; i < phdr_count; i++) {
 		if ((phdr_table[i].p_type == PT_LOAD) && (!phdr_table[i].p_offset)) {
 			if (!phdr_table[i].p_vaddr) {
-				lib_base_address(proc->pid, proc->filename, &load_addr);
+				lib_base_address(proc, proc->filename, &load_addr);
 			}
 			break;
 		}
 	}
 	proc->start_address = abfd->start_address + load_addr;
+	for (i = 0; i < phdr_count; i++) {
+		if (phdr_table[i].p_type == PT_DYNAMIC) {
+			proc->shared->dynamic_addr = phdr_table[i].p_vaddr + load_addr;
+			break;
+		}
+	}
 
 	/* */
 	sym_addr = bfd_lookup_symbol(abfd, "_dl_debug_state", SEC_CODE);
@@ -387,7 +417,7 @@ addr_t solib_dl_debug_address(struct process *proc)
 		goto close_abfd;
 	}
 	if (!solib_is_prelinked(abfd))
-		lib_base_address(proc->pid, interp_file, &start_addr);
+		lib_base_address(proc, interp_file, &start_addr);
 
 	free(interp_file);
 close_abfd:
@@ -397,31 +427,221 @@ error:
 	return (start_addr + sym_addr);
 }
 
-static void current_solibs(struct process *proc, struct solib_list **solist)
+/* Same as dl_debug_address(), but without libbfd. Returns -1 if the
+ * files have to be read with libbfd. */
+static int elf_dl_debug_address(struct process *proc, addr_t *addr)
 {
-	struct maps_data md;
-	struct solib_list *so = NULL;
+	struct elf_file *ef;
+	addr_t sym_addr, start_addr = 0, load_addr = 0;
+	char *interp_file = NULL;
+	const char *interp;
 
-	*solist = NULL;
-	if (maps_init(&md, proc->pid) == -1)
-		return;
-	while (maps_next(&md) == 1) {
-		if (MAP_EXEC(&md) && md.off == 0 && md.inum != 0) {
-			struct solib_list *tmp = xmalloc(sizeof(struct solib_list));
-
-			tmp->start_addr = md.lo;
-			tmp->end_addr = md.hi;
-			tmp->path = strdup(md.path);
-			tmp->next = so;
-			so = tmp;
-		}
+	ef = elf_open(proc->filename);
+	if (ef == NULL)
+		return -1;
+	/* Read the process entry point address, see dl_debug_address(). */
+	if (elf_is_pic(ef))
+		lib_base_address(proc, proc->filename, &load_addr);
+	proc->start_address = elf_entry(ef) + load_addr;
+	if (elf_dynamic(ef))
+		proc->shared->dynamic_addr = elf_dynamic(ef) + load_addr;
+
+	/* static executables contain the symbol themselves */
+	sym_addr = elf_lookup_function(ef, "_dl_debug_state");
+	interp = elf_interp(ef);
+	if (interp == NULL) {
+		debug(1, "\"%s\": no program interpreter", proc->filename);
+		elf_close(ef);
+		*addr = sym_addr;
+		return 0;
 	}
-	maps_finish(&md);
-	*solist = so;
+	find_solib(interp, &interp_file);
+	elf_close(ef);
+	if (interp_file == NULL)
+		return -1;
+
+	ef = elf_open(interp_file);
+	if (ef == NULL) {
+		free(interp_file);
+		return -1;
+	}
+	sym_addr = elf_lookup_function(ef, "_dl_debug_state");
+	if (sym_addr == 0)
+		msg_warn("\"%s\": could not find _dl_debug_state symbol",
+			 interp_file);
+	else if (!elf_is_prelinked(ef))
+		lib_base_address(proc, interp_file, &start_addr);
+	elf_close(ef);
+	free(interp_file);
+
+	*addr = start_addr + sym_addr;
+	return 0;
+}
+
+addr_t solib_dl_debug_address(struct process *proc)
+{
+	addr_t addr;
+
+	if (elf_dl_debug_address(proc, &addr) == 0)
+		return addr;
+	pthread_mutex_lock(&bfd_lock);
+	addr = dl_debug_address(proc);
+	pthread_mutex_unlock(&bfd_lock);
+	return addr;
+}
+
+struct solib_symbol {
+	char *name;
+	addr_t addr;
+};
+
+/* library file mapped at a given address */
+struct image_key {
+	const char *path;
+	dev_t dev;
+	ino_t ino;
+	addr_t start_addr;
+};
+
+/* Matching symbols of a library file mapped at a given address. The
+ * images are shared by all traced processes mapping the library at the
+ * same address, like forked children and their parent, so the library is
+ * read only once. */
+struct solib_image {
+	struct image_key key;
+	char *path;
+	struct solib_symbol *syms;
+	int nsyms;
+	/* references from the library lists and attach plans */
+	int refs;
+};
+
+static struct dict *images;
+static pthread_mutex_t images_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int image_hash(const void *key)
+{
+	const struct image_key *k = key;
+
+	return dict_key2hash_string(k->path) ^ k->ino ^ k->start_addr;
+}
+
+static int image_cmp(const void *key1, const void *key2)
+{
+	const struct image_key *a = key1, *b = key2;
+
+	if (a->start_addr != b->start_addr || a->ino != b->ino ||
+	    a->dev != b->dev)
+		return 1;
+	return strcmp(a->path, b->path);
+}
+
+static void image_key(struct image_key *key, const char *path,
+		      addr_t start_addr)
+{
+	struct stat st;
+
+	memset(key, 0, sizeof(*key));
+	key->path = path;
+	key->start_addr = start_addr;
+	if (stat(path, &st) == 0) {
+		key->dev = st.st_dev;
+		key->ino = st.st_ino;
+	}
+	errno = 0;
+}
+
+/* Returns a new reference to the image of the library, or NULL if it has
+ * not been read. */
+static struct solib_image *image_get(const char *path, addr_t start_addr)
+{
+	struct solib_image *image = NULL;
+	struct image_key key;
+
+	image_key(&key, path, start_addr);
+	pthread_mutex_lock(&images_lock);
+	if (images)
+		image = dict_find_entry(images, &key);
+	if (image)
+		image->refs++;
+	pthread_mutex_unlock(&images_lock);
+	if (image)
+		debug(2, "symbols of \"%s\" at %#lx already read", path,
+		      (unsigned long)start_addr);
+	return image;
+}
+
+static void image_free(struct solib_image *image)
+{
+	int i;
+
+	for (i = 0; i < image->nsyms; i++)
+		free(image->syms[i].name);
+	free(image->syms);
+	free(image->path);
+	free(image);
+}
+
+/* Creates the image of a library read by the caller, taking over the
+ * symbols. Returns a reference to it. */
+static struct solib_image *image_add(const char *path, addr_t start_addr,
+				     struct solib_symbol *syms, int nsyms)
+{
+	struct solib_image *image, *old;
+
+	image = xmalloc(sizeof(struct solib_image));
+	image->path = xstrdup(path);
+	image_key(&image->key, image->path, start_addr);
+	image->syms = syms;
+	image->nsyms = nsyms;
+	image->refs = 1;
+
+	pthread_mutex_lock(&images_lock);
+	if (images == NULL)
+		images = dict_init(image_hash, image_cmp);
+	/* the library may have been read by another worker meanwhile */
+	old = dict_find_entry(images, &image->key);
+	if (old)
+		old->refs++;
+	else
+		dict_enter(images, &image->key, image);
+	pthread_mutex_unlock(&images_lock);
+	if (old) {
+		image_free(image);
+		return old;
+	}
+	return image;
+}
+
+static void image_put(struct solib_image *image)
+{
+	int refs;
+
+	if (image == NULL)
+		return;
+	pthread_mutex_lock(&images_lock);
+	refs = --image->refs;
+	if (refs == 0)
+		dict_remove(images, &image->key);
+	pthread_mutex_unlock(&images_lock);
+	if (refs == 0)
+		image_free(image);
+}
+
+static struct solib_list *new_solib(const char *path, addr_t start_addr,
+				    addr_t end_addr)
+{
+	struct solib_list *solib = xcalloc(1, sizeof(struct solib_list));
+
+	solib->start_addr = start_addr;
+	solib->end_addr = end_addr;
+	solib->path = xstrdup(path);
+	return solib;
 }
 
 static void free_solib(struct solib_list *solib)
 {
+	image_put(solib->image);
 	if (solib->path)
 		free(solib->path);
 	free(solib);
@@ -437,11 +657,302 @@ void free_all_solibs(struct process *proc)
 		free_solib(tmp2);
 	}
 	proc->shared->solib_list = NULL;
+	if (proc->shared->solib_index) {
+		dict_clear(proc->shared->solib_index);
+		proc->shared->solib_index = NULL;
+	}
+}
+
+struct solib_list *solib_find(struct process *proc, const char *path)
+{
+	if (proc->shared->solib_index == NULL)
+		return NULL;
+	return dict_find_entry(proc->shared->solib_index, path);
+}
+
+void solib_clone(struct process *child, struct process *parent)
+{
+	struct process_shared *to = child->shared, *from = parent->shared;
+	struct solib_list *solib, *copy, **link = &to->solib_list;
+
+	to->solib_index = dict_init(dict_key2hash_string, dict_key_cmp_string);
+	for (solib = from->solib_list; solib; solib = solib->next) {
+		copy = new_solib(solib->path, solib->start_addr, solib->end_addr);
+		copy->generation = solib->generation;
+		copy->image = solib->image;
+		if (copy->image) {
+			pthread_mutex_lock(&images_lock);
+			copy->image->refs++;
+			pthread_mutex_unlock(&images_lock);
+		}
+		dict_enter(to->solib_index, copy->path, copy);
+		*link = copy;
+		link = &copy->next;
+	}
+	to->solib_generation = from->solib_generation;
+	to->dynamic_addr = from->dynamic_addr;
+	to->r_debug = from->r_debug;
+	to->r_map_tail = from->r_map_tail;
+	to->r_state = from->r_state;
+}
+
+/* Marks a known library as loaded in the current update round.
+ * Returns 0 if the library is not known. */
+static int solib_seen(struct process *proc, const char *path)
+{
+	struct solib_list *solib = solib_find(proc, path);
+
+	if (solib == NULL)
+		return 0;
+	solib->generation = proc->shared->solib_generation;
+	return 1;
+}
+
+/* Appends a newly loaded library to the list of libraries to be read. */
+static void solib_added(struct process *proc, struct solib_list ***tail,
+			struct solib_list *solib)
+{
+	solib->generation = proc->shared->solib_generation;
+	dict_enter(proc->shared->solib_index, solib->path, solib);
+	**tail = solib;
+	*tail = &solib->next;
+}
+
+/* Finds the loaded libraries from the executable mappings, used until the
+ * dynamic linker has set up its library list. */
+/* Returns the mapping of the start of the library file whose code is
+ * mapped at md, or NULL if md is not library code. The start of the file
+ * is mapped at the lowest load address, like the link map entries give
+ * it, also when the code is in a separate mapping. The previous mapping
+ * of the file start is given in first. */
+static const struct maps_data *maps_solib(const struct maps_data *first,
+					  const struct maps_data *md)
+{
+	if (!MAP_EXEC(md) || md->inum == 0)
+		return NULL;
+	if (md->off == 0)
+		return md;
+	if (first && first->inum == md->inum && first->maj == md->maj &&
+	    first->min == md->min && strcmp(first->path, md->path) == 0)
+		return first;
+	return NULL;
+}
+
+static void maps_solibs(struct process *proc, struct solib_list ***added)
+{
+	const struct maps_data *first = NULL, *lib;
+	struct maps_index *index;
+	struct maps_data *md;
+	int i;
+
+	index = maps_get(proc);
+	if (index == NULL)
+		return;
+	for (i = 0; i < index->nmaps; i++) {
+		md = &index->maps[i];
+		lib = maps_solib(first, md);
+		if (md->off == 0)
+			first = md;
+		if (lib && !solib_seen(proc, md->path))
+			solib_added(proc, added, new_solib(md->path, lib->lo, md->hi));
+	}
+}
+
+/* Returns the address of the dynamic linker r_debug structure, which is
+ * stored to the DT_DEBUG entry of the program dynamic section when the
+ * dynamic linker starts, or 0 if it is not set up yet. */
+static addr_t solib_r_debug(struct process *proc)
+{
+	struct process_shared *shared = proc->shared;
+	ElfW(Dyn) dyn;
+	int i;
+
+	if (shared->r_debug || shared->dynamic_addr == 0)
+		return shared->r_debug;
+	for (i = 0; i < MAX_DYNAMIC_ENTRIES; i++) {
+		trace_mem_read(proc, shared->dynamic_addr + i * sizeof(dyn),
+			       &dyn, sizeof(dyn));
+		if (dyn.d_tag == DT_NULL)
+			break;
+		if (dyn.d_tag == DT_DEBUG) {
+			shared->r_debug = dyn.d_un.d_ptr;
+			debug(2, "r_debug at %#lx", (unsigned long)shared->r_debug);
+			break;
+		}
+	}
+	return shared->r_debug;
+}
+
+static void link_map_solib(struct process *proc, struct link_map *lm,
+			   struct solib_list ***added)
+{
+	char lname[PATH_MAX], name[PATH_MAX], path[PATH_MAX];
+	struct elf_file *ef;
+	addr_t lo, hi, start_addr, end_addr;
+
+	lname[0] = '\0';
+	if (lm->l_name)
+		trace_mem_readstr(proc, (addr_t)lm->l_name, lname, sizeof(lname));
+	/* the entry of the program itself has no name, the others are
+	 * resolved in the root and the working directory of the process */
+	if (lname[0] == '\0')
+		snprintf(name, sizeof(name), "%s", proc->filename);
+	else
+		snprintf(name, sizeof(name), "/proc/%d/%s%s", proc->pid,
+			 lname[0] == '/' ? "root" : "cwd/", lname);
+	/* the maps contain the resolved paths, and the vDSO is not a file */
+	if (realpath(name, path) == NULL) {
+		errno = 0;
+		return;
+	}
+	if (solib_seen(proc, path))
+		return;
+	/* l_addr is the difference between the run-time and the link time
+	 * addresses */
+	start_addr = end_addr = lm->l_addr;
+	ef = elf_open(path);
+	if (ef != NULL) {
+		if (elf_load_range(ef, &lo, &hi) == 0) {
+			start_addr += lo;
+			end_addr += hi;
+		}
+		elf_close(ef);
+	}
+	solib_added(proc, added, new_solib(path, start_addr, end_addr));
+}
+
+/* Walks the dynamic linker library list starting from the given entry. */
+static void link_map_solibs(struct process *proc, addr_t lm_addr,
+			    struct solib_list ***added)
+{
+	struct link_map lm;
+	int i;
+
+	for (i = 0; lm_addr != 0 && i < MAX_LINK_MAP_ENTRIES; i++) {
+		trace_mem_read(proc, lm_addr, &lm, sizeof(lm));
+		link_map_solib(proc, &lm, added);
+		proc->shared->r_map_tail = lm_addr;
+		lm_addr = (addr_t)lm.l_next;
+	}
+}
+
+/* Checks if the registration callback may be interested in the symbol. */
+static int solib_symbol_match(const char *name)
+{
+	return context_match(name) || plg_lookup(name);
+}
+
+/* function symbols of a library matching the plugin or context symbols */
+struct solib_symbols {
+	struct solib_list *lib;
+	/* added to the symbol values, 0 for prelinked libraries */
+	addr_t start_addr;
+	struct solib_symbol *syms;
+	int nsyms;
+};
+
+static void solib_report_symbol(const char *name, addr_t symaddr, void *data)
+{
+	struct solib_symbols *ss = data;
+
+	ss->syms = xrealloc(ss->syms, (ss->nsyms + 1) * sizeof(*ss->syms));
+	ss->syms[ss->nsyms].name = xstrdup(name);
+	ss->syms[ss->nsyms].addr = symaddr + ss->start_addr;
+	ss->nsyms++;
+}
+
+static void solib_add_symbol(const char *name, addr_t symaddr, void *data)
+{
+	/* Ignore symbols with no defined address. */
+	if (symaddr != 0)
+		symcache_add(data, name, symaddr);
 }
 
-static void solib_read_library(struct process *proc, char *filename,
-			       addr_t start_addr, new_sym_t callback)
+/* Reads the function symbols of the library without libbfd.
+ * Returns -1 if the library has to be read with libbfd. */
+static int solib_read_elf(const char *filename, struct symcache *sc)
 {
+	struct elf_file *ef, *symfile;
+	long nsyms;
+
+	ef = elf_open(filename);
+	if (ef == NULL)
+		return -1;
+	if (arguments.audit) {
+		/* like solib_debug_read_symbols() */
+		symfile = elf_open_debug(ef, filename);
+		if (symfile == NULL)
+			symfile = ef;
+		nsyms = elf_for_each_function(symfile, ELF_SYMTAB,
+					      solib_add_symbol, sc);
+		if (nsyms <= 0)
+			nsyms = elf_for_each_function(symfile, ELF_DYNSYM,
+						      solib_add_symbol, sc);
+	} else {
+		symfile = ef;
+		nsyms = elf_for_each_function(symfile, ELF_DYNSYM,
+					      solib_add_symbol, sc);
+	}
+	if (nsyms >= 0)
+		symcache_save(sc, elf_is_prelinked(symfile));
+	if (symfile != ef)
+		elf_close(symfile);
+	elf_close(ef);
+	return nsyms >= 0 ? 0 : -1;
+}
+
+/* Looks up a symbol and its "IA__" prefixed internal alias. */
+static void solib_lookup_name(struct elf_file *ef, const char *name,
+			      struct solib_symbols *ss)
+{
+	char alias[256];
+
+	elf_lookup_dynamic(ef, name, solib_report_symbol, ss);
+	if (snprintf(alias, sizeof(alias), "IA__%s", name) < (int)sizeof(alias))
+		elf_lookup_dynamic(ef, alias, solib_report_symbol, ss);
+}
+
+/* Reports the plugin and context function symbols of the library found
+ * from its dynamic symbol hash table, instead of going through all the
+ * symbols. Returns -1 if the plugin symbols are patterns or the library
+ * has no hash table. */
+static int solib_lookup_exact(const char *filename,
+			      struct solib_symbols *ss)
+{
+	struct elf_file *ef;
+	const char **names;
+	int i, nnames;
+
+	/* audit mode reads the full symbol table, which has no hash */
+	if (arguments.audit)
+		return -1;
+	nnames = plg_exact_symbols(&names);
+	if (nnames < 0)
+		return -1;
+	ef = elf_open(filename);
+	if (ef == NULL)
+		return -1;
+	if (!elf_has_dynamic_hash(ef)) {
+		elf_close(ef);
+		return -1;
+	}
+	if (elf_is_prelinked(ef))
+		ss->start_addr = 0;
+	for (i = 0; context_symbols[i] != NULL; i++)
+		solib_lookup_name(ef, context_symbols[i], ss);
+	for (i = 0; i < nnames; i++)
+		solib_lookup_name(ef, names[i], ss);
+	elf_close(ef);
+	return 0;
+}
+
+/* Collects the matching function symbols of the library. Called from the
+ * loader threads, so it must not touch the traced process. */
+static void solib_read_library(struct solib_data *solib, const char *program,
+			       struct solib_symbols *ss)
+{
+	char *filename = ss->lib->path;
+	struct symcache *sc;
 	bfd *abfd;
 	long number_of_symbols;
 	asymbol *sym, **symbol_table;
@@ -449,7 +960,7 @@ static void solib_read_library(struct process *proc, char *filename,
 	const flagword flags = BSF_FUNCTION;
 
 	/* Do not read symbols from the target program itself. */
-	if (strcmp(proc->filename, filename) == 0)
+	if (strcmp(program, filename) == 0)
 		return;
 
 	/* Do not read symbols from the dynamic linker.
@@ -459,83 +970,254 @@ static void solib_read_library(struct process *proc, char *filename,
 	if (strcmp(filename, "/lib/ld-2.5.so") == 0)
 		return;
 
-	abfd = proc->solib->open(proc->solib, filename);
+	ss->start_addr = ss->lib->start_addr;
+	if (solib_lookup_exact(filename, ss) == 0)
+		return;
+
+	sc = symcache_open(filename, arguments.audit != NULL,
+			   plg_symbols_hash(), solib_symbol_match);
+	if (symcache_load(sc) == 0 || solib_read_elf(filename, sc) == 0)
+		goto report;
+
+	pthread_mutex_lock(&bfd_lock);
+	abfd = solib->open(solib, filename);
 	if (abfd == NULL) {
+		pthread_mutex_unlock(&bfd_lock);
+		symcache_close(sc);
 		return;
 	}
-	number_of_symbols = proc->solib->read_symbols(abfd, &symbol_table);
+	number_of_symbols = solib->read_symbols(abfd, &symbol_table);
 	if (number_of_symbols) {
 		int i;
 		for (i = 0; i < number_of_symbols; i++) {
 			sym = symbol_table[i];
 			if ((sym->flags & flags) == flags) {
+				/* Bfd symbols are section relative. */
 				symaddr = sym->value + sym->section->vma;
 				/* Ignore symbols with no defined address. */
 				if (symaddr == 0)
 					continue;
-				if (!solib_is_prelinked(abfd))
-					symaddr += start_addr;
 				if (is_thumb_func(sym))
 					symaddr |= 1;
-				/* Bfd symbols are section relative. */
-				/* FIXME: pass SONAME instead of library filename. */
-				callback(proc, filename, sym->name, symaddr);
+				symcache_add(sc, sym->name, symaddr);
 			}
 		}
-		proc->solib->free_symbols(symbol_table);
+		solib->free_symbols(symbol_table);
 	}
-	if (!proc->solib->close(proc->solib, abfd))
+	if (number_of_symbols >= 0)
+		symcache_save(sc, solib_is_prelinked(abfd));
+	if (!solib->close(solib, abfd))
 		error_bfd(filename, "could not close file");
+	pthread_mutex_unlock(&bfd_lock);
+
+report:
+	if (symcache_prelinked(sc))
+		ss->start_addr = 0;
+	symcache_for_each_match(sc, solib_report_symbol, ss);
+	symcache_close(sc);
 }
 
-/* Based on update_solib_list() code from GDB 6.6 (gdb/solib.c). */
+struct solib_loader {
+	struct solib_data *solib;
+	const char *program;
+	struct solib_symbols *libs;
+	int nlibs;
+	int next;
+	pthread_mutex_t lock;
+};
+
+static void *solib_loader_main(void *data)
+{
+	struct solib_loader *loader = data;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&loader->lock);
+		i = loader->next++;
+		pthread_mutex_unlock(&loader->lock);
+		if (i >= loader->nlibs)
+			break;
+		solib_read_library(loader->solib, loader->program,
+				   &loader->libs[i]);
+	}
+	return NULL;
+}
+
+/* Reads the libraries on a pool of loader threads, the calling thread
+ * being one of them. Only the symbol files are read, the breakpoints are
+ * inserted afterwards by the calling thread as ptrace() requests must
+ * come from the tracer thread. */
+static void solib_read_libraries(struct solib_data *solib, const char *program,
+				 struct solib_symbols *libs, int nlibs)
+{
+	struct solib_loader loader = { solib, program, libs, nlibs, 0,
+				       PTHREAD_MUTEX_INITIALIZER };
+	pthread_t threads[SOLIB_MAX_LOADERS];
+	long ncpus;
+	int i, nthreads;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = MIN(MIN(ncpus, SOLIB_MAX_LOADERS), nlibs);
+	for (i = 0; i < nthreads - 1; i++) {
+		if (pthread_create(&threads[i], NULL, solib_loader_main,
+				   &loader) != 0) {
+			msg_warn("pthread_create");
+			break;
+		}
+	}
+	nthreads = i;
+	debug(3, "reading %d libraries with %d threads", nlibs, nthreads + 1);
+	solib_loader_main(&loader);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&loader.lock);
+}
+
+/* Library images read before attaching to the process. The plan keeps
+ * them cached until the first library list update after attaching has
+ * taken them into use. */
+struct solib_plan {
+	pid_t pid;
+	struct solib_image **images;
+	int nimages;
+	struct solib_plan *next;
+};
+
+static struct solib_plan *plans;
+static pthread_mutex_t plans_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void solib_prepare_cancel(pid_t pid)
+{
+	struct solib_plan *plan, **link;
+	int i;
+
+	pthread_mutex_lock(&plans_lock);
+	for (link = &plans; (plan = *link) != NULL; link = &plan->next) {
+		if (plan->pid == pid) {
+			*link = plan->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&plans_lock);
+	if (plan == NULL)
+		return;
+	for (i = 0; i < plan->nimages; i++)
+		image_put(plan->images[i]);
+	free(plan->images);
+	free(plan);
+}
+
+/* Reads the libraries and adds their images to the cache. */
+static void solib_read_images(struct solib_data *solib, const char *program,
+			      struct solib_symbols *libs, int nlibs)
+{
+	int i;
+
+	if (nlibs == 0)
+		return;
+	solib_read_libraries(solib, program, libs, nlibs);
+	for (i = 0; i < nlibs; i++)
+		libs[i].lib->image = image_add(libs[i].lib->path,
+					       libs[i].lib->start_addr,
+					       libs[i].syms, libs[i].nsyms);
+}
+
+/* Finds the libraries loaded and unloaded since the previous call.
+ *
+ * The dynamic linker calls _dl_debug_state() with r_state RT_ADD or
+ * RT_DELETE before changing its library list, and with RT_CONSISTENT
+ * after it. New libraries are appended to the list, so after additions
+ * only the entries following the previously last one are read. After
+ * removals the whole list is read and the libraries not seen anymore
+ * are dropped. */
 void solib_update_list(struct process *proc, new_sym_t callback)
 {
-	struct solib_list *cur_sos;
-	struct solib_list *k = proc->shared->solib_list;
-	struct solib_list **k_link = &proc->shared->solib_list;
+	struct process_shared *shared = proc->shared;
+	struct solib_list *added = NULL, **tail = &added;
+	struct solib_list *solib, **link;
 	struct callback *cb = cb_get();
-	current_solibs(proc, &cur_sos);
-	while (k) {
-		struct solib_list *c = cur_sos;
-		struct solib_list **c_link = &cur_sos;
+	struct solib_symbols *libs = NULL;
+	struct r_debug rd;
+	struct link_map lm;
+	addr_t r_debug;
+	int i, nlibs = 0, full = 1;
 
-		while (c) {
-			if (strcmp(k->path, c->path) == 0)
-				break;
-			c_link = &c->next;
-			c = *c_link;
+	if (shared->solib_index == NULL)
+		shared->solib_index = dict_init(dict_key2hash_string,
+						dict_key_cmp_string);
+	shared->solib_generation++;
+
+	r_debug = solib_r_debug(proc);
+	if (r_debug == 0) {
+		maps_solibs(proc, &tail);
+	} else {
+		trace_mem_read(proc, r_debug, &rd, sizeof(rd));
+		if (rd.r_state != RT_CONSISTENT) {
+			/* a removal needs to be remembered until the list
+			 * is consistent again */
+			if (shared->r_state != RT_DELETE)
+				shared->r_state = rd.r_state;
+			return;
 		}
-		if (c) {
-			/* solib is already known */
-			/* equivalent to: parent->next = current->next */
-			*c_link = c->next;
-			free_solib(c);
-			k_link = &k->next;
-			k = *k_link;
+		if (shared->r_state != RT_DELETE && shared->r_map_tail) {
+			trace_mem_read(proc, shared->r_map_tail, &lm, sizeof(lm));
+			link_map_solibs(proc, (addr_t)lm.l_next, &tail);
+			full = 0;
 		} else {
-			/* solib was unloaded */
-			debug(3, "solib unloaded: start=0x%x, end=0x%x, \
-			      name=%s", k->start_addr, k->end_addr, k->path);
-			*k_link = k->next;
-			free_solib(k);
-			k = *k_link;
+			link_map_solibs(proc, (addr_t)rd.r_map, &tail);
 		}
+		shared->r_state = RT_CONSISTENT;
 	}
-	if (cur_sos) {
-		struct solib_list *c;
-
-		*k_link = cur_sos;
-		for (c = cur_sos; c; c = c->next) {
-			/* solib was loaded */
-			debug(3, "solib loaded: start=0x%08x, end=0x%08x, \
-			      name=%s", c->start_addr, c->end_addr, c->path);
-			if (cb && cb->library.load)
-				cb->library.load(proc, c->start_addr,
-						 c->end_addr, c->path);
-			if (filter_validate(c->path)) {
-				solib_read_library(proc, c->path, c->start_addr, callback);
-			}
+
+	/* drop the libraries not seen in a full update */
+	link = &shared->solib_list;
+	while (full && (solib = *link) != NULL) {
+		if (solib->generation == shared->solib_generation) {
+			link = &solib->next;
+			continue;
+		}
+		debug(3, "solib unloaded: start=0x%x, end=0x%x, name=%s",
+		      solib->start_addr, solib->end_addr, solib->path);
+		dict_remove(shared->solib_index, solib->path);
+		*link = solib->next;
+		free_solib(solib);
+	}
+	if (added == NULL)
+		return;
+	*tail = shared->solib_list;
+	shared->solib_list = added;
+
+	for (solib = added; solib != *tail; solib = solib->next) {
+		/* solib was loaded */
+		debug(3, "solib loaded: start=0x%08x, end=0x%08x, name=%s",
+		      solib->start_addr, solib->end_addr, solib->path);
+		if (cb && cb->library.load)
+			cb->library.load(proc, solib->start_addr,
+					 solib->end_addr, solib->path);
+		if (!filter_validate(solib->path))
+			continue;
+		solib->image = image_get(solib->path, solib->start_addr);
+		if (solib->image)
+			continue;
+		libs = xrealloc(libs, (nlibs + 1) * sizeof(*libs));
+		memset(&libs[nlibs], 0, sizeof(*libs));
+		libs[nlibs++].lib = solib;
+	}
+	solib_read_images(proc->solib, proc->filename, libs, nlibs);
+	free(libs);
+	/* the images read before attaching are referenced by the process now */
+	solib_prepare_cancel(proc->pid);
+
+	/* register the symbols in the library load order */
+	for (solib = added; solib != *tail; solib = solib->next) {
+		struct solib_image *image = solib->image;
+
+		if (image == NULL)
+			continue;
+		for (i = 0; i < image->nsyms; i++) {
+			/* FIXME: pass SONAME instead of library filename. */
+			callback(proc, solib->path, image->syms[i].name,
+				 image->syms[i].addr);
 		}
 	}
 }
@@ -564,3 +1246,66 @@ void solib_initialize(struct process *proc)
 {
 	proc->solib = arguments.audit ? &solib_data_debug : &solib_data_default;
 }
+
+void solib_prepare(pid_t pid)
+{
+	struct solib_symbols *libs = NULL;
+	struct solib_plan *plan;
+	struct maps_data md, first;
+	const struct maps_data *lib;
+	char *program;
+	int i, nlibs = 0;
+
+	program = name_from_pid(pid);
+	if (program == NULL || maps_init(&md, pid) == -1) {
+		free(program);
+		return;
+	}
+	/* the same libraries and start addresses as maps_solibs() and the
+	 * link map entries give, which key the images */
+	memset(&first, 0, sizeof(first));
+	while (maps_next(&md) == 1) {
+		lib = maps_solib(first.path ? &first : NULL, &md);
+		if (md.off == 0)
+			first = md;
+		if (lib == NULL || !filter_validate(md.path) ||
+		    (nlibs && strcmp(libs[nlibs - 1].lib->path, md.path) == 0))
+			continue;
+		libs = xrealloc(libs, (nlibs + 1) * sizeof(*libs));
+		memset(&libs[nlibs], 0, sizeof(*libs));
+		libs[nlibs++].lib = new_solib(md.path, lib->lo, md.hi);
+	}
+	maps_finish(&md);
+
+	plan = xcalloc(1, sizeof(struct solib_plan));
+	plan->pid = pid;
+	plan->images = xcalloc(nlibs ? nlibs : 1, sizeof(struct solib_image *));
+	/* libraries shared with other traced processes are read only once */
+	for (i = 0; i < nlibs; i++) {
+		plan->images[plan->nimages] = image_get(libs[i].lib->path,
+							libs[i].lib->start_addr);
+		if (plan->images[plan->nimages]) {
+			plan->nimages++;
+			free_solib(libs[i].lib);
+			memmove(&libs[i], &libs[i + 1],
+				(--nlibs - i) * sizeof(*libs));
+			i--;
+		}
+	}
+	solib_read_images(arguments.audit ? &solib_data_debug :
+			  &solib_data_default, program, libs, nlibs);
+	for (i = 0; i < nlibs; i++) {
+		/* the image reference is moved to the plan */
+		plan->images[plan->nimages++] = libs[i].lib->image;
+		libs[i].lib->image = NULL;
+		free_solib(libs[i].lib);
+	}
+	free(libs);
+	free(program);
+	debug(1, "%d libraries of PID %d read before attaching", nlibs, pid);
+
+	pthread_mutex_lock(&plans_lock);
+	plan->next = plans;
+	plans = plan;
+	pthread_mutex_unlock(&plans_lock);
+}
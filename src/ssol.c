@@ -37,7 +37,9 @@
 #include <sys/procfs.h>
 
 #include "arch-defs.h"
+#include "breakpoint.h"
 #include "debug.h"
+#include "function.h"
 #include "ssol.h"
 #include "syscall.h"
 #include "target_mem.h"
@@ -82,6 +84,7 @@ static long syscall_remote(struct process *proc, long sysnum, unsigned int argnu
 			sizeof(syscall_data->insns));
 
 	/* execute syscall instruction and stop again */
+	trace_flush(proc);
 	xptrace(PTRACE_CONT, proc->pid, 0, 0);
 
 	/* wait for child to stop */
@@ -124,6 +127,70 @@ static int munmap_remote(struct process *proc, void *start, size_t length)
 
 #define SSOL_LENGTH	4096
 
+long ssol_call(struct process *proc, addr_t fn, unsigned int argnum,
+	       long *args)
+{
+	elf_gregset_t orig_regs, call_regs;
+	struct bkpt_insn *insn;
+	addr_t ret_addr;
+	long ret, retval;
+	int status, sig = 0;
+	struct syscall_data *syscall_data = get_syscall_data(proc);
+
+	/* the function returns to a breakpoint of its own */
+	ret_addr = proc->shared->ssol->call_ret;
+	if (ret_addr == 0) {
+		ret_addr = ssol_new_slot(proc);
+		insn = breakpoint_instruction(ret_addr);
+		trace_mem_write(proc, ret_addr, insn->value, insn->size);
+		proc->shared->ssol->call_ret = ret_addr;
+	}
+
+	memset(&orig_regs, 0, sizeof(elf_gregset_t));
+	trace_getregs(proc, &orig_regs);
+	memcpy(&call_regs, &orig_regs, sizeof(elf_gregset_t));
+	fn_setup_call(proc, &call_regs, fn, argnum, args, ret_addr);
+	trace_setregs(proc, &call_regs);
+
+	/* the signals received meanwhile are delivered */
+	for (;;) {
+		trace_flush(proc);
+		xptrace(PTRACE_CONT, proc->pid, 0, (void *)(long)sig);
+		ret = ft_waitpid(proc->pid, &status, __WALL);
+		assert(ret == proc->pid && WIFSTOPPED(status));
+		if (WSTOPSIG(status) == SIGTRAP)
+			break;
+		sig = WSTOPSIG(status);
+	}
+	if (bkpt_get_address(proc) == ret_addr) {
+		retval = trace_user_readw(proc, 4 * syscall_data->retval_reg);
+	} else {
+		debug(1, "pid=%d: unexpected stop at %#x in the call of %#x",
+		      proc->pid, bkpt_get_address(proc), fn);
+		retval = -1;
+	}
+
+	trace_setregs(proc, &orig_regs);
+
+	return retval;
+}
+
+addr_t ssol_map(struct process *proc, size_t length)
+{
+	void *addr = mmap_remote(proc, NULL, length, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	/* the system call returns the error number negated */
+	if ((unsigned long)addr > -4096UL)
+		return 0;
+	return (addr_t)addr;
+}
+
+void ssol_unmap(struct process *proc, addr_t addr, size_t length)
+{
+	munmap_remote(proc, (void *)addr, length);
+}
+
 addr_t ssol_new_slot(struct process *proc)
 {
 	struct ssol *ssol = proc->shared->ssol;
@@ -142,9 +209,18 @@ void ssol_init(struct process *proc)
 		PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 	assert(proc->shared->ssol->first > 0);
 	proc->shared->ssol->last = proc->shared->ssol->first;
+	proc->shared->ssol->call_ret = 0;
 	debug(1, "mmap_remote() returned %#x", proc->shared->ssol->first);
 }
 
+void ssol_clone(struct process *child, struct process *parent)
+{
+	/* the child has a copy of the parent's SSOL area at the same
+	 * address */
+	child->shared->ssol = xmalloc(sizeof(struct ssol));
+	*child->shared->ssol = *parent->shared->ssol;
+}
+
 void ssol_finish(struct process *proc)
 {
 	int ret;
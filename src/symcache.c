@@ -0,0 +1,498 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libiberty.h>
+#include <limits.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "dict.h"
+#include "elfsym.h"
+#include "options.h"
+#include "symcache.h"
+
+#define SYMCACHE_MAGIC		0x43535446	/* "FTSC" */
+#define SYMCACHE_VERSION	2
+
+/* header flags */
+#define SYMCACHE_PRELINKED	1
+
+/* longest build-id read from a library */
+#define BUILD_ID_MAX		64
+/* largest note segment searched for the build-id */
+#define NOTES_MAX		65536
+
+#if __ELF_NATIVE_CLASS == 32
+#define ELF_NATIVE_CLASS	ELFCLASS32
+#else
+#define ELF_NATIVE_CLASS	ELFCLASS64
+#endif
+
+/*
+ * Index file layout: header, symbol table, indices of the matched symbols
+ * in the symbol table, string table.
+ */
+struct symcache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flags;
+	uint32_t match_hash;
+	uint64_t file_size;
+	uint64_t file_mtime;
+	uint32_t nsyms;
+	uint32_t nmatches;
+	uint32_t strtab_size;
+	/* separate debug file the "dbg" index was read from, 0 if none */
+	uint32_t debug_path_hash;
+	uint64_t debug_size;
+	uint64_t debug_mtime;
+};
+
+struct symcache_sym {
+	uint64_t value;
+	uint32_t name;		/* offset in the string table */
+	uint32_t reserved;
+};
+
+struct symcache {
+	/* index file, NULL if the library is not indexed */
+	char *path;
+	uint64_t file_size, file_mtime;
+	uint32_t debug_path_hash;
+	uint64_t debug_size, debug_mtime;
+	uint32_t flags;
+	unsigned int match_hash;
+	int (*match)(const char *name);
+
+	/* mapped index file */
+	void *map;
+	size_t map_size;
+
+	struct symcache_sym *syms;
+	uint32_t nsyms, syms_alloc;
+	char *strtab;
+	uint32_t strtab_size, strtab_alloc;
+	uint32_t *matches;
+	uint32_t nmatches;
+	int own_matches;
+};
+
+static char *cache_dir;
+
+static int make_dirs(char *path)
+{
+	char *p;
+
+	for (p = path + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+			*p = '/';
+			return -1;
+		}
+		*p = '/';
+	}
+	if (mkdir(path, 0755) == -1 && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+void symcache_init(void)
+{
+	const char *dir = arguments.symbol_cache, *base;
+	char path[PATH_MAX];
+
+	if (dir != NULL && strcmp(dir, "none") == 0)
+		return;
+	if (dir == NULL) {
+		if ((base = getenv("XDG_CACHE_HOME")) != NULL && *base)
+			snprintf(path, sizeof(path), "%s/functracer", base);
+		else if ((base = getenv("HOME")) != NULL && *base)
+			snprintf(path, sizeof(path), "%s/.cache/functracer", base);
+		else
+			return;
+	} else {
+		snprintf(path, sizeof(path), "%s", dir);
+	}
+	if (make_dirs(path) == -1 || access(path, W_OK | X_OK) == -1) {
+		debug(1, "symbol index disabled, no access to %s: %s", path,
+		      strerror(errno));
+		errno = 0;
+		return;
+	}
+	cache_dir = xstrdup(path);
+	debug(1, "symbol index directory %s", cache_dir);
+}
+
+void symcache_finish(void)
+{
+	free(cache_dir);
+	cache_dir = NULL;
+}
+
+/* Reads the GNU build-id note of the ELF file as a hex string. */
+static int read_build_id(int fd, char *hex)
+{
+	ElfW(Ehdr) ehdr;
+	ElfW(Phdr) phdr;
+	ElfW(Nhdr) *nhdr;
+	char *notes, *p;
+	size_t off, size;
+	int i, j, ret = -1;
+
+	if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) ||
+	    memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 ||
+	    ehdr.e_ident[EI_CLASS] != ELF_NATIVE_CLASS ||
+	    ehdr.e_phentsize != sizeof(phdr))
+		return -1;
+	for (i = 0; i < ehdr.e_phnum && ret == -1; i++) {
+		if (pread(fd, &phdr, sizeof(phdr), ehdr.e_phoff + i * sizeof(phdr)) !=
+		    sizeof(phdr))
+			return -1;
+		if (phdr.p_type != PT_NOTE || phdr.p_filesz > NOTES_MAX)
+			continue;
+		size = phdr.p_filesz;
+		notes = xmalloc(size);
+		if (pread(fd, notes, size, phdr.p_offset) != (ssize_t)size) {
+			free(notes);
+			return -1;
+		}
+		for (off = 0; off + sizeof(*nhdr) <= size; ) {
+			nhdr = (ElfW(Nhdr) *)(notes + off);
+			p = notes + off + sizeof(*nhdr);
+			off += sizeof(*nhdr) + ((nhdr->n_namesz + 3) & ~3) +
+				((nhdr->n_descsz + 3) & ~3);
+			if (off > size)
+				break;
+			if (nhdr->n_type != NT_GNU_BUILD_ID || nhdr->n_namesz != 4 ||
+			    memcmp(p, "GNU", 4) != 0 || nhdr->n_descsz == 0 ||
+			    nhdr->n_descsz > BUILD_ID_MAX)
+				continue;
+			p += 4;
+			for (j = 0; j < (int)nhdr->n_descsz; j++)
+				sprintf(hex + 2 * j, "%02x", (unsigned char)p[j]);
+			ret = 0;
+			break;
+		}
+		free(notes);
+	}
+	return ret;
+}
+
+/* Identifies the separate debug file of the library, which the "dbg"
+ * index depends on too. */
+static void debug_file_identity(struct symcache *sc, const char *filename)
+{
+	struct elf_file *ef;
+	char path[PATH_MAX];
+	struct stat st;
+
+	ef = elf_open(filename);
+	if (ef == NULL)
+		return;
+	if (elf_find_debug(ef, filename, path, sizeof(path)) == 0 &&
+	    stat(path, &st) == 0) {
+		sc->debug_path_hash = dict_key2hash_string(path);
+		sc->debug_size = st.st_size;
+		sc->debug_mtime = st.st_mtime;
+	}
+	elf_close(ef);
+}
+
+struct symcache *symcache_open(const char *filename, int debug,
+			       unsigned int match_hash,
+			       int (*match)(const char *name))
+{
+	struct symcache *sc = xcalloc(1, sizeof(struct symcache));
+	char build_id[2 * BUILD_ID_MAX + 1], path[PATH_MAX];
+	const char *suffix = debug ? "dbg" : "dyn";
+	struct stat st;
+	int fd;
+
+	sc->match_hash = match_hash;
+	sc->match = match;
+	if (cache_dir == NULL)
+		return sc;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		if (fd != -1)
+			close(fd);
+		errno = 0;
+		return sc;
+	}
+	sc->file_size = st.st_size;
+	sc->file_mtime = st.st_mtime;
+	if (read_build_id(fd, build_id) == 0)
+		snprintf(path, sizeof(path), "%s/%s.%s", cache_dir, build_id, suffix);
+	else
+		snprintf(path, sizeof(path), "%s/%llx-%llx.%s", cache_dir,
+			 (unsigned long long)st.st_dev,
+			 (unsigned long long)st.st_ino, suffix);
+	close(fd);
+	sc->path = xstrdup(path);
+	if (debug)
+		debug_file_identity(sc, filename);
+
+	return sc;
+}
+
+static void match_symbols(struct symcache *sc)
+{
+	uint32_t i;
+
+	if (sc->own_matches)
+		free(sc->matches);
+	sc->matches = NULL;
+	sc->nmatches = 0;
+	sc->own_matches = 1;
+	for (i = 0; i < sc->nsyms; i++) {
+		if (!sc->match(sc->strtab + sc->syms[i].name))
+			continue;
+		sc->matches = xrealloc(sc->matches,
+				       (sc->nmatches + 1) * sizeof(uint32_t));
+		sc->matches[sc->nmatches++] = i;
+	}
+}
+
+static int write_all(int fd, const void *buf, size_t count)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (count > 0) {
+		n = write(fd, p, count);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		count -= n;
+	}
+	return 0;
+}
+
+/* Writes the index into a temporary file, which then replaces the index
+ * file, so that concurrent runs never see a partial index. */
+static void write_index(struct symcache *sc)
+{
+	struct symcache_header header;
+	char *tmp;
+	int fd;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = SYMCACHE_MAGIC;
+	header.version = SYMCACHE_VERSION;
+	header.flags = sc->flags;
+	header.match_hash = sc->match_hash;
+	header.file_size = sc->file_size;
+	header.file_mtime = sc->file_mtime;
+	header.debug_path_hash = sc->debug_path_hash;
+	header.debug_size = sc->debug_size;
+	header.debug_mtime = sc->debug_mtime;
+	header.nsyms = sc->nsyms;
+	header.nmatches = sc->nmatches;
+	header.strtab_size = sc->strtab_size;
+
+	errno = 0;
+	tmp = xmalloc(strlen(sc->path) + 8);
+	sprintf(tmp, "%s.XXXXXX", sc->path);
+	fd = mkstemp(tmp);
+	if (fd == -1)
+		goto out;
+	if (write_all(fd, &header, sizeof(header)) == -1 ||
+	    write_all(fd, sc->syms, sc->nsyms * sizeof(struct symcache_sym)) == -1 ||
+	    write_all(fd, sc->matches, sc->nmatches * sizeof(uint32_t)) == -1 ||
+	    write_all(fd, sc->strtab, sc->strtab_size) == -1 ||
+	    fchmod(fd, 0644) == -1) {
+		close(fd);
+		unlink(tmp);
+		goto out;
+	}
+	if (close(fd) == -1 || rename(tmp, sc->path) == -1) {
+		unlink(tmp);
+		goto out;
+	}
+	debug(2, "indexed %u symbols to %s", sc->nsyms, sc->path);
+out:
+	if (errno) {
+		debug(1, "could not write symbol index %s: %s", sc->path,
+		      strerror(errno));
+		errno = 0;
+	}
+	free(tmp);
+}
+
+int symcache_load(struct symcache *sc)
+{
+	struct symcache_header *header;
+	struct stat st;
+	size_t size;
+	int fd;
+
+	if (sc->path == NULL)
+		return -1;
+	fd = open(sc->path, O_RDONLY);
+	if (fd == -1) {
+		errno = 0;
+		return -1;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*header)) {
+		close(fd);
+		errno = 0;
+		return -1;
+	}
+	sc->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (sc->map == MAP_FAILED) {
+		sc->map = NULL;
+		errno = 0;
+		return -1;
+	}
+	sc->map_size = st.st_size;
+
+	header = sc->map;
+	if (header->magic != SYMCACHE_MAGIC ||
+	    header->version != SYMCACHE_VERSION ||
+	    header->file_size != sc->file_size ||
+	    header->file_mtime != sc->file_mtime ||
+	    header->debug_path_hash != sc->debug_path_hash ||
+	    header->debug_size != sc->debug_size ||
+	    header->debug_mtime != sc->debug_mtime ||
+	    header->nsyms > sc->map_size / sizeof(struct symcache_sym) ||
+	    header->nmatches > header->nsyms ||
+	    header->strtab_size == 0 || header->strtab_size > sc->map_size)
+		goto stale;
+	size = sizeof(*header) + header->nsyms * sizeof(struct symcache_sym) +
+		header->nmatches * sizeof(uint32_t) + header->strtab_size;
+	if (size != sc->map_size || ((char *)sc->map)[size - 1] != '\0')
+		goto stale;
+	sc->flags = header->flags;
+	sc->nsyms = header->nsyms;
+	sc->syms = (struct symcache_sym *)(header + 1);
+	sc->matches = (uint32_t *)(sc->syms + sc->nsyms);
+	sc->nmatches = header->nmatches;
+	sc->strtab = (char *)(sc->matches + sc->nmatches);
+	sc->strtab_size = header->strtab_size;
+
+	if (header->match_hash != sc->match_hash) {
+		debug(2, "rematching symbols of %s", sc->path);
+		match_symbols(sc);
+		write_index(sc);
+	}
+	debug(2, "%u symbols, %u matches from %s", sc->nsyms, sc->nmatches,
+	      sc->path);
+	if (arguments.verbose)
+		fprintf(stderr, "Loaded symbol index %s\n", sc->path);
+	return 0;
+
+stale:
+	debug(2, "stale symbol index %s", sc->path);
+	munmap(sc->map, sc->map_size);
+	sc->map = NULL;
+	return -1;
+}
+
+void symcache_add(struct symcache *sc, const char *name, addr_t value)
+{
+	size_t len = strlen(name) + 1;
+
+	if (sc->nsyms == sc->syms_alloc) {
+		sc->syms_alloc = sc->syms_alloc ? sc->syms_alloc * 2 : 256;
+		sc->syms = xrealloc(sc->syms,
+				    sc->syms_alloc * sizeof(struct symcache_sym));
+	}
+	while (sc->strtab_size + len > sc->strtab_alloc) {
+		sc->strtab_alloc = sc->strtab_alloc ? sc->strtab_alloc * 2 : 4096;
+		sc->strtab = xrealloc(sc->strtab, sc->strtab_alloc);
+	}
+	sc->syms[sc->nsyms].value = value;
+	sc->syms[sc->nsyms].name = sc->strtab_size;
+	sc->syms[sc->nsyms].reserved = 0;
+	sc->nsyms++;
+	memcpy(sc->strtab + sc->strtab_size, name, len);
+	sc->strtab_size += len;
+}
+
+void symcache_save(struct symcache *sc, int prelinked)
+{
+	sc->flags = prelinked ? SYMCACHE_PRELINKED : 0;
+	match_symbols(sc);
+	if (sc->path == NULL)
+		return;
+	/* the string table is never empty in a valid index */
+	if (sc->strtab_size == 0) {
+		sc->strtab = xrealloc(sc->strtab, 1);
+		sc->strtab[0] = '\0';
+		sc->strtab_size = sc->strtab_alloc = 1;
+	}
+	write_index(sc);
+}
+
+int symcache_prelinked(struct symcache *sc)
+{
+	return (sc->flags & SYMCACHE_PRELINKED) != 0;
+}
+
+void symcache_for_each_match(struct symcache *sc,
+		void (*func)(const char *name, addr_t value, void *data),
+		void *data)
+{
+	struct symcache_sym *sym;
+	uint32_t i;
+
+	for (i = 0; i < sc->nmatches; i++) {
+		if (sc->matches[i] >= sc->nsyms)
+			continue;
+		sym = &sc->syms[sc->matches[i]];
+		if (sym->name >= sc->strtab_size)
+			continue;
+		func(sc->strtab + sym->name, (addr_t)sym->value, data);
+	}
+}
+
+void symcache_close(struct symcache *sc)
+{
+	if (sc->own_matches)
+		free(sc->matches);
+	if (sc->map) {
+		munmap(sc->map, sc->map_size);
+	} else {
+		free(sc->syms);
+		free(sc->strtab);
+	}
+	free(sc->path);
+	free(sc);
+}
@@ -44,6 +44,8 @@ struct syscall_data *get_syscall_data(__attribute__((unused)) struct process *pr
 int get_syscall_nr(struct process *proc, int *nr)
 {
 	*nr = trace_user_readw(proc, 4 * ORIG_EAX);
+	/* in_syscall is also set on the seccomp stop, when the kernel does
+	 * not stop on the entry of the syscall, see seccomp_syscall_enter() */
 	if (proc->in_syscall) {
 		proc->in_syscall = 0;
 		return 2;
@@ -22,83 +22,424 @@
  *
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <libiberty.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <wchar.h>
+#include <sys/procfs.h>
 #include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
 #include "process.h"
 
+#include "arch-defs.h"
 #include "debug.h"
+#include "sample.h"
 #include "target_mem.h"
 #include "util.h"
 
 #define WORD_SIZE	sizeof(long)
 
-long trace_mem_readw(struct process *proc, addr_t addr)
+/* maximum number of bytes read at once when looking for string end */
+#define STR_CHUNK_SIZE	1024
+
+/* older C-library headers don't have it */
+#ifndef __NR_process_vm_readv
+# if defined(ARCH_ARM)
+#  define __NR_process_vm_readv	376
+# else
+#  define __NR_process_vm_readv	347
+# endif
+#endif
+
+/* number of tracee pages cached per stop */
+#define PAGE_CACHE_SIZE	8
+
+/* cleared if the kernel doesn't support process_vm_readv() */
+static int vm_readv_supported = 1;
+
+static long page_size;
+
+static void page_size_init(void)
 {
-	return xptrace(PTRACE_PEEKTEXT, proc->pid, (void *)addr, NULL);
+	if (page_size == 0)
+		page_size = sysconf(_SC_PAGESIZE);
 }
 
-void trace_mem_writew(struct process *proc, addr_t addr, long w)
+/*
+ * Tracee pages read since the last stop. Word reads (stack, function
+ * arguments) and the libunwind memory accessor go through the cache, so
+ * that unwinding the stack costs a few page reads instead of a ptrace call
+ * per word. Bulk reads don't use it, as other threads of the process may
+ * modify the code (breakpoints) while this one is stopped. The cache is
+ * dropped when the memory has been written through another thread.
+ */
+struct page_cache {
+	addr_t addr[PAGE_CACHE_SIZE];
+	unsigned int valid;
+	/* process_shared mem_writes when the pages were read */
+	unsigned int writes;
+	/* next entry to be replaced */
+	int next;
+	unsigned char *data;
+};
+
+static int trace_regs_fetch(struct process *proc)
 {
-	xptrace(PTRACE_POKETEXT, proc->pid, (void *)addr, (void *)w);
+	if (proc->regs_cached)
+		return 0;
+	if (xptrace(PTRACE_GETREGS, proc->pid, NULL, &proc->regs) == -1)
+		return -1;
+	proc->regs_cached = 1;
+	return 0;
+}
+
+/* Checks if the user area offset is within the general registers, which
+ * are at the start of the user area in the PTRACE_GETREGS layout. */
+static int is_reg_offset(long offset)
+{
+	return offset >= 0 && offset < (long)sizeof(elf_gregset_t) &&
+		offset % sizeof(elf_greg_t) == 0;
+}
+
+void trace_regs_flush(struct process *proc)
+{
+	if (proc->regs_dirty) {
+		xptrace(PTRACE_SETREGS, proc->pid, NULL, &proc->regs);
+		proc->regs_dirty = 0;
+	}
+	proc->regs_cached = 0;
 }
 
 long trace_user_readw(struct process *proc, long offset)
 {
+	if (proc->sample)
+		return sample_user_readw(proc->sample, offset);
+	if (is_reg_offset(offset) && trace_regs_fetch(proc) == 0)
+		return ((elf_greg_t *)&proc->regs)[offset / sizeof(elf_greg_t)];
 	return xptrace(PTRACE_PEEKUSER, proc->pid, (void *)offset, NULL);
 }
 
 void trace_user_writew(struct process *proc, long offset, long w)
 {
+	if (is_reg_offset(offset) && trace_regs_fetch(proc) == 0) {
+		((elf_greg_t *)&proc->regs)[offset / sizeof(elf_greg_t)] = w;
+		proc->regs_dirty = 1;
+		return;
+	}
 	xptrace(PTRACE_POKEUSER, proc->pid, (void *)offset, (void *)w);
 }
 
-static void trace_mem_io(struct process *proc, addr_t addr, void *buf, size_t count, int write)
+/* Returns /proc/PID/mem of the process, opening it on the first use. */
+static int trace_mem_fd(struct process *proc)
 {
-	long w;
-	unsigned int i, j;
-	unsigned char *buf_bytes = buf;
-	unsigned char *w_bytes = (unsigned char *)&w;
-
-	debug(4, "trace_mem_io(pid=%d, addr=0x%x, buf=%p, count=%d, write=%d", proc->pid, addr, buf, count, write);
-	for (i = 0; i < 1 + ((count - 1) / WORD_SIZE); i++) {
-		w = trace_mem_readw(proc, addr + i * WORD_SIZE);
-		debug(5, "trace_mem_io (read): w = 0x%08lx", w);
-		for (j = 0; j < WORD_SIZE && i * WORD_SIZE + j < count; j++) {
-			if (write)
-				w_bytes[j] = buf_bytes[i * WORD_SIZE + j];
-			else
-				buf_bytes[i * WORD_SIZE + j] = w_bytes[j];
-		}
-		if (write) {
-			trace_mem_writew(proc, addr + i * WORD_SIZE, w);
-			debug(4, "trace_mem_io (write): w = 0x%08lx", w);
+	char path[64];
+
+	if (proc->mem_fd == -1) {
+		snprintf(path, sizeof(path), "/proc/%d/mem", proc->pid);
+		proc->mem_fd = open(path, O_RDWR);
+		if (proc->mem_fd < 0) {
+			debug(1, "could not open %s: %s", path, strerror(errno));
+			/* don't try again */
+			proc->mem_fd = -2;
 		}
 	}
+	return proc->mem_fd;
+}
+
+void trace_mem_close(struct process *proc)
+{
+	if (proc->mem_fd >= 0)
+		close(proc->mem_fd);
+	proc->mem_fd = -1;
+	if (proc->page_cache) {
+		free(proc->page_cache->data);
+		free(proc->page_cache);
+		proc->page_cache = NULL;
+	}
+}
+
+static unsigned char *page_cache_data(struct page_cache *pc, int i)
+{
+	return pc->data + i * page_size;
+}
+
+/* Returns the cached page, reading it and the following page (where the
+ * stack usually continues) with one system call on a cache miss. */
+static unsigned char *page_cache_get(struct process *proc, addr_t page)
+{
+	struct page_cache *pc = proc->page_cache;
+	struct iovec local[2], remote[2];
+	long n = -1;
+	int i, j, fd;
+
+	if (pc == NULL) {
+		pc = xcalloc(1, sizeof(struct page_cache));
+		pc->data = xmalloc(PAGE_CACHE_SIZE * page_size);
+		proc->page_cache = pc;
+	}
+	/* the workers tracing the other threads may have written */
+	if (proc->shared && pc->writes != proc->shared->mem_writes) {
+		pc->writes = proc->shared->mem_writes;
+		pc->valid = 0;
+	}
+	for (i = 0; i < PAGE_CACHE_SIZE; i++) {
+		if ((pc->valid & (1U << i)) && pc->addr[i] == page)
+			return page_cache_data(pc, i);
+	}
+
+	i = pc->next;
+	j = (i + 1) % PAGE_CACHE_SIZE;
+	pc->valid &= ~((1U << i) | (1U << j));
+	if (vm_readv_supported) {
+		local[0].iov_base = page_cache_data(pc, i);
+		local[1].iov_base = page_cache_data(pc, j);
+		local[0].iov_len = local[1].iov_len = page_size;
+		remote[0].iov_base = (void *)page;
+		remote[1].iov_base = (void *)(page + page_size);
+		remote[0].iov_len = remote[1].iov_len = page_size;
+		n = syscall(__NR_process_vm_readv, proc->pid, local, 2,
+			    remote, 2, 0);
+		if (n < 0 && errno == ENOSYS)
+			vm_readv_supported = 0;
+	}
+	if (n < page_size) {
+		fd = trace_mem_fd(proc);
+		if (fd < 0 || pread64(fd, page_cache_data(pc, i), page_size,
+				      (off64_t)page) != page_size)
+			return NULL;
+		n = page_size;
+	}
+	pc->addr[i] = page;
+	pc->valid |= 1U << i;
+	if (n == 2 * page_size) {
+		pc->addr[j] = page + page_size;
+		pc->valid |= 1U << j;
+	}
+	pc->next = (i + 2) % PAGE_CACHE_SIZE;
+
+	return page_cache_data(pc, i);
+}
+
+/* Keeps the cached pages up to date with the memory written, and makes
+ * the other threads drop theirs. */
+static void page_cache_update(struct process *proc, addr_t addr,
+			      const void *buf, size_t count)
+{
+	struct page_cache *pc = proc->page_cache;
+	addr_t start, end;
+	unsigned int writes;
+	int i;
+
+	if (proc->shared) {
+		writes = __sync_fetch_and_add(&proc->shared->mem_writes, 1);
+		/* not written by the others since read */
+		if (pc && pc->writes == writes)
+			pc->writes = writes + 1;
+	}
+	if (pc == NULL)
+		return;
+	for (i = 0; i < PAGE_CACHE_SIZE; i++) {
+		if (!(pc->valid & (1U << i)))
+			continue;
+		start = addr > pc->addr[i] ? addr : pc->addr[i];
+		end = addr + count < pc->addr[i] + page_size ?
+			addr + count : pc->addr[i] + page_size;
+		if (start < end)
+			memcpy(page_cache_data(pc, i) + (start - pc->addr[i]),
+			       (const unsigned char *)buf + (start - addr),
+			       end - start);
+	}
+}
+
+void trace_flush(struct process *proc)
+{
+	trace_regs_flush(proc);
+	if (proc->page_cache)
+		proc->page_cache->valid = 0;
+}
+
+int trace_mem_peek(struct process *proc, addr_t addr, long *w)
+{
+	addr_t page;
+	unsigned char *data;
+
+	if (proc->sample)
+		return sample_mem_read(proc->sample, addr, w, sizeof(*w));
+	page_size_init();
+	page = addr & ~(page_size - 1);
+	if (addr - page <= page_size - WORD_SIZE &&
+	    (data = page_cache_get(proc, page)) != NULL) {
+		memcpy(w, data + (addr - page), WORD_SIZE);
+		return 0;
+	}
+	/* not cached, e.g. the word crosses a page boundary */
+	errno = 0;
+	*w = ptrace(PTRACE_PEEKTEXT, proc->pid, (void *)addr, NULL);
+	return errno ? -1 : 0;
+}
+
+long trace_mem_readw(struct process *proc, addr_t addr)
+{
+	long w;
+
+	if (proc->sample)
+		return sample_mem_readw(proc->sample, addr);
+	if (trace_mem_peek(proc, addr, &w) == 0)
+		return w;
+	/* reports the error */
+	return xptrace(PTRACE_PEEKTEXT, proc->pid, (void *)addr, NULL);
+}
+
+void trace_mem_writew(struct process *proc, addr_t addr, long w)
+{
+	xptrace(PTRACE_POKETEXT, proc->pid, (void *)addr, (void *)w);
+	page_cache_update(proc, addr, &w, sizeof(w));
+}
+
+/* Reads the memory with as few system calls as possible. Falls back from
+ * process_vm_readv() to /proc/PID/mem, and returns -1 if both fail so
+ * that the caller can still try word by word with ptrace. */
+static int trace_mem_read_bulk(struct process *proc, addr_t addr, void *buf,
+			       size_t count)
+{
+	struct iovec local, remote;
+	int fd;
+
+	if (proc->sample)
+		return sample_mem_read(proc->sample, addr, buf, count);
+
+	if (vm_readv_supported) {
+		local.iov_base = buf;
+		local.iov_len = count;
+		remote.iov_base = (void *)addr;
+		remote.iov_len = count;
+		if (syscall(__NR_process_vm_readv, proc->pid, &local, 1,
+			    &remote, 1, 0) == (long)count)
+			return 0;
+		if (errno == ENOSYS)
+			vm_readv_supported = 0;
+	}
+	/* also reads the pages that are not readable by the process */
+	fd = trace_mem_fd(proc);
+	if (fd >= 0 && pread64(fd, buf, count, (off64_t)addr) == (ssize_t)count)
+		return 0;
+
+	return -1;
+}
+
+/* Writes the memory through /proc/PID/mem, which can also write the
+ * read-only text pages of the traced process. */
+static int trace_mem_write_bulk(struct process *proc, addr_t addr,
+				const void *buf, size_t count)
+{
+	int fd = trace_mem_fd(proc);
+
+	if (fd >= 0 && pwrite64(fd, buf, count, (off64_t)addr) == (ssize_t)count) {
+		page_cache_update(proc, addr, buf, count);
+		return 0;
+	}
+
+	return -1;
+}
+
+/* Returns the number of bytes that can be read from the address without
+ * crossing a page boundary, at most STR_CHUNK_SIZE. */
+static size_t str_chunk_size(addr_t addr)
+{
+	size_t left;
+
+	page_size_init();
+	left = page_size - (addr & (page_size - 1));
+
+	return left < STR_CHUNK_SIZE ? left : STR_CHUNK_SIZE;
+}
+
+/* word by word fallback of trace_mem_read() */
+static void trace_mem_read_words(struct process *proc, addr_t addr, void *buf,
+				 size_t count)
+{
+	unsigned char *dst_bytes = buf;
+	long w;
+	size_t i, n;
+
+	debug(4, "trace_mem_read_words(pid=%d, addr=0x%x, buf=%p, count=%d)", proc->pid, addr, buf, count);
+	for (i = 0; i < count; i += WORD_SIZE) {
+		if (proc->sample)
+			w = sample_mem_readw(proc->sample, addr + i);
+		else
+			w = xptrace(PTRACE_PEEKTEXT, proc->pid,
+				    (void *)(addr + i), NULL);
+		debug(5, "trace_mem_read_words: w = 0x%08lx", w);
+		n = count - i < WORD_SIZE ? count - i : WORD_SIZE;
+		memcpy(dst_bytes + i, &w, n);
+	}
+}
+
+/* word by word fallback of trace_mem_write() */
+static void trace_mem_write_words(struct process *proc, addr_t addr,
+				  const void *buf, size_t count)
+{
+	const unsigned char *src_bytes = buf;
+	long w;
+	size_t i, n;
+
+	debug(4, "trace_mem_write_words(pid=%d, addr=0x%x, buf=%p, count=%d)", proc->pid, addr, buf, count);
+	for (i = 0; i < count; i += WORD_SIZE) {
+		n = count - i < WORD_SIZE ? count - i : WORD_SIZE;
+		/* the bytes after the buffer are kept */
+		if (n < WORD_SIZE)
+			w = xptrace(PTRACE_PEEKTEXT, proc->pid,
+				    (void *)(addr + i), NULL);
+		memcpy(&w, src_bytes + i, n);
+		trace_mem_writew(proc, addr + i, w);
+		debug(4, "trace_mem_write_words: w = 0x%08lx", w);
+	}
 }
 
 void trace_mem_read(struct process *proc, addr_t addr, void *buf, size_t count)
 {
-	trace_mem_io(proc, addr, buf, count, 0);
+	if (count == 0 || trace_mem_read_bulk(proc, addr, buf, count) == 0)
+		return;
+	trace_mem_read_words(proc, addr, buf, count);
 }
 
 void trace_mem_write(struct process *proc, addr_t addr, const void *buf, size_t count)
 {
-	trace_mem_io(proc, addr, buf, count, 1);
+	if (count == 0 || trace_mem_write_bulk(proc, addr, buf, count) == 0)
+		return;
+	trace_mem_write_words(proc, addr, buf, count);
 }
 
 void trace_getregs(struct process *proc, void *regs)
 {
-	xptrace(PTRACE_GETREGS, proc->pid, NULL, regs);
+	if (proc->sample) {
+		memcpy(regs, &proc->sample->regs, sizeof(proc->sample->regs));
+		return;
+	}
+	if (trace_regs_fetch(proc) == 0)
+		memcpy(regs, &proc->regs, sizeof(proc->regs));
 }
 
 void trace_setregs(struct process *proc, void *regs)
 {
-	xptrace(PTRACE_SETREGS, proc->pid, NULL, regs);
+	/* written through, the cached registers are replaced */
+	memcpy(&proc->regs, regs, sizeof(proc->regs));
+	proc->regs_dirty = 0;
+	if (xptrace(PTRACE_SETREGS, proc->pid, NULL, regs) == -1)
+		proc->regs_cached = 0;
+	else
+		proc->regs_cached = 1;
 }
 
-size_t trace_mem_readstr(struct process* proc, size_t addr, char* buffer, size_t size)
+/* word by word fallback of trace_mem_readstr() */
+static size_t trace_mem_readstr_words(struct process* proc, size_t addr, char* buffer, size_t size)
 {
 	int bytes = 0;
 	unsigned char c = 0xff;
@@ -121,11 +462,8 @@ size_t trace_mem_readstr(struct process* proc, size_t addr, char* buffer, size_t
 	return bytes+1;
 }
 
-/* copies wide string if buffer given, buffer size is in wide chars.
- * returns number of read wide chars, _including_ terminator.
- * If string was copied, it will be terminated, clipped if necessary.
- */
-size_t trace_mem_readwstr(struct process* proc, size_t addr, wchar_t* buffer, size_t size)
+/* word by word fallback of trace_mem_readwstr() */
+static size_t trace_mem_readwstr_words(struct process* proc, size_t addr, wchar_t* buffer, size_t size)
 {
 	int bytes = 0;
 	int c = 0xff;
@@ -141,3 +479,77 @@ size_t trace_mem_readwstr(struct process* proc, size_t addr, wchar_t* buffer, si
 	return bytes+1;
 }
 
+/* Copies string if buffer given, reading it in page bounded chunks.
+ * Returns the string length, _including_ terminator.
+ * If string was copied, it will be terminated, clipped if necessary.
+ */
+size_t trace_mem_readstr(struct process* proc, size_t addr, char* buffer, size_t size)
+{
+	char chunk[STR_CHUNK_SIZE], *end;
+	size_t len = 0, n, copy;
+
+	for (;;) {
+		n = str_chunk_size(addr + len);
+		if (trace_mem_read_bulk(proc, addr + len, chunk, n) < 0) {
+			if (len)
+				break;
+			return trace_mem_readstr_words(proc, addr, buffer, size);
+		}
+		end = memchr(chunk, '\0', n);
+		if (end)
+			n = end - chunk;
+		if (buffer && size && len < size - 1) {
+			copy = size - 1 - len < n ? size - 1 - len : n;
+			memcpy(buffer + len, chunk, copy);
+		}
+		len += n;
+		if (end)
+			break;
+	}
+	if (size)
+		buffer[len < size - 1 ? len : size - 1] = '\0';
+	return len + 1;
+}
+
+/* copies wide string if buffer given, buffer size is in wide chars.
+ * returns number of read wide chars, _including_ terminator.
+ * If string was copied, it will be terminated, clipped if necessary.
+ */
+size_t trace_mem_readwstr(struct process* proc, size_t addr, wchar_t* buffer, size_t size)
+{
+	wchar_t chunk[STR_CHUNK_SIZE / sizeof(wchar_t)];
+	size_t len = 0, n, whole, i, copy;
+	addr_t pos;
+	int found = 0;
+
+	for (;;) {
+		pos = addr + len * sizeof(wchar_t);
+		/* An unaligned string has a wide char crossing the page
+		 * boundary, read with the next page if it is readable. */
+		whole = str_chunk_size(pos) / sizeof(wchar_t);
+		n = (str_chunk_size(pos) + sizeof(wchar_t) - 1) / sizeof(wchar_t);
+		if (trace_mem_read_bulk(proc, pos, chunk, n * sizeof(wchar_t)) < 0 &&
+		    (n == whole || whole == 0 ||
+		     trace_mem_read_bulk(proc, pos, chunk, (n = whole) * sizeof(wchar_t)) < 0)) {
+			if (len)
+				break;
+			return trace_mem_readwstr_words(proc, addr, buffer, size);
+		}
+		for (i = 0; i < n; i++) {
+			if (chunk[i] == L'\0') {
+				found = 1;
+				break;
+			}
+		}
+		if (buffer && size && len < size - 1) {
+			copy = size - 1 - len < i ? size - 1 - len : i;
+			memcpy(buffer + len, chunk, copy * sizeof(wchar_t));
+		}
+		len += i;
+		if (found)
+			break;
+	}
+	if (size)
+		buffer[len < size - 1 ? len : size - 1] = L'\0';
+	return len + 1;
+}
@@ -33,15 +33,28 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "agent.h"
 #include "breakpoint.h"
 #include "callback.h"
 #include "debug.h"
 #include "function.h"
 #include "process.h"
+#include "procfs.h"
+#include "seccomp.h"
 #include "syscall.h"
 #include "trace.h"
+#include "uprobe.h"
 #include "util.h"
 #include "options.h"
+#include "worker.h"
+
+/* how often (ms) the tracees are checked for ptrace events while the
+ * function calls are recorded without stopping them */
+#define POLL_TIMEOUT	10
+
+/* how long (s) a thread waits for its main thread to be attached by
+ * another worker */
+#define MAIN_THREAD_TIMEOUT	10
 
 struct event {
 	struct process *proc;
@@ -59,11 +72,12 @@ struct event {
 		EV_SIGNAL,	/* process received a signal */
 		EV_SYSCALL,	/* syscall entry */
 		EV_SYSRET,	/* syscall return */
+		EV_SECCOMP,	/* syscall stopped by seccomp filter */
 	} type;
 	union {
 		int retval;	/* EV_PRE_EXIT, EV_POST_EXIT */
 		int signo;	/* EV_SIGNAL, EV_EXIT_SIGNAL */
-		int sysno;	/* EV_SYSCALL, EV_SYSRET */
+		int sysno;	/* EV_SYSCALL, EV_SYSRET, EV_SECCOMP */
 		addr_t addr;	/* EV_BREAKPOINT */
 		pid_t pid;	/* EV_NEW_PROC, EV_FORK, EV_EXEC */
 	} data;
@@ -84,12 +98,46 @@ pid_t ft_waitpid(pid_t pid, int *status, int options)
 	return pid2;
 }
 
+/* Reports the function calls recorded without stopping the tracees. */
+static void read_recorded_calls(void)
+{
+	uprobe_read_samples();
+	agent_read_records();
+}
+
+/* Waits for a ptrace event while reporting the function calls recorded
+ * meanwhile by the uprobes or by the agent. */
+static pid_t poll_waitpid(int *status)
+{
+	pid_t pid;
+	int saved_errno;
+
+	for (;;) {
+		read_recorded_calls();
+		pid = ft_waitpid(-1, status, __WALL | __WNOTHREAD | WNOHANG);
+		if (pid != 0)
+			break;
+		uprobe_poll(POLL_TIMEOUT);
+	}
+	/* report the calls made before the ptrace event */
+	saved_errno = errno;
+	read_recorded_calls();
+	errno = saved_errno;
+
+	return pid;
+}
+
 static int wait_for_event(struct event *event)
 {
 	pid_t pid;
 	int status;
 
-	pid = ft_waitpid(-1, &status, __WALL);
+	/* Only wait for the tracees of this worker, other workers have their
+	 * own event loops. */
+	if (uprobe_enabled() || agent_enabled())
+		pid = poll_waitpid(&status);
+	else
+		pid = ft_waitpid(-1, &status, __WALL | __WNOTHREAD);
 	if (pid == -1) {
 		if (errno == ECHILD) {
 			event->type = EV_NOCHILD;
@@ -122,6 +170,11 @@ static int wait_for_event(struct event *event)
 			event->type = EV_EXEC;
 			event->data.pid = pid;
 			break;
+		case PTRACE_EVENT_SECCOMP:
+			/* the filter passes the syscall number as event data */
+			event->type = EV_SECCOMP;
+			xptrace(PTRACE_GETEVENTMSG, pid, NULL, &event->data.sysno);
+			break;
 		default:
 			msg_err("unexpected ptrace() event %d", status >> 16);
 			return -1;
@@ -163,15 +216,23 @@ static void continue_process(struct process *proc)
 {
 	debug(3, "pid=%d", proc->pid);
 
+	trace_flush(proc);
 	if (proc->singlestep)
 		xptrace(FT_PTRACE_SINGLESTEP, proc->pid, NULL, NULL);
+	else if (proc->in_seccomp)
+		/* stop again on the exit of the seccomp traced syscall */
+		xptrace(PTRACE_SYSCALL, proc->pid, NULL, NULL);
 	else
 		xptrace(PTRACE_CONT, proc->pid, NULL, NULL);
 }
 
 static void continue_after_signal(struct process *proc, int signo)
 {
-	xptrace(PTRACE_CONT, proc->pid, NULL, (void *)signo);
+	trace_flush(proc);
+	if (proc->in_seccomp)
+		xptrace(PTRACE_SYSCALL, proc->pid, NULL, (void *)signo);
+	else
+		xptrace(PTRACE_CONT, proc->pid, NULL, (void *)signo);
 }
 
 static void trace_set_options(pid_t pid)
@@ -180,6 +241,8 @@ static void trace_set_options(pid_t pid)
 	    | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC
 	    | PTRACE_O_TRACEEXIT;
 
+	if (seccomp_enabled())
+		options |= PTRACE_O_TRACESECCOMP;
 	debug(3, "pid=%d", pid);
 	xptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)options);
 }
@@ -206,20 +269,24 @@ static int new_process(struct process *parent_proc, pid_t child_pid)
 	 * space with the parent (i.e. it is not a thread). This happens
 	 * because at the time the children was forked/cloned, the breakpoints
 	 * were enabled and were copied to the new process' address space.
-	 * Therefore, we disable these breakpoints for the new process. */
+	 * Therefore, the child gets a copy of the parent's breakpoint table
+	 * instead of setting up its own one. */
 	if (parent_proc && (child_proc->parent == NULL)) {
-		child_proc->shared = parent_proc->shared;
-		/* FIXME: should we call fn_callstack_restore() as done in
-		 * handle_interrupt() ? */
-		disable_all_breakpoints(child_proc);
-		child_proc->shared = NULL;
+		bkpt_fork(child_proc, parent_proc);
+		/* the child inherited the probes of the parent */
+		uprobe_fork(parent_proc, child_pid);
 		if (cb && cb->process.fork) {
 			/* Callback should be called only when child is not a
 			 * thread. */
 			cb->process.fork(parent_proc, child_pid);
 		}
-	} 
-	bkpt_init(child_proc);
+	} else {
+		bkpt_init(child_proc);
+	}
+	/* Threads traced by other workers may wait for the shared data of
+	 * this process. */
+	child_proc->initialized = 1;
+	worker_registry_notify();
 	trace_set_options(child_pid);
 	continue_process(child_proc);
 	return 0;
@@ -252,6 +319,31 @@ static int new_thread(pid_t tid, pid_t tgid)
 {
 	struct process *main_thread = process_from_pid(tgid);
 
+	/* Main thread attached by another worker is initialized by that
+	 * worker, so just wait for it. The wait ends also if the worker
+	 * could not attach it, or if it never stops after attaching (e.g.
+	 * when it has already exited). */
+	if (!main_thread && !worker_owns(tgid)) {
+		int waited = 0;
+
+		worker_registry_lock();
+		while (((main_thread = process_lookup(tgid)) == NULL ||
+			!main_thread->initialized) && !worker_failed(tgid) &&
+		       waited < MAIN_THREAD_TIMEOUT) {
+			if (worker_registry_wait(1) == ETIMEDOUT)
+				waited++;
+		}
+		if (main_thread && !main_thread->initialized)
+			main_thread = NULL;
+		worker_registry_unlock();
+		if (main_thread == NULL) {
+			msg_warn("main thread %d is not traced, detaching thread %d",
+				 tgid, tid);
+			trace_detach(tid);
+			return 0;
+		}
+	}
+
 	/* Make sure that main thread is already tracing */
 	if (!main_thread) {
 		/*
@@ -356,8 +448,10 @@ static void trace_finish(struct process *proc)
 		debug(2, "restore callstack");
 		fn_callstack_restore(proc, 1);
 	}
+	bkpt_leave_ssol(proc);
 	disable_all_breakpoints(proc);
 	bkpt_finish(proc);
+	trace_flush(proc);
 	trace_detach(proc->pid);
 }
 
@@ -385,6 +479,9 @@ static int dispatch_event(struct event *event)
 	case EV_EXEC:
 		free(event->proc->filename);
 		event->proc->filename = name_from_pid(event->proc->pid);
+		/* the descriptors refer to the old address space */
+		trace_mem_close(event->proc);
+		procfs_close(event->proc->pid);
 		if (cb && cb->process.exec)
 			cb->process.exec(event->proc);
 		bkpt_finish(event->proc);
@@ -421,6 +518,12 @@ static int dispatch_event(struct event *event)
 	case EV_SYSRET:
 		if (cb && cb->syscall.exit)
 			cb->syscall.exit(event->proc, event->data.sysno);
+		if (event->proc->in_seccomp)
+			seccomp_syscall_exit(event->proc);
+		continue_process(event->proc);
+		break;
+	case EV_SECCOMP:
+		seccomp_syscall_enter(event->proc);
 		continue_process(event->proc);
 		break;
 	case EV_BREAKPOINT:
@@ -479,6 +582,14 @@ int trace_execute(char *filename, char *argv[])
 			return -1;
 		}
 		xptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		if (seccomp_enabled() && seccomp_install() < 0) {
+			error_file(filename, "could not install seccomp filter");
+			return -1;
+		}
+		if (agent_enabled() && agent_setup_child() < 0) {
+			error_file(filename, "could not set up the agent");
+			return -1;
+		}
 		execvp(filename, argv);
 		error_file(filename, "could not execute program");
 		return -1;
@@ -487,9 +598,11 @@ int trace_execute(char *filename, char *argv[])
 	return pid;
 }
 
-static void trace_attach(pid_t pid)
+void trace_attach_thread(pid_t pid)
 {
-	xptrace(PTRACE_ATTACH, pid, NULL, NULL);
+	/* threads traced by other workers may wait for this one */
+	if (xptrace(PTRACE_ATTACH, pid, NULL, NULL) == -1)
+		worker_attach_failed(pid);
 }
 
 void trace_attach_child(pid_t pid)
@@ -511,7 +624,7 @@ void trace_attach_child(pid_t pid)
 			tid = atoi(dir_name->d_name);
 			if (tid <= 0)
 				continue;
-			trace_attach(tid);
+			trace_attach_thread(tid);
 		}
 		closedir(dir);
 	}
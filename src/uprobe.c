@@ -0,0 +1,775 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <libiberty.h>
+#include <linux/perf_event.h>
+#include <linux/ptrace.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arch-defs.h"
+#include "callback.h"
+#include "debug.h"
+#include "dict.h"
+#include "maps.h"
+#include "options.h"
+#include "process.h"
+#include "report.h"
+#include "sample.h"
+#include "solib.h"
+#include "uprobe.h"
+#include "util.h"
+
+#define UPROBE_PMU_DIR		"/sys/bus/event_source/devices/uprobe"
+
+/* ring buffer data size in pages (power of two) */
+#define RING_PAGES		64
+/* stack copied on the function entry, holds the stack arguments */
+#define ENTRY_STACK_SIZE	64
+/* stack copied on the function return, used for unwinding the backtrace */
+#define RETURN_STACK_SIZE	8192
+
+/* user area offsets of the perf user registers */
+#if defined(ARCH_ARM)
+static const int perf_reg_offset[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+#define SP_OFFSET	13
+#else
+static const int perf_reg_offset[] = {
+	EAX, EBX, ECX, EDX, ESI, EDI, EBP, UESP,
+	EIP, EFL, CS, SS, DS, ES, FS, GS,
+};
+#define SP_OFFSET	UESP
+#endif
+
+struct uprobe {
+	char *symbol;
+	int retprobe;
+	struct uprobe *next;
+};
+
+/* Function probed in a process. The probes are inherited by the threads
+ * and by the children forked afterwards, and they stay in place after
+ * exec(), so each function is probed only once per process. The system
+ * wide probes are kept in the set of PID -1 and shared by all the traced
+ * processes. */
+struct uprobe_key {
+	char *path;
+	unsigned long offset;
+	struct uprobe_key *next;
+};
+
+struct uprobe_set {
+	pid_t pid;
+	struct uprobe_key *keys;
+	struct uprobe_set *next;
+};
+
+/* per-CPU ring buffer shared by all the probe events of the CPU */
+struct uprobe_ring {
+	int fd;
+	void *base;
+};
+
+/* function call read from the ring buffers, not yet reported */
+struct uprobe_sample {
+	uint64_t time;
+	pid_t tid;
+	struct uprobe *probe;
+	elf_gregset_t regs;
+	unsigned char *stack;
+	size_t stack_size;
+};
+
+static int pmu_type = -1;
+static int retprobe_bit;
+static long page_size;
+static int ncpus;
+static struct uprobe_ring *rings;
+static struct pollfd *pollfds;
+static int npollfds;
+
+/* sample id -> struct uprobe */
+static struct dict *probes;
+static struct uprobe *probe_list;
+static int *event_fds;
+static int nevent_fds;
+static struct uprobe_set *sets;
+/* Probes are opened on every CPU for all the processes when requested
+ * with --uprobes-system-wide, so that the traced processes share the events
+ * instead of opening their own ones. Cleared if the system wide events are
+ * not permitted. */
+static int system_wide;
+
+static unsigned char *record;
+static struct uprobe_sample *samples;
+static int nsamples, samples_size;
+
+static int read_sysfs(const char *path, const char *format, int *value)
+{
+	FILE *fp;
+	int ret;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+	ret = fscanf(fp, format, value);
+	fclose(fp);
+
+	return ret == 1 ? 0 : -1;
+}
+
+void uprobe_init(void)
+{
+	int i;
+
+	if (!arguments.uprobes)
+		return;
+	if (read_sysfs(UPROBE_PMU_DIR "/type", "%d", &pmu_type) < 0 ||
+	    read_sysfs(UPROBE_PMU_DIR "/format/retprobe", "config:%d",
+		       &retprobe_bit) < 0) {
+		msg_warn("uprobes are not supported by the kernel, "
+			 "using breakpoints instead");
+		arguments.uprobes = false;
+		return;
+	}
+	page_size = sysconf(_SC_PAGESIZE);
+	ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (ncpus < 1)
+		ncpus = 1;
+	system_wide = arguments.uprobes_system_wide;
+	rings = xcalloc(ncpus, sizeof(struct uprobe_ring));
+	for (i = 0; i < ncpus; i++)
+		rings[i].fd = -1;
+	pollfds = xcalloc(ncpus, sizeof(struct pollfd));
+	record = xmalloc(1 << 16);
+	probes = dict_init(dict_key2hash_int, dict_key_cmp_int);
+	debug(1, "uprobe PMU type %d, retprobe bit %d, %d CPUs", pmu_type,
+	      retprobe_bit, ncpus);
+}
+
+void uprobe_finish(void)
+{
+	struct uprobe_set *set, *next_set;
+	struct uprobe_key *key, *next_key;
+	struct uprobe *probe, *next_probe;
+	int i;
+
+	if (probes == NULL)
+		return;
+	for (i = 0; i < nevent_fds; i++)
+		close(event_fds[i]);
+	free(event_fds);
+	for (i = 0; i < ncpus; i++) {
+		if (rings[i].base)
+			munmap(rings[i].base, (RING_PAGES + 1) * page_size);
+	}
+	free(rings);
+	free(pollfds);
+	free(record);
+	free(samples);
+	dict_clear(probes);
+	probes = NULL;
+	for (probe = probe_list; probe; probe = next_probe) {
+		next_probe = probe->next;
+		free(probe->symbol);
+		free(probe);
+	}
+	for (set = sets; set; set = next_set) {
+		next_set = set->next;
+		for (key = set->keys; key; key = next_key) {
+			next_key = key->next;
+			free(key->path);
+			free(key);
+		}
+		free(set);
+	}
+}
+
+int uprobe_enabled(void)
+{
+	return probes != NULL;
+}
+
+static struct uprobe_set *set_get(pid_t pid)
+{
+	struct uprobe_set *set;
+
+	for (set = sets; set; set = set->next) {
+		if (set->pid == pid)
+			return set;
+	}
+	set = xcalloc(1, sizeof(struct uprobe_set));
+	set->pid = pid;
+	set->next = sets;
+	sets = set;
+
+	return set;
+}
+
+static int set_contains(struct uprobe_set *set, const char *path,
+			unsigned long offset)
+{
+	struct uprobe_key *key;
+
+	for (key = set->keys; key; key = key->next) {
+		if (key->offset == offset && strcmp(key->path, path) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static void set_add(struct uprobe_set *set, const char *path,
+		    unsigned long offset)
+{
+	struct uprobe_key *key;
+
+	key = xmalloc(sizeof(struct uprobe_key));
+	key->path = xstrdup(path);
+	key->offset = offset;
+	key->next = set->keys;
+	set->keys = key;
+}
+
+void uprobe_fork(struct process *parent, pid_t child_pid)
+{
+	struct uprobe_set *pset, *cset;
+	struct uprobe_key *key, *next;
+
+	if (!uprobe_enabled() || parent->shared == NULL)
+		return;
+	for (pset = sets; pset; pset = pset->next) {
+		if (pset->pid == parent->shared->main->pid)
+			break;
+	}
+	if (pset == NULL)
+		return;
+	/* the PID may be reused from an earlier traced process */
+	cset = set_get(child_pid);
+	for (key = cset->keys; key; key = next) {
+		next = key->next;
+		free(key->path);
+		free(key);
+	}
+	cset->keys = NULL;
+	for (key = pset->keys; key; key = key->next)
+		set_add(cset, key->path, key->offset);
+}
+
+static void add_event_fd(int fd)
+{
+	event_fds = xrealloc(event_fds, (nevent_fds + 1) * sizeof(int));
+	event_fds[nevent_fds++] = fd;
+}
+
+/* Redirects the event output to the ring buffer of the CPU, creating the
+ * buffer on the first event of the CPU. */
+static int ring_attach(int cpu, int fd)
+{
+	struct uprobe_ring *ring = &rings[cpu];
+	void *base;
+
+	if (ring->base)
+		return ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, ring->fd);
+
+	base = mmap(NULL, (RING_PAGES + 1) * page_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+		return -1;
+	ring->base = base;
+	ring->fd = fd;
+	pollfds[npollfds].fd = fd;
+	pollfds[npollfds].events = POLLIN;
+	npollfds++;
+
+	return 0;
+}
+
+/* Closes the events opened since the first one. The ring buffers they own
+ * were created by these events, so no other event writes there and the
+ * buffers are released too. */
+static void events_close(int first)
+{
+	int fd, i, j;
+
+	while (nevent_fds > first) {
+		fd = event_fds[--nevent_fds];
+		for (i = 0; i < ncpus; i++) {
+			if (rings[i].fd != fd)
+				continue;
+			munmap(rings[i].base, (RING_PAGES + 1) * page_size);
+			rings[i].base = NULL;
+			rings[i].fd = -1;
+			for (j = 0; j < npollfds; j++) {
+				if (pollfds[j].fd == fd) {
+					pollfds[j] = pollfds[--npollfds];
+					break;
+				}
+			}
+		}
+		close(fd);
+	}
+}
+
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu)
+{
+	return syscall(SYS_perf_event_open, attr, pid, cpu, -1, 0);
+}
+
+/* Opens the probe event on every CPU. */
+static int probe_open(pid_t pid, const char *path, unsigned long offset,
+		      const char *symbol, int retprobe)
+{
+	struct perf_event_attr attr;
+	struct uprobe *probe;
+	uint64_t *ids;
+	int cpu, fd, i, err, nids = 0, first = nevent_fds;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = pmu_type;
+	attr.config = retprobe ? 1ULL << retprobe_bit : 0;
+	attr.config1 = (uintptr_t)path;		/* uprobe_path */
+	attr.config2 = offset;			/* probe_offset */
+	attr.sample_period = 1;
+	attr.sample_type = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_TID |
+		PERF_SAMPLE_TIME | PERF_SAMPLE_REGS_USER |
+		PERF_SAMPLE_STACK_USER;
+	attr.sample_regs_user = (1ULL << ARRAY_SIZE(perf_reg_offset)) - 1;
+	attr.sample_stack_user = retprobe ? RETURN_STACK_SIZE : ENTRY_STACK_SIZE;
+	/* the sample times are compared against CLOCK_MONOTONIC */
+	attr.use_clockid = 1;
+	attr.clockid = CLOCK_MONOTONIC;
+	/* the system wide events follow every process already */
+	attr.inherit = pid != -1;
+	attr.wakeup_events = 1;
+
+	ids = xmalloc(ncpus * sizeof(uint64_t));
+	for (cpu = 0; cpu < ncpus; cpu++) {
+		fd = perf_event_open(&attr, pid, cpu);
+		if (fd < 0) {
+			/* offline CPU */
+			if (errno == ENODEV)
+				continue;
+			debug(1, "perf_event_open(%s+%#lx): %s", path, offset,
+			      strerror(errno));
+			goto err;
+		}
+		add_event_fd(fd);
+		if (ioctl(fd, PERF_EVENT_IOC_ID, &ids[nids]) < 0 ||
+		    ring_attach(cpu, fd) < 0) {
+			debug(1, "could not attach probe %s+%#lx to CPU %d: %s",
+			      path, offset, cpu, strerror(errno));
+			goto err;
+		}
+		nids++;
+	}
+	if (nids == 0)
+		goto err;
+
+	probe = xmalloc(sizeof(struct uprobe));
+	probe->symbol = xstrdup(symbol);
+	probe->retprobe = retprobe;
+	probe->next = probe_list;
+	probe_list = probe;
+	for (i = 0; i < nids; i++)
+		dict_enter(probes, (void *)(uintptr_t)ids[i], probe);
+	free(ids);
+
+	return 0;
+
+err:
+	err = errno;
+	events_close(first);
+	free(ids);
+	errno = err;
+
+	return -1;
+}
+
+/* Opens the entry and return probes of the function. */
+static int probes_open(pid_t pid, const char *path, unsigned long offset,
+		       const char *symbol)
+{
+	int err, first = nevent_fds;
+
+	if (probe_open(pid, path, offset, symbol, 0) < 0)
+		return -1;
+	if (probe_open(pid, path, offset, symbol, 1) < 0) {
+		err = errno;
+		events_close(first);
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+/* Opens the probes in every thread of the process, the events being
+ * inherited by the threads and processes created later. */
+static int probes_open_threads(pid_t pid, const char *path,
+			       unsigned long offset, const char *symbol)
+{
+	char proc_dir[32];
+	struct dirent *dir_name;
+	DIR *dir;
+	int tid, err, first = nevent_fds;
+
+	if (pid == -1)
+		return probes_open(pid, path, offset, symbol);
+	sprintf(proc_dir, "/proc/%d/task", pid);
+	dir = opendir(proc_dir);
+	if (dir == NULL)
+		return probes_open(pid, path, offset, symbol);
+	while ((dir_name = readdir(dir)) != NULL) {
+		if (dir_name->d_name[0] == '.')
+			continue;
+		tid = atoi(dir_name->d_name);
+		if (tid <= 0)
+			continue;
+		if (probes_open(tid, path, offset, symbol) < 0) {
+			err = errno;
+			closedir(dir);
+			events_close(first);
+			errno = err;
+			return -1;
+		}
+	}
+	closedir(dir);
+
+	return 0;
+}
+
+int uprobe_register(struct process *proc, const char *libname,
+		    const char *symname, addr_t symaddr)
+{
+	struct maps_index *index;
+	struct maps_data *md;
+	struct uprobe_set *set;
+	unsigned long offset;
+	pid_t pid;
+
+	if (!uprobe_enabled())
+		return -1;
+	/* Thumb functions need a breakpoint of different size */
+	if (symaddr & 1)
+		return -1;
+	index = maps_get(proc);
+	md = index ? maps_lookup(index, symaddr) : NULL;
+	if (md == NULL || strcmp(md->path, libname) != 0) {
+		debug(1, "no mapping found for %s", libname);
+		return -1;
+	}
+	/* probes are set at file offsets */
+	offset = symaddr - md->lo + md->off;
+	pid = system_wide ? -1 : proc->shared->main->pid;
+	set = set_get(pid);
+	if (set_contains(set, libname, offset))
+		return 0;
+
+	if (probes_open_threads(pid, libname, offset, symname) < 0) {
+		if (pid != -1 || (errno != EACCES && errno != EPERM))
+			return -1;
+		/* needs CAP_PERFMON or perf_event_paranoid <= 0 */
+		msg_warn("system wide uprobes are not permitted, "
+			 "probing the traced processes instead");
+		debug(1, "system wide probes not permitted, probing PID %d",
+		      proc->shared->main->pid);
+		system_wide = 0;
+		return uprobe_register(proc, libname, symname, symaddr);
+	}
+	set_add(set, libname, offset);
+
+	if (arguments.verbose)
+		fprintf(stderr, "Registered uprobe for function \"%s\" (%#x) "
+			"from %s (PID %d)\n", symname, symaddr, libname, pid);
+	debug(2, "uprobe registered for \"%s\" at %s+%#lx, PID %d", symname,
+	      libname, offset, pid);
+
+	return 0;
+}
+
+void uprobe_release(struct process *proc)
+{
+	struct callstack *cs;
+
+	while ((cs = proc->uprobe_stack) != NULL) {
+		proc->uprobe_stack = cs->next;
+		free(cs->data[0]);
+		free(cs);
+	}
+}
+
+/* Saves the function arguments on the function entry. */
+static void save_arguments(struct sample *sample)
+{
+	const elf_greg_t *regs = (const elf_greg_t *)&sample->regs;
+	addr_t sp = regs[SP_OFFSET], addr;
+	int i;
+
+	for (i = 0; i < SAMPLE_NARGS; i++) {
+#if defined(ARCH_ARM)
+		/* the first four arguments are passed in r0-r3 */
+		if (i < 4) {
+			sample->args[i] = regs[i];
+			continue;
+		}
+		addr = sp + 4 * (i - 4);
+#else
+		/* the arguments follow the return address */
+		addr = sp + 4 * (i + 1);
+#endif
+		if (sample_mem_read(sample, addr, &sample->args[i],
+				    sizeof(long)) < 0)
+			sample->args[i] = 0;
+	}
+}
+
+static void report_entry(struct process *proc, struct uprobe *probe,
+			 struct sample *sample)
+{
+	struct callback *cb = cb_get();
+	struct callstack *cs;
+
+	save_arguments(sample);
+	cs = xmalloc(sizeof(struct callstack));
+	cs->data[0] = xmalloc(sizeof(sample->args));
+	memcpy(cs->data[0], sample->args, sizeof(sample->args));
+	cs->data[1] = NULL;
+	cs->data[2] = probe->symbol;
+	cs->next = proc->uprobe_stack;
+	proc->uprobe_stack = cs;
+
+	if (cb && cb->function.enter)
+		cb->function.enter(proc, probe->symbol);
+}
+
+static void report_return(struct process *proc, struct uprobe *probe,
+			  struct sample *sample)
+{
+	struct callback *cb = cb_get();
+	struct callstack *cs, *dropped, *saved;
+
+	for (cs = proc->uprobe_stack; cs; cs = cs->next) {
+		if (strcmp(cs->data[2], probe->symbol) == 0)
+			break;
+	}
+	if (cs == NULL) {
+		debug(1, "return from %s without entry (pid=%d)", probe->symbol,
+		      proc->pid);
+		return;
+	}
+	/* drop the calls that never returned (e.g. left with longjmp()) */
+	while (proc->uprobe_stack != cs) {
+		dropped = proc->uprobe_stack;
+		debug(1, "dropping unfinished call of %s (pid=%d)",
+		      (char *)dropped->data[2], proc->pid);
+		proc->uprobe_stack = dropped->next;
+		free(dropped->data[0]);
+		free(dropped);
+	}
+	memcpy(sample->args, cs->data[0], sizeof(sample->args));
+
+	/* The callbacks see the call like it was caught by the breakpoints,
+	 * with the calls still pending in the callstack. */
+	saved = proc->callstack;
+	proc->callstack = cs;
+	if (cb && cb->function.exit)
+		cb->function.exit(proc, probe->symbol);
+	proc->callstack = saved;
+
+	proc->uprobe_stack = cs->next;
+	free(cs->data[0]);
+	free(cs);
+}
+
+static void report_sample(struct uprobe_sample *us)
+{
+	const elf_greg_t *regs = (const elf_greg_t *)&us->regs;
+	struct process *proc;
+	struct sample sample;
+	struct timespec ts;
+
+	/* the system wide probes are hit by the untraced processes too */
+	proc = process_from_pid(us->tid);
+	if (proc == NULL) {
+		debug(3, "sample from untraced thread %d", us->tid);
+		return;
+	}
+	sample_init(&sample, us->tid, regs[SP_OFFSET], us->stack,
+		    us->stack_size);
+	memcpy(&sample.regs, &us->regs, sizeof(elf_gregset_t));
+	/* the call is stamped with the time it was sampled */
+	ts.tv_sec = us->time / 1000000000;
+	ts.tv_nsec = us->time % 1000000000;
+	rp_set_event_time(&ts);
+	proc->sample = &sample;
+	if (us->probe->retprobe)
+		report_return(proc, us->probe, &sample);
+	else
+		report_entry(proc, us->probe, &sample);
+	proc->sample = NULL;
+	rp_set_event_time(NULL);
+	sample_finish(&sample);
+}
+
+/* Parses PERF_RECORD_SAMPLE in the sample_type order. */
+static void parse_sample(const unsigned char *p, size_t size)
+{
+	const unsigned char *end = p + size;
+	elf_greg_t *regs;
+	struct uprobe_sample *us;
+	struct uprobe *probe;
+	uint64_t id, time, abi, value, stack_size, dyn_size = 0;
+	uint32_t pid_tid[2];
+	const unsigned char *stack;
+	unsigned int i;
+
+	p += sizeof(struct perf_event_header);
+	memcpy(&id, p, 8);
+	p += 8;
+	memcpy(pid_tid, p, 8);
+	p += 8;
+	memcpy(&time, p, 8);
+	p += 8;
+	memcpy(&abi, p, 8);
+	p += 8;
+	if (abi != PERF_SAMPLE_REGS_ABI_NONE)
+		p += 8 * ARRAY_SIZE(perf_reg_offset);
+	if (p + 8 > end)
+		return;
+	memcpy(&stack_size, p, 8);
+	stack = p + 8;
+	if (stack_size) {
+		if (stack + stack_size + 8 > end)
+			return;
+		memcpy(&dyn_size, stack + stack_size, 8);
+	}
+
+	probe = dict_find_entry(probes, (void *)(uintptr_t)id);
+	if (probe == NULL || abi == PERF_SAMPLE_REGS_ABI_NONE)
+		return;
+
+	if (nsamples == samples_size) {
+		samples_size = samples_size ? 2 * samples_size : 64;
+		samples = xrealloc(samples,
+				   samples_size * sizeof(struct uprobe_sample));
+	}
+	us = &samples[nsamples++];
+	us->time = time;
+	us->tid = pid_tid[1];
+	us->probe = probe;
+	memset(&us->regs, 0, sizeof(elf_gregset_t));
+	regs = (elf_greg_t *)&us->regs;
+	p = stack - 8 - 8 * ARRAY_SIZE(perf_reg_offset);
+	for (i = 0; i < ARRAY_SIZE(perf_reg_offset); i++) {
+		memcpy(&value, p + 8 * i, 8);
+		regs[perf_reg_offset[i]] = value;
+	}
+	us->stack_size = dyn_size < stack_size ? dyn_size : stack_size;
+	us->stack = xmalloc(us->stack_size ? us->stack_size : 1);
+	memcpy(us->stack, stack, us->stack_size);
+}
+
+static void ring_copy(const unsigned char *data, size_t size, uint64_t pos,
+		      void *dst, size_t len)
+{
+	size_t off = pos & (size - 1);
+	size_t first = len < size - off ? len : size - off;
+
+	memcpy(dst, data + off, first);
+	memcpy((unsigned char *)dst + first, data, len - first);
+}
+
+static void ring_read(struct uprobe_ring *ring)
+{
+	struct perf_event_mmap_page *pg = ring->base;
+	const unsigned char *data = (unsigned char *)ring->base + page_size;
+	size_t size = RING_PAGES * page_size;
+	struct perf_event_header hdr;
+	uint64_t head, tail, lost;
+
+	head = pg->data_head;
+	__sync_synchronize();
+	for (tail = pg->data_tail; tail < head; tail += hdr.size) {
+		ring_copy(data, size, tail, &hdr, sizeof(hdr));
+		if (hdr.size < sizeof(hdr))
+			break;
+		ring_copy(data, size, tail, record, hdr.size);
+		if (hdr.type == PERF_RECORD_SAMPLE) {
+			parse_sample(record, hdr.size);
+		} else if (hdr.type == PERF_RECORD_LOST) {
+			memcpy(&lost, record + sizeof(hdr) + 8, 8);
+			msg_warn("%llu function calls were lost, the ring "
+				 "buffer is full", (unsigned long long)lost);
+		}
+	}
+	__sync_synchronize();
+	pg->data_tail = head;
+}
+
+static int sample_cmp(const void *a, const void *b)
+{
+	const struct uprobe_sample *s1 = a, *s2 = b;
+
+	if (s1->time != s2->time)
+		return s1->time < s2->time ? -1 : 1;
+	return 0;
+}
+
+/* Reports the samples from all the CPUs in the order they were taken. */
+void uprobe_read_samples(void)
+{
+	int i;
+
+	if (!uprobe_enabled())
+		return;
+	for (i = 0; i < ncpus; i++) {
+		if (rings[i].base)
+			ring_read(&rings[i]);
+	}
+	if (nsamples == 0)
+		return;
+	qsort(samples, nsamples, sizeof(struct uprobe_sample), sample_cmp);
+	for (i = 0; i < nsamples; i++) {
+		report_sample(&samples[i]);
+		free(samples[i].stack);
+	}
+	nsamples = 0;
+}
+
+void uprobe_poll(int timeout)
+{
+	poll(pollfds, npollfds, timeout);
+}
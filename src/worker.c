@@ -0,0 +1,228 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <dirent.h>
+#include <libiberty.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include "debug.h"
+#include "options.h"
+#include "solib.h"
+#include "trace.h"
+#include "worker.h"
+
+/* worker used when functracer runs single threaded */
+static struct worker default_worker;
+
+static struct worker *workers = &default_worker;
+static int nworkers = 1;
+
+static __thread struct worker *current_worker;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t registry_cond = PTHREAD_COND_INITIALIZER;
+
+/* threads the workers failed to attach */
+static pid_t *failed_tids;
+static int nfailed_tids;
+
+struct worker *worker_self(void)
+{
+	return current_worker ? current_worker : &workers[0];
+}
+
+void worker_for_each(void (*callback)(struct worker *, void *), void *data)
+{
+	int i;
+
+	for (i = 0; i < nworkers; i++)
+		callback(&workers[i], data);
+}
+
+int worker_owns(pid_t tid)
+{
+	struct worker *w = worker_self();
+	int i;
+
+	if (nworkers == 1)
+		return 1;
+	for (i = 0; i < w->ntids; i++) {
+		if (w->tids[i] == tid)
+			return 1;
+	}
+	return 0;
+}
+
+void worker_registry_lock(void)
+{
+	pthread_mutex_lock(&registry_lock);
+}
+
+void worker_registry_unlock(void)
+{
+	pthread_mutex_unlock(&registry_lock);
+}
+
+int worker_registry_wait(int timeout)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout;
+	return pthread_cond_timedwait(&registry_cond, &registry_lock, &ts);
+}
+
+void worker_attach_failed(pid_t tid)
+{
+	/* the symbols read for the process are not used */
+	solib_prepare_cancel(tid);
+	pthread_mutex_lock(&registry_lock);
+	failed_tids = xrealloc(failed_tids, (nfailed_tids + 1) * sizeof(pid_t));
+	failed_tids[nfailed_tids++] = tid;
+	pthread_cond_broadcast(&registry_cond);
+	pthread_mutex_unlock(&registry_lock);
+}
+
+int worker_failed(pid_t tid)
+{
+	int i;
+
+	for (i = 0; i < nfailed_tids; i++) {
+		if (failed_tids[i] == tid)
+			return 1;
+	}
+	return 0;
+}
+
+void worker_registry_notify(void)
+{
+	pthread_mutex_lock(&registry_lock);
+	pthread_cond_broadcast(&registry_cond);
+	pthread_mutex_unlock(&registry_lock);
+}
+
+static void worker_add_tid(struct worker *w, pid_t tid)
+{
+	w->tids = xrealloc(w->tids, (w->ntids + 1) * sizeof(pid_t));
+	w->tids[w->ntids++] = tid;
+	debug(2, "thread %d assigned to worker %d", tid, w->id);
+}
+
+/* Distributes threads of the process between workers. The main thread is
+ * assigned first, so that the worker owning it can initialize the data
+ * shared by all threads of the process. */
+static void worker_assign_threads(pid_t pid, int *next)
+{
+	char proc_dir[MAXPATHLEN];
+	struct dirent *dir_name;
+	DIR *dir;
+	int tid;
+
+	worker_add_tid(&workers[(*next)++ % nworkers], pid);
+
+	sprintf(proc_dir, "/proc/%d/task", pid);
+	dir = opendir(proc_dir);
+	if (dir == NULL)
+		return;
+	while ((dir_name = readdir(dir)) != NULL) {
+		if (dir_name->d_fileno == 0 || dir_name->d_name[0] == '.')
+			continue;
+		tid = atoi(dir_name->d_name);
+		if (tid <= 0 || tid == pid)
+			continue;
+		worker_add_tid(&workers[(*next)++ % nworkers], tid);
+	}
+	closedir(dir);
+}
+
+static void *worker_main(void *data)
+{
+	struct worker *w = data;
+	int i;
+
+	current_worker = w;
+	debug(1, "worker %d started with %d threads", w->id, w->ntids);
+	for (i = 0; i < w->ntids; i++)
+		trace_attach_thread(w->tids[i]);
+	w->retval = trace_main_loop();
+	debug(1, "worker %d finished (retval=%d)", w->id, w->retval);
+
+	return NULL;
+}
+
+int worker_run(void)
+{
+	int i, next = 0, ret = 0;
+
+	/* Read the library symbols while the processes are still running,
+	 * so that they are stopped only for inserting the breakpoints. */
+	for (i = 0; i < arguments.npids; i++)
+		solib_prepare(arguments.pid[i]);
+
+	/* Only attached processes are distributed between workers. A started
+	 * program and all of its threads are traced by the main thread. */
+	if (arguments.jobs <= 1 || arguments.npids == 0) {
+		current_worker = &default_worker;
+		for (i = 0; i < arguments.npids; i++)
+			trace_attach_child(arguments.pid[i]);
+		if (!arguments.npids)
+			trace_execute(arguments.remaining_args[0],
+				      arguments.remaining_args);
+		return trace_main_loop();
+	}
+
+	nworkers = arguments.jobs;
+	workers = xcalloc(nworkers, sizeof(struct worker));
+	for (i = 0; i < nworkers; i++)
+		workers[i].id = i;
+	for (i = 0; i < arguments.npids; i++)
+		worker_assign_threads(arguments.pid[i], &next);
+
+	for (i = 0; i < nworkers; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_main,
+				   &workers[i]) != 0) {
+			int j;
+
+			msg_err("pthread_create");
+			workers[i].retval = -1;
+			/* the other threads of these processes must not wait
+			 * for them to be attached */
+			for (j = 0; j < workers[i].ntids; j++)
+				worker_attach_failed(workers[i].tids[j]);
+			workers[i].ntids = 0;
+		}
+	}
+	for (i = 0; i < nworkers; i++) {
+		if (workers[i].thread)
+			pthread_join(workers[i].thread, NULL);
+		if (workers[i].retval)
+			ret = -1;
+	}
+
+	return ret;
+}
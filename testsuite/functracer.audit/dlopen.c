@@ -0,0 +1,51 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2011 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <dlfcn.h>
+
+/* Loads the library after the program has started, so that it is found
+ * from the dynamic linker list of libraries. The second time it is loaded
+ * after being removed from the list. */
+static int call_library(void)
+{
+	void *handle = dlopen("libdlopen.so", RTLD_NOW);
+	int (*func)(int);
+	int ret = -1;
+
+	if (handle == NULL) return -1;
+	func = (int (*)(int))dlsym(handle, "lib_dlopen");
+	if (func != NULL)
+		ret = func(0);
+	dlclose(handle);
+	return ret;
+}
+
+int main(void)
+{
+	if (call_library() < 0) return -1;
+	if (call_library() < 0) return -1;
+
+	return 0;
+}
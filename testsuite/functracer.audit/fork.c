@@ -0,0 +1,50 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2011 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern int lib_fork(void);
+extern int lib_child(int i);
+extern int lib_parent(int i);
+
+int main(void)
+{
+	int status;
+	pid_t pid;
+
+	pid = lib_fork();
+	if (pid == -1) return -1;
+	if (pid == 0) { /* child */
+		lib_child(0);
+		return 0;
+	}
+
+	/* parent */
+	waitpid(pid, &status, __WALL);
+	lib_parent(0);
+
+	return 0;
+}
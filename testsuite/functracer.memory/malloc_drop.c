@@ -0,0 +1,43 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2008 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <stdlib.h>
+
+/* Allocates more than the trace output buffer holds. Nothing is printed,
+ * as the trace is written to the standard output. */
+int main(void)
+{
+	char *x;
+	int i;
+
+	for (i = 0; i < 300000; i++) {
+		x = malloc(i % 1000 + 1);
+		free(x);
+	}
+	/* allocated after the dropped output */
+	x = malloc(123456);
+	free(x);
+
+	return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2011 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define PAGE_SIZE	4096
+
+int main(void)
+{
+	char path[] = "/tmp/mmap_offsetXXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1) return 0;
+	unlink(path);
+	if (ftruncate(fd, 4 * PAGE_SIZE) == 0) {
+		/* the offset is passed to mmap2 in pages */
+		void* ptr = mmap(NULL, PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 2 * PAGE_SIZE);
+		if (ptr != MAP_FAILED) {
+			munmap(ptr, PAGE_SIZE);
+		}
+	}
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of Functracer.
+ *
+ * Copyright (C) 2011-2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define NTHREADS 4
+
+/* Give the tracer time to attach to all the threads. */
+static void *entry(void *arg)
+{
+	sleep(2);
+	free(malloc(1000 + (long)arg));
+	return NULL;
+}
+
+int main(void)
+{
+	pthread_t th[NTHREADS];
+	long i;
+
+	for (i = 0; i < NTHREADS; i++)
+		pthread_create(&th[i], NULL, entry, (void *)i);
+	for (i = 0; i < NTHREADS; i++)
+		pthread_join(th[i], NULL);
+	return 0;
+}